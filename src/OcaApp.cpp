@@ -25,6 +25,9 @@
 #include "OcaOctaveController.h"
 #include "OcaAudioController.h"
 #include "OcaObjectListener.h"
+#include "OcaSampleCompressor.h"
+#include "OcaSampleWriter.h"
+#include "OcaPyramidBuilder.h"
 
 #include <QtCore>
 #include <QtNetwork>
@@ -41,6 +44,9 @@ OcaApp::OcaApp( int& argc, char** argv, bool gui_enabled )
   m_audioController( NULL ),
   m_mainWindow( NULL ),
   m_gcTimer( NULL ),
+  m_compressor( NULL ),
+  m_sampleWriter( NULL ),
+  m_pyramidBuilder( NULL ),
   m_nextId( 1 )
 {
   setApplicationName( "octaudio" );
@@ -54,6 +60,21 @@ OcaApp::OcaApp( int& argc, char** argv, bool gui_enabled )
 
 OcaApp::~OcaApp()
 {
+  if( NULL != m_compressor ) {
+    m_compressor->stop();
+    delete m_compressor;
+    m_compressor = NULL;
+  }
+  if( NULL != m_sampleWriter ) {
+    m_sampleWriter->stop();
+    delete m_sampleWriter;
+    m_sampleWriter = NULL;
+  }
+  if( NULL != m_pyramidBuilder ) {
+    m_pyramidBuilder->stop();
+    delete m_pyramidBuilder;
+    m_pyramidBuilder = NULL;
+  }
   if( NULL != m_ocaInstance ) {
     Q_ASSERT( NULL != m_audioController );
     Q_ASSERT( NULL != m_octaveController );
@@ -176,6 +197,12 @@ int OcaApp::run()
   window_data->setName( applicationName() );
   m_ocaInstance->setWindow( window_data );
   m_octaveController->startThread();
+  m_pyramidBuilder = new OcaPyramidBuilder();
+  m_pyramidBuilder->start();
+  m_compressor = new OcaSampleCompressor();
+  m_compressor->start( QThread::LowestPriority );
+  m_sampleWriter = new OcaSampleWriter();
+  m_sampleWriter->start();
   return exec();
 }
 
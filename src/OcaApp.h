@@ -34,6 +34,9 @@ class OcaAudioController;
 class OcaObjectListener;
 class OcaMainWindow;
 class OcaObject;
+class OcaSampleCompressor;
+class OcaSampleWriter;
+class OcaPyramidBuilder;
 class QTimer;
 
 class OcaApp : public QApplication
@@ -50,6 +53,7 @@ class OcaApp : public QApplication
     static OcaInstance* getOcaInstance() { return getSelf()->m_ocaInstance; }
     static OcaOctaveController* getOctaveController() { return getSelf()->m_octaveController; }
     static OcaAudioController*  getAudioController() { return getSelf()->m_audioController; }
+    static OcaPyramidBuilder*   getPyramidBuilder() { return getSelf()->m_pyramidBuilder; }
     static QDir getDataCacheDir() { return getSelf()->checkDataCacheDir(); }
 
   protected:
@@ -83,6 +87,9 @@ class OcaApp : public QApplication
     QHash<oca_ulong,OcaObject*>   m_objects;
     mutable QMutex                m_mutex;
     QTimer*                       m_gcTimer;
+    OcaSampleCompressor*          m_compressor;
+    OcaSampleWriter*              m_sampleWriter;
+    OcaPyramidBuilder*            m_pyramidBuilder;
 
     QFile   m_sessionFile;
     QDir    m_dataCacheDir;
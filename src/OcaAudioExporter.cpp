@@ -0,0 +1,255 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "OcaAudioExporter.h"
+#include "OcaSampleFormat.h"
+
+#include <QtCore>
+
+#ifdef OCA_USE_SNDFILE
+#include <sndfile.h>
+#endif
+
+// the data chunk starts after the RIFF header, the ds64 (or JUNK) chunk
+// reserving the place for the RF64 sizes, and the fmt chunk
+static const qint64 WAV_HEADER_SIZE = 12 + 8 + 28 + 8 + 16 + 8;
+
+// ------------------------------------------------------------------------------------
+
+static void put_le( uchar* dst, quint64 value, int size )
+{
+  for( int i = 0; i < size; i++ ) {
+    dst[i] = ( value >> ( 8 * i ) ) & 0xff;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaAudioExporter::OcaAudioExporter( const QString& path, int channels, double rate,
+                                                              int format, bool dither )
+:
+  m_path( path ),
+  m_channels( channels ),
+  m_rate( rate ),
+  m_format( format ),
+  m_dither( dither && ( OcaSampleFormat::e_FormatInt16 <= format ) ),
+  m_length( 0 ),
+  m_file( path ),
+  m_sndfile( NULL ),
+  m_random( 0x9e3779b9 )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaAudioExporter::~OcaAudioExporter()
+{
+  close();
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaAudioExporter::open( QString* error )
+{
+  if( m_path.endsWith( ".flac", Qt::CaseInsensitive ) ) {
+#ifdef OCA_USE_SNDFILE
+    SF_INFO info;
+    memset( &info, 0, sizeof(info) );
+    info.samplerate = qRound( m_rate );
+    info.channels = m_channels;
+    if( OcaSampleFormat::e_FormatInt16 == m_format ) {
+      info.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+    }
+    else if( OcaSampleFormat::e_FormatInt24 == m_format ) {
+      info.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+    }
+    else {
+      *error = "flac supports only int16 and int24 formats";
+      return false;
+    }
+    SNDFILE* sf = sf_open( m_path.toLocal8Bit().data(), SFM_WRITE, &info );
+    if( NULL == sf ) {
+      *error = sf_strerror( NULL );
+      return false;
+    }
+    m_sndfile = sf;
+    return true;
+#else
+    *error = "flac export needs octaudio built with libsndfile";
+    return false;
+#endif
+  }
+
+  if( ! m_file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+    *error = m_file.errorString();
+    return false;
+  }
+  if( ! writeHeader( false ) ) {
+    *error = m_file.errorString();
+    return false;
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaAudioExporter::writeHeader( bool final )
+{
+  // the sizes are patched by the final call, above 4 GB the file becomes RF64
+  const int K = m_channels * OcaSampleFormat::getSampleSize( m_format );
+  const quint64 data_size = m_length * K;
+  const quint64 riff_size = WAV_HEADER_SIZE - 8 + data_size + ( data_size & 1 );
+  const bool rf64 = ( Q_UINT64_C(0xFFFFFFFF) < riff_size );
+  const bool is_float = ( OcaSampleFormat::e_FormatFloat32 >= m_format );
+
+  uchar h[ WAV_HEADER_SIZE ];
+  memset( h, 0, sizeof(h) );
+  memcpy( h, rf64 ? "RF64" : "RIFF", 4 );
+  put_le( h + 4, rf64 ? 0xFFFFFFFF : riff_size, 4 );
+  memcpy( h + 8, "WAVE", 4 );
+  memcpy( h + 12, rf64 ? "ds64" : "JUNK", 4 );
+  put_le( h + 16, 28, 4 );
+  if( rf64 ) {
+    put_le( h + 20, riff_size, 8 );
+    put_le( h + 28, data_size, 8 );
+    put_le( h + 36, m_length, 8 );
+  }
+  memcpy( h + 48, "fmt ", 4 );
+  put_le( h + 52, 16, 4 );
+  put_le( h + 56, is_float ? 3 : 1, 2 );
+  put_le( h + 58, m_channels, 2 );
+  put_le( h + 60, qRound( m_rate ), 4 );
+  put_le( h + 64, qRound( m_rate ) * K, 4 );
+  put_le( h + 68, K, 2 );
+  put_le( h + 70, 8 * OcaSampleFormat::getSampleSize( m_format ), 2 );
+  memcpy( h + 72, "data", 4 );
+  put_le( h + 76, rf64 ? 0xFFFFFFFF : data_size, 4 );
+
+  if( final && ( data_size & 1 ) ) {
+    m_file.seek( WAV_HEADER_SIZE + data_size );
+    m_file.write( "", 1 );
+  }
+  return m_file.seek( 0 ) && ( WAV_HEADER_SIZE == m_file.write( (const char*)h, sizeof(h) ) );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaAudioExporter::addDither( OcaDataVector* data )
+{
+  // triangular noise of one lsb, the sum of two uniform values
+  const double lsb = ( OcaSampleFormat::e_FormatInt16 == m_format ) ?
+                                                1.0 / 32768 : 1.0 / 8388608;
+  const double k = lsb / 4294967296.0;
+  double* v = data->data();
+  const long count = data->length() * data->channels();
+  quint32 r = m_random;
+  for( long i = 0; i < count; i++ ) {
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    const quint32 a = r;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    v[i] += ( (double)a - (double)r ) * k;
+  }
+  m_random = r;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaAudioExporter::write( OcaDataVector* data )
+{
+  // the data is modified by the dither
+  Q_ASSERT( data->channels() == m_channels );
+  const long len = data->length();
+  if( 0 == len ) {
+    return true;
+  }
+  if( m_dither ) {
+    addDither( data );
+  }
+  const long count = len * m_channels;
+  m_buffer.resize( count * OcaSampleFormat::getSampleSize( m_format ) );
+  OcaSampleFormat::encode( m_format, m_buffer.data(), data->constData(), count );
+
+#ifdef OCA_USE_SNDFILE
+  if( NULL != m_sndfile ) {
+    SNDFILE* sf = (SNDFILE*)m_sndfile;
+    sf_count_t n = 0;
+    if( OcaSampleFormat::e_FormatInt16 == m_format ) {
+      n = sf_writef_short( sf, (const short*)m_buffer.constData(), len );
+    }
+    else {
+      // the 24 bit samples are passed left aligned in 32 bits
+      QVector<int> tmp( count );
+      const uchar* src = (const uchar*)m_buffer.constData();
+      for( long i = 0; i < count; i++ ) {
+        tmp[i] = (int)( ( (quint32)src[0] << 8 ) | ( (quint32)src[1] << 16 )
+                                                  | ( (quint32)src[2] << 24 ) );
+        src += 3;
+      }
+      n = sf_writef_int( sf, tmp.constData(), len );
+    }
+    m_length += n;
+    return ( n == len );
+  }
+#endif
+
+  const qint64 n = m_file.write( m_buffer.constData(), m_buffer.size() );
+  if( n != m_buffer.size() ) {
+    return false;
+  }
+  m_length += len;
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaAudioExporter::close()
+{
+#ifdef OCA_USE_SNDFILE
+  if( NULL != m_sndfile ) {
+    bool ok = ( 0 == sf_close( (SNDFILE*)m_sndfile ) );
+    m_sndfile = NULL;
+    return ok;
+  }
+#endif
+  if( ! m_file.isOpen() ) {
+    return true;
+  }
+  bool ok = writeHeader( true );
+  m_file.close();
+  return ok;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaAudioExporter::abort()
+{
+#ifdef OCA_USE_SNDFILE
+  if( NULL != m_sndfile ) {
+    sf_close( (SNDFILE*)m_sndfile );
+    m_sndfile = NULL;
+  }
+#endif
+  m_file.close();
+  QFile::remove( m_path );
+}
+
+// ------------------------------------------------------------------------------------
@@ -0,0 +1,65 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaAudioExporter_h
+#define OcaAudioExporter_h
+
+#include "OcaDataVector.h"
+
+#include <QFile>
+#include <QByteArray>
+
+// Streaming writer of the audio files. The frames are converted to the given
+// storage format (see OcaSampleFormat), optionally with TPDF dither for the
+// integer formats. Wav files are written natively and become RF64 once they
+// grow above 4 GB, the files with the .flac extension need libsndfile.
+// abort() closes and removes an incomplete file.
+
+class OcaAudioExporter
+{
+  public:
+    OcaAudioExporter( const QString& path, int channels, double rate,
+                                                          int format, bool dither );
+    ~OcaAudioExporter();
+
+  public:
+    bool open( QString* error );
+    bool write( OcaDataVector* data );
+    bool close();
+    void abort();
+    qint64 getLength() const { return m_length; }
+
+  protected:
+    void addDither( OcaDataVector* data );
+    bool writeHeader( bool final );
+
+  protected:
+    const QString   m_path;
+    const int       m_channels;
+    const double    m_rate;
+    const int       m_format;
+    const bool      m_dither;
+    qint64          m_length;
+    QFile           m_file;
+    void*           m_sndfile;
+    QByteArray      m_buffer;
+    quint32         m_random;
+};
+
+#endif // OcaAudioExporter_h
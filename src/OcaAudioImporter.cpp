@@ -0,0 +1,229 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "OcaAudioImporter.h"
+#include "OcaTrackDataBlock.h"
+#include "OcaSampleFormat.h"
+#include "OcaWavFile.h"
+
+#include <QtCore>
+
+#ifdef OCA_USE_SNDFILE
+#include <sndfile.h>
+#endif
+
+const long OcaAudioImporter::s_CHUNK_LENGTH = 0x10000;
+const int  OcaAudioImporter::s_QUEUE_SIZE = 8;
+
+// ------------------------------------------------------------------------------------
+
+OcaAudioImporter::OcaAudioImporter( const QString& path )
+:
+  m_path( path ),
+  m_rate( 0 ),
+  m_channels( 0 ),
+  m_format( OcaSampleFormat::e_FormatDouble ),
+  m_length( -1 ),
+  m_position( 0 ),
+  m_file( path ),
+  m_fileFormat( -1 ),
+  m_remaining( 0 ),
+  m_sndfile( NULL ),
+  m_done( false ),
+  m_failed( false ),
+  m_run( true )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaAudioImporter::~OcaAudioImporter()
+{
+  cancel();
+  wait();
+  while( ! m_queue.isEmpty() ) {
+    delete m_queue.takeFirst();
+  }
+#ifdef OCA_USE_SNDFILE
+  if( NULL != m_sndfile ) {
+    sf_close( (SNDFILE*)m_sndfile );
+    m_sndfile = NULL;
+  }
+#endif
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaAudioImporter::open( QString* error )
+{
+  OcaWavFile::Info info;
+  QString wav_error;
+  if( OcaWavFile::readInfo( m_path, &info, &wav_error ) ) {
+    if( ! ( m_file.open( QIODevice::ReadOnly ) && m_file.seek( info.offset ) ) ) {
+      *error = "can't open file";
+      return false;
+    }
+    m_rate = info.rate;
+    m_channels = info.channels;
+    m_format = info.format;
+    m_fileFormat = info.format;
+    m_length = info.length;
+    m_remaining = info.length;
+    return true;
+  }
+
+#ifdef OCA_USE_SNDFILE
+  SF_INFO sf_info;
+  memset( &sf_info, 0, sizeof(sf_info) );
+  SNDFILE* sf = sf_open( m_path.toLocal8Bit().data(), SFM_READ, &sf_info );
+  if( NULL == sf ) {
+    *error = sf_strerror( NULL );
+    return false;
+  }
+  m_sndfile = sf;
+  m_rate = sf_info.samplerate;
+  m_channels = sf_info.channels;
+  m_length = sf_info.frames;
+  switch( sf_info.format & SF_FORMAT_SUBMASK ) {
+    case SF_FORMAT_PCM_S8:
+    case SF_FORMAT_PCM_U8:
+    case SF_FORMAT_PCM_16:
+      m_format = OcaSampleFormat::e_FormatInt16;
+      break;
+    case SF_FORMAT_PCM_24:
+      m_format = OcaSampleFormat::e_FormatInt24;
+      break;
+    case SF_FORMAT_DOUBLE:
+      m_format = OcaSampleFormat::e_FormatDouble;
+      break;
+    default:
+      m_format = OcaSampleFormat::e_FormatFloat32;
+      break;
+  }
+  return ( 0 < m_channels ) && ( 0 < m_rate );
+#else
+  *error = wav_error;
+  return false;
+#endif
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaAudioImporter::decode( OcaDataVector* dst )
+{
+  // returns the number of frames, 0 at the end, or -1 on errors
+#ifdef OCA_USE_SNDFILE
+  if( NULL != m_sndfile ) {
+    SNDFILE* sf = (SNDFILE*)m_sndfile;
+    long len = sf_readf_double( sf, dst->data(), s_CHUNK_LENGTH );
+    return ( SF_ERR_NO_ERROR == sf_error( sf ) ) ? qMax( 0l, len ) : -1;
+  }
+#endif
+  const int K = m_channels * OcaSampleFormat::getSampleSize( m_fileFormat );
+  const long len = qMin( m_remaining, (qint64)s_CHUNK_LENGTH );
+  if( 0 == len ) {
+    return 0;
+  }
+  QByteArray buffer( len * K, Qt::Uninitialized );
+  if( len * K != m_file.read( buffer.data(), len * K ) ) {
+    return -1;
+  }
+  OcaSampleFormat::decode( m_fileFormat, dst->data(), buffer.constData(), len * m_channels );
+  m_remaining -= len;
+  return len;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaAudioImporter::run()
+{
+  for( ; ; ) {
+    OcaDataVector* chunk = new OcaDataVector( m_channels, s_CHUNK_LENGTH );
+    long len = m_run ? decode( chunk ) : 0;
+    QMutexLocker locker( &m_mutex );
+    if( 0 >= len ) {
+      delete chunk;
+      m_failed = m_failed || ( 0 > len );
+      m_done = true;
+      m_condition.wakeAll();
+      return;
+    }
+    chunk->setLength( len );
+    while( m_run && ( s_QUEUE_SIZE <= m_queue.size() ) ) {
+      m_condition.wait( &m_mutex );
+    }
+    m_queue.append( chunk );
+    m_condition.wakeAll();
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaAudioImporter::writeNext( OcaTrackDataBlock* dst )
+{
+  // appends the next chunk to the block, returns false at the end
+  OcaDataVector* chunk = NULL;
+  {
+    QMutexLocker locker( &m_mutex );
+    while( m_run && m_queue.isEmpty() && ( ! m_done ) ) {
+      m_condition.wait( &m_mutex );
+    }
+    if( ( ! m_run ) || m_queue.isEmpty() ) {
+      return false;
+    }
+    chunk = m_queue.takeFirst();
+    m_condition.wakeAll();
+  }
+  const long chunk_len = chunk->length();
+  long len = dst->write( chunk, dst->getLength() );
+  delete chunk;
+  m_position += len;
+  if( len < chunk_len ) {
+    // the storage failed, the decoder is stopped so it doesn't wait for
+    // the queue forever
+    QMutexLocker locker( &m_mutex );
+    m_failed = true;
+    m_run = false;
+    m_condition.wakeAll();
+    return false;
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaAudioImporter::cancel()
+{
+  // the import is incomplete, so it is reported as failed
+  QMutexLocker locker( &m_mutex );
+  if( ! m_done ) {
+    m_failed = true;
+  }
+  m_run = false;
+  m_condition.wakeAll();
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaAudioImporter::isFailed() const
+{
+  QMutexLocker locker( &m_mutex );
+  return m_failed;
+}
+
+// ------------------------------------------------------------------------------------
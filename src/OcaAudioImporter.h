@@ -0,0 +1,86 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaAudioImporter_h
+#define OcaAudioImporter_h
+
+#include "OcaDataVector.h"
+
+#include <QThread>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+
+class OcaTrackDataBlock;
+
+// Import pipeline of the audio files. The decoder thread fills a bounded queue
+// of chunks, and the caller converts them to the storage format by writing them
+// to a data block with writeNext(), so it can report the progress and cancel
+// the import between the chunks. The wav (RF64) files with the sample formats
+// of OcaSampleFormat are decoded natively, the other files need libsndfile.
+
+class OcaAudioImporter : public QThread
+{
+  public:
+    OcaAudioImporter( const QString& path );
+    ~OcaAudioImporter();
+
+  public:
+    bool   open( QString* error );
+    double getSampleRate() const { return m_rate; }
+    int    getChannels() const { return m_channels; }
+    int    getFormat() const { return m_format; }
+    qint64 getLength() const { return m_length; }
+    qint64 getPosition() const { return m_position; }
+
+    bool writeNext( OcaTrackDataBlock* dst );
+    void cancel();
+    bool isFailed() const;
+
+  protected:
+    void run();
+    long decode( OcaDataVector* dst );
+
+  protected:
+    const QString   m_path;
+    double          m_rate;
+    int             m_channels;
+    int             m_format;
+    qint64          m_length;
+    qint64          m_position;
+
+    QFile           m_file;
+    int             m_fileFormat;
+    qint64          m_remaining;
+    void*           m_sndfile;
+
+    mutable QMutex  m_mutex;
+    QWaitCondition  m_condition;
+    QList<OcaDataVector*> m_queue;
+    bool            m_done;
+    bool            m_failed;
+    volatile bool   m_run;
+
+  protected:
+    static const long s_CHUNK_LENGTH;
+    static const int  s_QUEUE_SIZE;
+};
+
+#endif // OcaAudioImporter_h
@@ -0,0 +1,454 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaAvgKernel.h"
+
+#include <QtCore>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined( __SSE2__ ) && defined( __GNUC__ ) && defined( __x86_64__ )
+// avx2 kernels are compiled for the target attribute and selected at runtime
+#define OCA_AVX2_KERNELS
+#include <immintrin.h>
+#define OCA_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#endif
+
+typedef void (*AvgFunc)( OcaAvgData*, const double*, int, long, int );
+typedef void (*Avg2Func)( OcaAvgData*, const OcaAvgData*, int, long, int );
+
+// ------------------------------------------------------------------------------------
+
+static inline void set_entry( OcaAvgData* d, double min, double max,
+                                            double sum, double sumsq, int factor )
+{
+  d->min = min;
+  d->max = max;
+  d->avg = sum / factor;
+  d->var = sumsq / factor - d->avg * d->avg;
+}
+
+// ------------------------------------------------------------------------------------
+
+static inline void avg_column( OcaAvgData* d, const double* v, int stride, int factor )
+{
+  double min = *v;
+  double max = *v;
+  double sum = 0;
+  double sumsq = 0;
+  for( int i = 0; i < factor; i++ ) {
+    min = qMin( min, *v );
+    max = qMax( max, *v );
+    sum += *v;
+    sumsq += (*v) * (*v);
+    v += stride;
+  }
+  set_entry( d, min, max, sum, sumsq, factor );
+}
+
+// ------------------------------------------------------------------------------------
+
+static inline void avg2_column( OcaAvgData* d, const OcaAvgData* v, int stride, int factor )
+{
+  double min = v->min;
+  double max = v->max;
+  double sum = 0;
+  double sumsq = 0;
+  for( int i = 0; i < factor; i++ ) {
+    min = qMin( min, v->min );
+    max = qMax( max, v->max );
+    sum += v->avg;
+    sumsq += v->avg * v->avg + v->var;
+    v += stride;
+  }
+  set_entry( d, min, max, sum, sumsq, factor );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaAvgKernel::calcAvgScalar( OcaAvgData* dst, const double* src,
+                                            int channels, long len, int factor )
+{
+  for( long j = 0; j < len; j++ ) {
+    for( int c = 0; c < channels; c++ ) {
+      avg_column( dst++, src + c, channels, factor );
+    }
+    src += factor * channels;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaAvgKernel::calcAvg2Scalar( OcaAvgData* dst, const OcaAvgData* src,
+                                            int channels, long len, int factor )
+{
+  for( long j = 0; j < len; j++ ) {
+    for( int c = 0; c < channels; c++ ) {
+      avg2_column( dst++, src + c, channels, factor );
+    }
+    src += factor * channels;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+#ifdef __SSE2__
+
+static inline void avg_columns_sse2( OcaAvgData* d, const double* v, int stride, int factor )
+{
+  // two adjacent channels at once
+  __m128d min = _mm_loadu_pd( v );
+  __m128d max = min;
+  __m128d sum = _mm_setzero_pd();
+  __m128d sumsq = _mm_setzero_pd();
+  for( int i = 0; i < factor; i++ ) {
+    __m128d x = _mm_loadu_pd( v );
+    min = _mm_min_pd( min, x );
+    max = _mm_max_pd( max, x );
+    sum = _mm_add_pd( sum, x );
+    sumsq = _mm_add_pd( sumsq, _mm_mul_pd( x, x ) );
+    v += stride;
+  }
+  double r[4][2];
+  _mm_storeu_pd( r[0], min );
+  _mm_storeu_pd( r[1], max );
+  _mm_storeu_pd( r[2], sum );
+  _mm_storeu_pd( r[3], sumsq );
+  set_entry( d, r[0][0], r[1][0], r[2][0], r[3][0], factor );
+  set_entry( d + 1, r[0][1], r[1][1], r[2][1], r[3][1], factor );
+}
+
+// ------------------------------------------------------------------------------------
+
+static void calc_avg_sse2( OcaAvgData* dst, const double* src,
+                                            int channels, long len, int factor )
+{
+  if( ( 1 == channels ) && ( 0 == factor % 2 ) ) {
+    // mono data: two frames per register, the halves are merged at the end
+    for( long j = 0; j < len; j++ ) {
+      __m128d min = _mm_loadu_pd( src );
+      __m128d max = min;
+      __m128d sum = _mm_setzero_pd();
+      __m128d sumsq = _mm_setzero_pd();
+      for( int i = 0; i < factor; i += 2 ) {
+        __m128d x = _mm_loadu_pd( src + i );
+        min = _mm_min_pd( min, x );
+        max = _mm_max_pd( max, x );
+        sum = _mm_add_pd( sum, x );
+        sumsq = _mm_add_pd( sumsq, _mm_mul_pd( x, x ) );
+      }
+      double r[4][2];
+      _mm_storeu_pd( r[0], min );
+      _mm_storeu_pd( r[1], max );
+      _mm_storeu_pd( r[2], sum );
+      _mm_storeu_pd( r[3], sumsq );
+      set_entry( dst++, qMin( r[0][0], r[0][1] ), qMax( r[1][0], r[1][1] ),
+                        r[2][0] + r[2][1], r[3][0] + r[3][1], factor );
+      src += factor;
+    }
+    return;
+  }
+
+  for( long j = 0; j < len; j++ ) {
+    int c = 0;
+    for( ; c + 2 <= channels; c += 2 ) {
+      avg_columns_sse2( dst + c, src + c, channels, factor );
+    }
+    for( ; c < channels; c++ ) {
+      avg_column( dst + c, src + c, channels, factor );
+    }
+    dst += channels;
+    src += factor * channels;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static void calc_avg2_sse2( OcaAvgData* dst, const OcaAvgData* src,
+                                            int channels, long len, int factor )
+{
+  for( long j = 0; j < len; j++ ) {
+    for( int c = 0; c < channels; c++ ) {
+      // (min,max) and (avg,var) pairs
+      const double* v = &src[c].min;
+      const int stride = channels * 4;
+      __m128d min = _mm_loadu_pd( v );
+      __m128d max = min;
+      __m128d sum = _mm_setzero_pd();
+      __m128d sumsq = _mm_setzero_pd();
+      for( int i = 0; i < factor; i++ ) {
+        __m128d a = _mm_loadu_pd( v );
+        __m128d b = _mm_loadu_pd( v + 2 );
+        min = _mm_min_pd( min, a );
+        max = _mm_max_pd( max, a );
+        sum = _mm_add_pd( sum, b );
+        sumsq = _mm_add_pd( sumsq, _mm_mul_pd( b, b ) );
+        v += stride;
+      }
+      double r[4][2];
+      _mm_storeu_pd( r[0], min );
+      _mm_storeu_pd( r[1], max );
+      _mm_storeu_pd( r[2], sum );
+      _mm_storeu_pd( r[3], sumsq );
+      set_entry( dst++, r[0][0], r[1][1], r[2][0], r[3][0] + r[2][1], factor );
+    }
+    src += factor * channels;
+  }
+}
+
+#endif // __SSE2__
+
+// ------------------------------------------------------------------------------------
+
+#ifdef OCA_AVX2_KERNELS
+
+OCA_TARGET_AVX2
+static void calc_avg_avx2( OcaAvgData* dst, const double* src,
+                                            int channels, long len, int factor )
+{
+  // frames per register when the channels fit into it
+  int rows = ( 4 % channels ) ? 0 : 4 / channels;
+  if( ( 0 < rows ) && ( 0 == factor % rows ) ) {
+    for( long j = 0; j < len; j++ ) {
+      __m256d min = _mm256_loadu_pd( src );
+      __m256d max = min;
+      __m256d sum = _mm256_setzero_pd();
+      __m256d sumsq = _mm256_setzero_pd();
+      for( int i = 0; i < factor * channels; i += 4 ) {
+        __m256d x = _mm256_loadu_pd( src + i );
+        min = _mm256_min_pd( min, x );
+        max = _mm256_max_pd( max, x );
+        sum = _mm256_add_pd( sum, x );
+        sumsq = _mm256_add_pd( sumsq, _mm256_mul_pd( x, x ) );
+      }
+      double r[4][4];
+      _mm256_storeu_pd( r[0], min );
+      _mm256_storeu_pd( r[1], max );
+      _mm256_storeu_pd( r[2], sum );
+      _mm256_storeu_pd( r[3], sumsq );
+      // lane k holds channel k % channels
+      for( int c = 0; c < channels; c++ ) {
+        double mn = r[0][c];
+        double mx = r[1][c];
+        double s = r[2][c];
+        double q = r[3][c];
+        for( int k = c + channels; k < 4; k += channels ) {
+          mn = qMin( mn, r[0][k] );
+          mx = qMax( mx, r[1][k] );
+          s += r[2][k];
+          q += r[3][k];
+        }
+        set_entry( dst++, mn, mx, s, q, factor );
+      }
+      src += factor * channels;
+    }
+    return;
+  }
+
+  for( long j = 0; j < len; j++ ) {
+    int c = 0;
+    for( ; c + 4 <= channels; c += 4 ) {
+      const double* v = src + c;
+      __m256d min = _mm256_loadu_pd( v );
+      __m256d max = min;
+      __m256d sum = _mm256_setzero_pd();
+      __m256d sumsq = _mm256_setzero_pd();
+      for( int i = 0; i < factor; i++ ) {
+        __m256d x = _mm256_loadu_pd( v );
+        min = _mm256_min_pd( min, x );
+        max = _mm256_max_pd( max, x );
+        sum = _mm256_add_pd( sum, x );
+        sumsq = _mm256_add_pd( sumsq, _mm256_mul_pd( x, x ) );
+        v += channels;
+      }
+      double r[4][4];
+      _mm256_storeu_pd( r[0], min );
+      _mm256_storeu_pd( r[1], max );
+      _mm256_storeu_pd( r[2], sum );
+      _mm256_storeu_pd( r[3], sumsq );
+      for( int k = 0; k < 4; k++ ) {
+        set_entry( dst + c + k, r[0][k], r[1][k], r[2][k], r[3][k], factor );
+      }
+    }
+    for( ; c + 2 <= channels; c += 2 ) {
+      avg_columns_sse2( dst + c, src + c, channels, factor );
+    }
+    for( ; c < channels; c++ ) {
+      avg_column( dst + c, src + c, channels, factor );
+    }
+    dst += channels;
+    src += factor * channels;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+OCA_TARGET_AVX2
+static void calc_avg2_avx2( OcaAvgData* dst, const OcaAvgData* src,
+                                            int channels, long len, int factor )
+{
+  for( long j = 0; j < len; j++ ) {
+    for( int c = 0; c < channels; c++ ) {
+      // one entry per register: min, max, avg, var;
+      // odd and even entries go to separate accumulators to hide the latency
+      const double* v = &src[c].min;
+      const int stride = channels * 4;
+      __m256d min = _mm256_loadu_pd( v );
+      __m256d max = min;
+      __m256d sum = _mm256_setzero_pd();
+      __m256d sumsq = _mm256_setzero_pd();
+      __m256d min1 = min;
+      __m256d max1 = min;
+      __m256d sum1 = sum;
+      __m256d sumsq1 = sum;
+      int i = 0;
+      for( ; i + 2 <= factor; i += 2 ) {
+        __m256d x = _mm256_loadu_pd( v );
+        __m256d y = _mm256_loadu_pd( v + stride );
+        min = _mm256_min_pd( min, x );
+        max = _mm256_max_pd( max, x );
+        sum = _mm256_add_pd( sum, x );
+        sumsq = _mm256_add_pd( sumsq, _mm256_mul_pd( x, x ) );
+        min1 = _mm256_min_pd( min1, y );
+        max1 = _mm256_max_pd( max1, y );
+        sum1 = _mm256_add_pd( sum1, y );
+        sumsq1 = _mm256_add_pd( sumsq1, _mm256_mul_pd( y, y ) );
+        v += 2 * stride;
+      }
+      if( i < factor ) {
+        __m256d x = _mm256_loadu_pd( v );
+        min = _mm256_min_pd( min, x );
+        max = _mm256_max_pd( max, x );
+        sum = _mm256_add_pd( sum, x );
+        sumsq = _mm256_add_pd( sumsq, _mm256_mul_pd( x, x ) );
+      }
+      min = _mm256_min_pd( min, min1 );
+      max = _mm256_max_pd( max, max1 );
+      sum = _mm256_add_pd( sum, sum1 );
+      sumsq = _mm256_add_pd( sumsq, sumsq1 );
+      double r[4][4];
+      _mm256_storeu_pd( r[0], min );
+      _mm256_storeu_pd( r[1], max );
+      _mm256_storeu_pd( r[2], sum );
+      _mm256_storeu_pd( r[3], sumsq );
+      set_entry( dst++, r[0][0], r[1][1], r[2][2], r[3][2] + r[2][3], factor );
+    }
+    src += factor * channels;
+  }
+}
+
+#endif // OCA_AVX2_KERNELS
+
+// ------------------------------------------------------------------------------------
+
+static int select_kernel()
+{
+#ifdef OCA_AVX2_KERNELS
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) ) {
+    return 2;
+  }
+#endif
+#ifdef __SSE2__
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+static int s_kernel = select_kernel();
+
+// ------------------------------------------------------------------------------------
+
+void OcaAvgKernel::calcAvg( OcaAvgData* dst, const double* src,
+                                            int channels, long len, int factor )
+{
+  switch( s_kernel ) {
+#ifdef OCA_AVX2_KERNELS
+    case 2:
+      calc_avg_avx2( dst, src, channels, len, factor );
+      return;
+#endif
+#ifdef __SSE2__
+    case 1:
+      calc_avg_sse2( dst, src, channels, len, factor );
+      return;
+#endif
+  }
+  calcAvgScalar( dst, src, channels, len, factor );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaAvgKernel::calcAvg2( OcaAvgData* dst, const OcaAvgData* src,
+                                            int channels, long len, int factor )
+{
+  switch( s_kernel ) {
+#ifdef OCA_AVX2_KERNELS
+    case 2:
+      calc_avg2_avx2( dst, src, channels, len, factor );
+      return;
+#endif
+#ifdef __SSE2__
+    case 1:
+      calc_avg2_sse2( dst, src, channels, len, factor );
+      return;
+#endif
+  }
+  calcAvg2Scalar( dst, src, channels, len, factor );
+}
+
+// ------------------------------------------------------------------------------------
+
+const char* OcaAvgKernel::getKernelName()
+{
+  switch( s_kernel ) {
+    case 2:
+      return "avx2";
+    case 1:
+      return "sse2";
+  }
+  return "scalar";
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaAvgKernel::setKernel( const char* name )
+{
+  int kernel = -1;
+  if( 0 == qstrcmp( name, "scalar" ) ) {
+    kernel = 0;
+  }
+  else if( 0 == qstrcmp( name, "sse2" ) ) {
+    kernel = 1;
+  }
+  else if( 0 == qstrcmp( name, "avx2" ) ) {
+    kernel = 2;
+  }
+  if( ( 0 > kernel ) || ( select_kernel() < kernel ) ) {
+    return false;
+  }
+  s_kernel = kernel;
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
@@ -0,0 +1,50 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaAvgKernel_h
+#define OcaAvgKernel_h
+
+#include "OcaDataVector.h"
+
+// Reduction kernels computing the pyramid entries of interleaved multichannel data.
+// Each output entry summarizes `factor` consecutive source frames.
+// calcAvg() and calcAvg2() use the best kernel supported by the cpu (sse2 or avx2),
+// the scalar versions are the reference implementation.
+// setKernel() selects the kernel by name ("scalar", "sse2" or "avx2") and fails
+// when the cpu doesn't support it, it is meant for tools/oca_kernel_check.cpp
+// and is not thread safe.
+
+class OcaAvgKernel
+{
+  public:
+    static void calcAvg( OcaAvgData* dst, const double* src,
+                                            int channels, long len, int factor );
+    static void calcAvg2( OcaAvgData* dst, const OcaAvgData* src,
+                                            int channels, long len, int factor );
+
+    static void calcAvgScalar( OcaAvgData* dst, const double* src,
+                                            int channels, long len, int factor );
+    static void calcAvg2Scalar( OcaAvgData* dst, const OcaAvgData* src,
+                                            int channels, long len, int factor );
+
+    static const char* getKernelName();
+    static bool setKernel( const char* name );
+};
+
+#endif // OcaAvgKernel_h
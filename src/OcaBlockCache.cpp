@@ -0,0 +1,242 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaBlockCache.h"
+#include "OcaDataFile.h"
+
+#include <QtCore>
+
+const qint64 OcaBlockCache::s_CHUNK_SIZE = 0x10000;
+const qint64 OcaBlockCache::s_STREAM_LENGTH = 0x100000;
+
+QMutex OcaBlockCache::s_mutex;
+qint64 OcaBlockCache::s_budget = 0x4000000;
+qint64 OcaBlockCache::s_size = 0;
+OcaBlockCache::Stats OcaBlockCache::s_stats = { 0, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } };
+OcaBlockCache::Chunk* OcaBlockCache::s_head[ e_PoolCount ] = { NULL, NULL };
+OcaBlockCache::Chunk* OcaBlockCache::s_tail[ e_PoolCount ] = { NULL, NULL };
+QHash< QPair<const OcaDataFile*,qint64>, OcaBlockCache::Chunk* > OcaBlockCache::s_chunks;
+QHash< const OcaDataFile*, qint64 > OcaBlockCache::s_serials;
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaBlockCache::getBudget()
+{
+  QMutexLocker locker( &s_mutex );
+  return s_budget;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaBlockCache::setBudget( qint64 budget )
+{
+  QMutexLocker locker( &s_mutex );
+  s_budget = qMax( 0ll, budget );
+  evict( 0, e_PoolPyramid );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaBlockCache::getStats( Stats* stats )
+{
+  QMutexLocker locker( &s_mutex );
+  *stats = s_stats;
+  stats->budget = s_budget;
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaBlockCache::read( const OcaDataFile* file, int pool,
+                                              char* dst, qint64 pos, qint64 len )
+{
+  Q_ASSERT( ( 0 <= pool ) && ( e_PoolCount > pool ) );
+  QMutexLocker locker( &s_mutex );
+  if( ( 0 == s_budget ) || ( ( e_PoolSamples == pool ) && ( s_STREAM_LENGTH < len ) ) ) {
+    s_stats.misses[ pool ]++;
+    s_stats.read[ pool ] += len;
+    locker.unlock();
+    return file->readFile( dst, pos, len );
+  }
+
+  qint64 result = 0;
+  while( result < len ) {
+    const qint64 idx = ( pos + result ) / s_CHUNK_SIZE;
+    const qint64 ofs = pos + result - idx * s_CHUNK_SIZE;
+    const qint64 n = qMin( len - result, s_CHUNK_SIZE - ofs );
+    Chunk* chunk = find( file, idx );
+    if( NULL != chunk ) {
+      s_stats.hits[ pool ]++;
+      memcpy( dst + result, chunk->data.constData() + ofs, n );
+      result += n;
+      continue;
+    }
+
+    // the chunk is loaded unlocked, it is dropped if the file was written meanwhile
+    s_stats.misses[ pool ]++;
+    s_stats.read[ pool ] += s_CHUNK_SIZE;
+    const qint64 serial = s_serials.value( file );
+    locker.unlock();
+    QByteArray data( s_CHUNK_SIZE, Qt::Uninitialized );
+    qint64 size = file->readFile( data.data(), idx * s_CHUNK_SIZE, s_CHUNK_SIZE );
+    if( ofs + n > size ) {
+      // the tail of the file is not cached
+      size = qMax( 0ll, size - ofs );
+      memcpy( dst + result, data.constData() + ofs, size );
+      return result + size;
+    }
+    memcpy( dst + result, data.constData() + ofs, n );
+    result += n;
+    locker.relock();
+    if( ( serial == s_serials.value( file ) ) && ( NULL == find( file, idx ) )
+                                              && evict( s_CHUNK_SIZE, pool ) ) {
+      chunk = new Chunk;
+      chunk->key = qMakePair( file, idx );
+      chunk->pool = pool;
+      chunk->data = data;
+      s_chunks.insert( chunk->key, chunk );
+      link( chunk );
+    }
+  }
+
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaBlockCache::invalidate( const OcaDataFile* file, qint64 pos, qint64 len )
+{
+  // negative length means up to the end of the file
+  QMutexLocker locker( &s_mutex );
+  s_serials[ file ]++;
+  if( s_chunks.isEmpty() ) {
+    return;
+  }
+  const qint64 first = pos / s_CHUNK_SIZE;
+  if( 0 <= len ) {
+    const qint64 last = ( pos + len - 1 ) / s_CHUNK_SIZE;
+    for( qint64 idx = first; idx <= last; idx++ ) {
+      Chunk* chunk = s_chunks.value( qMakePair( file, idx ) );
+      if( NULL != chunk ) {
+        remove( chunk );
+      }
+    }
+  }
+  else {
+    QList<Chunk*> list;
+    QHash< QPair<const OcaDataFile*,qint64>, Chunk* >::const_iterator it = s_chunks.begin();
+    for( ; it != s_chunks.end(); it++ ) {
+      if( ( file == it.key().first ) && ( first <= it.key().second ) ) {
+        list.append( it.value() );
+      }
+    }
+    for( int i = 0; i < list.size(); i++ ) {
+      remove( list[i] );
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaBlockCache::drop( const OcaDataFile* file )
+{
+  invalidate( file, 0 );
+  QMutexLocker locker( &s_mutex );
+  s_serials.remove( file );
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaBlockCache::Chunk* OcaBlockCache::find( const OcaDataFile* file, qint64 idx )
+{
+  Chunk* chunk = s_chunks.value( qMakePair( file, idx ) );
+  if( ( NULL != chunk ) && ( s_head[ chunk->pool ] != chunk ) ) {
+    unlink( chunk );
+    link( chunk );
+  }
+  return chunk;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaBlockCache::link( Chunk* chunk )
+{
+  const int pool = chunk->pool;
+  chunk->prev = NULL;
+  chunk->next = s_head[ pool ];
+  if( NULL != chunk->next ) {
+    chunk->next->prev = chunk;
+  }
+  else {
+    s_tail[ pool ] = chunk;
+  }
+  s_head[ pool ] = chunk;
+  s_size += chunk->data.size();
+  s_stats.size[ pool ] += chunk->data.size();
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaBlockCache::unlink( Chunk* chunk )
+{
+  const int pool = chunk->pool;
+  if( NULL != chunk->prev ) {
+    chunk->prev->next = chunk->next;
+  }
+  else {
+    s_head[ pool ] = chunk->next;
+  }
+  if( NULL != chunk->next ) {
+    chunk->next->prev = chunk->prev;
+  }
+  else {
+    s_tail[ pool ] = chunk->prev;
+  }
+  s_size -= chunk->data.size();
+  s_stats.size[ pool ] -= chunk->data.size();
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaBlockCache::remove( Chunk* chunk )
+{
+  unlink( chunk );
+  s_chunks.remove( chunk->key );
+  delete chunk;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaBlockCache::evict( qint64 size, int pool )
+{
+  // makes room for a chunk of the given pool, the sample chunks go first
+  while( s_size + size > s_budget ) {
+    Chunk* victim = s_tail[ e_PoolSamples ];
+    if( ( NULL == victim ) && ( e_PoolPyramid == pool ) ) {
+      victim = s_tail[ e_PoolPyramid ];
+    }
+    if( NULL == victim ) {
+      return false;
+    }
+    remove( victim );
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
@@ -0,0 +1,93 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaBlockCache_h
+#define OcaBlockCache_h
+
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+
+class OcaDataFile;
+
+// Memory cache of data file chunks shared by all sample files.
+// Pyramid chunks and sample chunks are kept in separate LRU pools, the
+// sample chunks are evicted first and never push out pyramid chunks.
+// Long sample reads (streaming) bypass the cache.
+// The cached ranges are invalidated by the writes to the files.
+
+class OcaBlockCache
+{
+  public:
+    enum EPool {
+      e_PoolNone    = -1,
+      e_PoolSamples = 0,
+      e_PoolPyramid = 1,
+      e_PoolCount
+    };
+
+    struct Stats {
+      qint64  budget;
+      qint64  size[ e_PoolCount ];
+      qint64  hits[ e_PoolCount ];
+      qint64  misses[ e_PoolCount ];
+      qint64  read[ e_PoolCount ];    // bytes requested from the files
+    };
+
+  public:
+    static qint64 getBudget();
+    static void   setBudget( qint64 budget );
+    static void   getStats( Stats* stats );
+
+    static qint64 read( const OcaDataFile* file, int pool,
+                                              char* dst, qint64 pos, qint64 len );
+    static void   invalidate( const OcaDataFile* file, qint64 pos, qint64 len = -1 );
+    static void   drop( const OcaDataFile* file );
+
+  protected:
+    struct Chunk {
+      QPair<const OcaDataFile*,qint64> key;
+      int         pool;
+      QByteArray  data;
+      Chunk*      prev;
+      Chunk*      next;
+    };
+
+  protected:
+    static Chunk* find( const OcaDataFile* file, qint64 idx );
+    static void   link( Chunk* chunk );
+    static void   unlink( Chunk* chunk );
+    static void   remove( Chunk* chunk );
+    static bool   evict( qint64 size, int pool );
+
+  protected:
+    static QMutex   s_mutex;
+    static qint64   s_budget;
+    static qint64   s_size;
+    static Stats    s_stats;
+    static Chunk*   s_head[ e_PoolCount ];
+    static Chunk*   s_tail[ e_PoolCount ];
+    static QHash< QPair<const OcaDataFile*,qint64>, Chunk* > s_chunks;
+    static QHash< const OcaDataFile*, qint64 > s_serials;
+
+    static const qint64 s_CHUNK_SIZE;
+    static const qint64 s_STREAM_LENGTH;
+};
+
+#endif // OcaBlockCache_h
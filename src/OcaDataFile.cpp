@@ -0,0 +1,349 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaDataFile.h"
+
+#include <QtCore>
+
+const qint64 OcaDataFile::s_MEMORY_GRANULARITY = 0x1000;
+QAtomicInteger<qint64> OcaDataFile::s_memoryLimit( 0x100000 );
+QAtomicInteger<qint64> OcaDataFile::s_memoryBudget( 0x10000000 );
+QAtomicInteger<qint64> OcaDataFile::s_memoryUsed( 0 );
+
+// ------------------------------------------------------------------------------------
+
+OcaDataFile::OcaDataFile( const QString& path, int cache_pool )
+:
+  m_file( path ),
+  m_map( NULL ),
+  m_size( 0 ),
+  m_capacity( 0 ),
+  m_packFailed( false ),
+  m_memory( 0 < s_memoryLimit.load() ),
+  m_external( false ),
+  m_offset( 0 ),
+  m_cachePool( cache_pool )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaDataFile::OcaDataFile( const QString& path, qint64 offset, qint64 size, int cache_pool )
+:
+  m_file( path ),
+  m_map( NULL ),
+  m_size( size ),
+  m_capacity( size ),
+  m_packFailed( false ),
+  m_memory( false ),
+  m_external( true ),
+  m_offset( offset ),
+  m_cachePool( cache_pool )
+{
+  // the reads fall back to file io if the file can't be mapped
+  if( ! m_file.open( QIODevice::ReadOnly ) ) {
+    fprintf( stderr, "OcaDataFile: can't open %s\n",
+                                              m_file.fileName().toLocal8Bit().data() );
+    m_size = 0;
+    m_capacity = 0;
+  }
+  else if( 0 < m_size ) {
+    m_map = m_file.map( m_offset, m_size );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaDataFile::OcaDataFile( const QVector<OcaPackFile::Segment>& segments,
+                                                        qint64 size, int cache_pool )
+:
+  m_map( NULL ),
+  m_segments( segments ),
+  m_size( size ),
+  m_capacity( segments.size() * OcaPackFile::s_SEGMENT_SIZE ),
+  m_packFailed( false ),
+  m_memory( false ),
+  m_external( true ),
+  m_offset( 0 ),
+  m_cachePool( cache_pool )
+{
+  Q_ASSERT( m_size <= m_capacity );
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaDataFile::~OcaDataFile()
+{
+  if( OcaBlockCache::e_PoolNone != m_cachePool ) {
+    OcaBlockCache::drop( this );
+  }
+  if( m_memory ) {
+    free( m_map );
+    m_map = NULL;
+    s_memoryUsed.fetchAndAddOrdered( -m_capacity );
+  }
+  if( m_external && ( NULL != m_map ) ) {
+    m_file.unmap( m_map );
+    m_map = NULL;
+  }
+  releaseSegments( 0 );
+  if( m_packFailed ) {
+    m_file.remove();
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaDataFile::isCached() const
+{
+  // the data kept in memory or mapped in place is not duplicated in the block cache
+  return ( OcaBlockCache::e_PoolNone != m_cachePool ) && ( ! m_memory )
+                                          && ! ( m_external && ( NULL != m_map ) );
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaDataFile::read( char* dst, qint64 pos, qint64 len ) const
+{
+  len = qMin( len, m_size - pos );
+  if( ( 0 >= len ) || ( 0 > pos ) ) {
+    return 0;
+  }
+  if( isCached() ) {
+    return OcaBlockCache::read( this, m_cachePool, dst, pos, len );
+  }
+  return readFile( dst, pos, len );
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaDataFile::readFile( char* dst, qint64 pos, qint64 len ) const
+{
+  len = qMin( len, m_size - pos );
+  if( ( 0 >= len ) || ( 0 > pos ) ) {
+    return 0;
+  }
+  if( m_memory || ( m_external && ( NULL != m_map ) ) ) {
+    memcpy( dst, m_map + pos, len );
+    return len;
+  }
+  if( ! m_segments.isEmpty() ) {
+    for( qint64 done = 0; done < len; ) {
+      const int k = ( pos + done ) / OcaPackFile::s_SEGMENT_SIZE;
+      const qint64 ofs = pos + done - k * OcaPackFile::s_SEGMENT_SIZE;
+      const qint64 n = qMin( len - done, OcaPackFile::s_SEGMENT_SIZE - ofs );
+      memcpy( dst + done, m_segments[k].data + ofs, n );
+      done += n;
+    }
+    return len;
+  }
+
+  QMutexLocker locker( &m_mutex );
+  m_file.seek( m_offset + pos );
+  return qMax( 0ll, m_file.read( dst, len ) );
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaDataFile::write( const char* src, qint64 pos, qint64 len )
+{
+  if( ( 0 >= len ) || ( 0 > pos ) || m_external ) {
+    return 0;
+  }
+  reserve( pos + len );
+  qint64 result = writeFile( src, pos, len );
+  m_size = qMax( m_size, pos + result );
+  if( isCached() ) {
+    OcaBlockCache::invalidate( this, pos, result );
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaDataFile::writeFile( const char* src, qint64 pos, qint64 len )
+{
+  if( ! m_packFailed ) {
+    len = qMin( len, m_capacity - pos );
+    if( 0 >= len ) {
+      return 0;
+    }
+  }
+  if( m_memory ) {
+    memcpy( m_map + pos, src, len );
+    return len;
+  }
+  if( ! m_packFailed ) {
+    for( qint64 done = 0; done < len; ) {
+      const int k = ( pos + done ) / OcaPackFile::s_SEGMENT_SIZE;
+      const qint64 ofs = pos + done - k * OcaPackFile::s_SEGMENT_SIZE;
+      const qint64 n = qMin( len - done, OcaPackFile::s_SEGMENT_SIZE - ofs );
+      memcpy( m_segments[k].data + ofs, src + done, n );
+      done += n;
+    }
+    return len;
+  }
+
+  QMutexLocker locker( &m_mutex );
+  m_file.seek( pos );
+  return qMax( 0ll, m_file.write( src, len ) );
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaDataFile::resize( qint64 size )
+{
+  if( ( 0 > size ) || m_external ) {
+    return false;
+  }
+  reserve( size );
+  if( m_memory ) {
+    if( size > m_capacity ) {
+      return false;
+    }
+    m_size = size;
+    // give back the memory when the file is truncated considerably
+    if( m_size < m_capacity / 4 ) {
+      allocMemory( qMax( m_size, s_MEMORY_GRANULARITY ), true );
+    }
+  }
+  else if( m_packFailed ) {
+    QMutexLocker locker( &m_mutex );
+    if( ! m_file.resize( size ) ) {
+      return false;
+    }
+    m_size = size;
+  }
+  else {
+    m_size = size;
+    releaseSegments( ( size + OcaPackFile::s_SEGMENT_SIZE - 1 ) / OcaPackFile::s_SEGMENT_SIZE );
+  }
+  if( isCached() ) {
+    OcaBlockCache::invalidate( this, size );
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaDataFile::reserve( qint64 size )
+{
+  if( size <= m_capacity ) {
+    return;
+  }
+  if( m_memory ) {
+    qint64 capacity = qMax( size, 2 * m_capacity );
+    capacity = ( ( capacity + s_MEMORY_GRANULARITY - 1 ) / s_MEMORY_GRANULARITY )
+                                                              * s_MEMORY_GRANULARITY;
+    const qint64 limit = s_memoryLimit.load();
+    if( ( size <= limit ) && allocMemory( qMax( size, qMin( capacity, limit ) ), false ) ) {
+      return;
+    }
+    spill();
+  }
+
+  while( ( ! m_packFailed ) && ( m_capacity < size ) ) {
+    OcaPackFile::Segment segment;
+    if( ! OcaPackFile::allocSegment( &segment, QFileInfo( m_file.fileName() ).path() ) ) {
+      fallBackToFile();
+      break;
+    }
+    m_segments.append( segment );
+    m_capacity += OcaPackFile::s_SEGMENT_SIZE;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaDataFile::allocMemory( qint64 capacity, bool force )
+{
+  // the budget is checked only when the memory grows
+  const qint64 delta = capacity - m_capacity;
+  const qint64 used = s_memoryUsed.fetchAndAddOrdered( delta ) + delta;
+  if( ( 0 < delta ) && ( ! force ) && ( used > s_memoryBudget.load() ) ) {
+    s_memoryUsed.fetchAndAddOrdered( -delta );
+    return false;
+  }
+  uchar* data = (uchar*)realloc( m_map, capacity );
+  if( NULL == data ) {
+    s_memoryUsed.fetchAndAddOrdered( -delta );
+    return false;
+  }
+  if( 0 < delta ) {
+    memset( data + m_capacity, 0, delta );
+  }
+  m_map = data;
+  m_capacity = capacity;
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaDataFile::spill()
+{
+  // moves the data from memory to disk
+  uchar* data = m_map;
+  const qint64 capacity = m_capacity;
+  m_map = NULL;
+  m_capacity = 0;
+  m_memory = false;
+  reserve( m_size );
+  if( m_size != writeFile( (const char*)data, 0, m_size ) ) {
+    fprintf( stderr, "OcaDataFile: can't write %s\n",
+                                              m_file.fileName().toLocal8Bit().data() );
+  }
+  free( data );
+  s_memoryUsed.fetchAndAddOrdered( -capacity );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaDataFile::fallBackToFile()
+{
+  // moves the data from the pack segments to the own file
+  fprintf( stderr, "OcaDataFile: no pack space, using file io for %s\n",
+                                              m_file.fileName().toLocal8Bit().data() );
+  if( ! m_file.open( QIODevice::ReadWrite | QIODevice::Truncate ) ) {
+    fprintf( stderr, "OcaDataFile: can't open %s\n",
+                                              m_file.fileName().toLocal8Bit().data() );
+  }
+  for( int k = 0; k < m_segments.size(); k++ ) {
+    const qint64 pos = k * OcaPackFile::s_SEGMENT_SIZE;
+    const qint64 n = qMin( m_size - pos, OcaPackFile::s_SEGMENT_SIZE );
+    if( 0 < n ) {
+      m_file.write( (const char*)m_segments[k].data, n );
+    }
+  }
+  releaseSegments( 0 );
+  m_packFailed = true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaDataFile::releaseSegments( int count )
+{
+  while( count < m_segments.size() ) {
+    OcaPackFile::freeSegment( m_segments.takeLast() );
+  }
+  if( ! m_memory ) {
+    m_capacity = m_segments.size() * OcaPackFile::s_SEGMENT_SIZE;
+  }
+}
+
+// ------------------------------------------------------------------------------------
@@ -0,0 +1,100 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaDataFile_h
+#define OcaDataFile_h
+
+#include "OcaBlockCache.h"
+#include "OcaPackFile.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QVector>
+#include <QAtomicInteger>
+
+// Data of the cache that lives as long as the object.
+// Small files are kept in memory and moved to disk when they grow above
+// the memory limit or the total memory budget is exceeded. On disk the data
+// is stored in segments of the shared pack files (see OcaPackFile), the file
+// with the given path is used only when no pack file can be mapped.
+// Reads of a file with a cache pool go through OcaBlockCache.
+// An external file is a read-only view of a part of an existing file (such as
+// the samples of an imported wav file), it is mapped in place and never removed.
+// The data of a loaded project is also external, given either as a part of
+// a file or as segments of a pack file of the project.
+
+class OcaDataFile
+{
+  public:
+    OcaDataFile( const QString& path, int cache_pool = OcaBlockCache::e_PoolNone );
+    OcaDataFile( const QString& path, qint64 offset, qint64 size,
+                                      int cache_pool = OcaBlockCache::e_PoolNone );
+    OcaDataFile( const QVector<OcaPackFile::Segment>& segments, qint64 size,
+                                      int cache_pool = OcaBlockCache::e_PoolNone );
+    ~OcaDataFile();
+
+  public:
+    qint64 getSize() const { return m_size; }
+    bool   isInMemory() const { return m_memory; }
+    bool   isExternal() const { return m_external; }
+    qint64 read( char* dst, qint64 pos, qint64 len ) const;
+    qint64 write( const char* src, qint64 pos, qint64 len );
+    bool   resize( qint64 size );
+
+  public:
+    static qint64 getMemoryLimit() { return s_memoryLimit.load(); }
+    static void   setMemoryLimit( qint64 limit ) { s_memoryLimit.store( limit ); }
+    static qint64 getMemoryBudget() { return s_memoryBudget.load(); }
+    static void   setMemoryBudget( qint64 budget ) { s_memoryBudget.store( budget ); }
+    static qint64 getMemoryUsed() { return s_memoryUsed.load(); }
+
+  protected:
+    qint64 readFile( char* dst, qint64 pos, qint64 len ) const;
+    qint64 writeFile( const char* src, qint64 pos, qint64 len );
+    bool isCached() const;
+    void reserve( qint64 size );
+    bool allocMemory( qint64 capacity, bool force );
+    void spill();
+    void fallBackToFile();
+    void releaseSegments( int count );
+
+  protected:
+    mutable QFile   m_file;
+    mutable QMutex  m_mutex;
+    uchar*          m_map;
+    QVector<OcaPackFile::Segment> m_segments;
+    qint64          m_size;
+    qint64          m_capacity;
+    bool            m_packFailed;
+    bool            m_memory;
+    const bool      m_external;
+    const qint64    m_offset;
+    const int       m_cachePool;
+
+  protected:
+    static const qint64 s_MEMORY_GRANULARITY;
+    static QAtomicInteger<qint64> s_memoryLimit;
+    static QAtomicInteger<qint64> s_memoryBudget;
+    static QAtomicInteger<qint64> s_memoryUsed;
+
+  friend class OcaBlockCache;
+  friend class OcaProject;
+};
+
+#endif // OcaDataFile_h
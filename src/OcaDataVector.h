@@ -24,8 +24,11 @@
 
 template <typename Type> class OcaBareArray {
   public:
-    OcaBareArray() : m_channels(0), m_alloc(0), m_length(0), m_data(NULL) {}
-    OcaBareArray( int channels, long len ) : m_alloc(0), m_data(NULL) { alloc( channels, len, len ); }
+    OcaBareArray() : m_channels(0), m_alloc(0), m_length(0), m_data(NULL), m_view(false) {}
+    OcaBareArray( int channels, long len ) : m_alloc(0), m_data(NULL), m_view(false) { alloc( channels, len, len ); }
+    // read-only view of samples owned by the caller, they are neither copied nor freed
+    OcaBareArray( const Type* data, int channels, long len )
+      : m_channels(channels), m_alloc(0), m_length(len), m_data(const_cast<Type*>(data)), m_view(true) {}
     ~OcaBareArray() { clear(); }
 
   public:
@@ -44,6 +47,7 @@ template <typename Type> class OcaBareArray {
     long    m_alloc;
     long    m_length;
     Type*   m_data;
+    bool    m_view;
 };
 
 template <typename Type>
@@ -51,6 +55,7 @@ inline void OcaBareArray<Type>::alloc( int channels, long len, long alloc_len )
 {
   Q_ASSERT( len <= alloc_len );
   Q_ASSERT( 0 < channels );
+  Q_ASSERT( ! m_view );
   long size = alloc_len * channels;
   if( m_alloc < size ) {
     if( NULL != m_data ) {
@@ -71,8 +76,11 @@ inline void OcaBareArray<Type>::clear()
     m_alloc = 0;
     m_length = 0;
     m_channels = 0;
-    delete [] m_data;
+    if( ! m_view ) {
+      delete [] m_data;
+    }
     m_data = NULL;
+    m_view = false;
   }
 }
 
@@ -83,6 +91,47 @@ struct OcaAvgData {
   double var;
 };
 
+// accumulated statistics of a sample range, used to merge pyramid entries
+struct OcaSampleStats {
+  qint64 count;
+  double min;
+  double max;
+  double sum;
+  double sumsq;
+
+  void clear() { count = 0; min = 0; max = 0; sum = 0; sumsq = 0; }
+  void add( double v ) {
+    min = ( 0 == count ) ? v : qMin( min, v );
+    max = ( 0 == count ) ? v : qMax( max, v );
+    sum += v;
+    sumsq += v * v;
+    count++;
+  }
+  void add( const OcaAvgData& d, qint64 n ) {
+    min = ( 0 == count ) ? d.min : qMin( min, d.min );
+    max = ( 0 == count ) ? d.max : qMax( max, d.max );
+    sum += d.avg * n;
+    sumsq += ( d.var + d.avg * d.avg ) * n;
+    count += n;
+  }
+  void add( const OcaSampleStats& s ) {
+    if( 0 < s.count ) {
+      min = ( 0 == count ) ? s.min : qMin( min, s.min );
+      max = ( 0 == count ) ? s.max : qMax( max, s.max );
+      sum += s.sum;
+      sumsq += s.sumsq;
+      count += s.count;
+    }
+  }
+  void getAvgData( OcaAvgData* d ) const {
+    Q_ASSERT( 0 < count );
+    d->min = min;
+    d->max = max;
+    d->avg = sum / count;
+    d->var = sumsq / count - d->avg * d->avg;
+  }
+};
+
 typedef OcaBareArray<double>     OcaDataVector;
 typedef OcaBareArray<OcaAvgData> OcaAvgVector;
 typedef OcaBareArray<float>      OcaFloatVector;
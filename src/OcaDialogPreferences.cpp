@@ -83,12 +83,32 @@ OcaDialogPreferences::OcaDialogPreferences()
   layout->addWidget( m_editSampleRate, row, 1 );
 
   m_listener->addObject( OcaApp::getOcaInstance(),
-                         OcaInstance::e_FlagCachePathChanged );
+                         OcaInstance::e_FlagCachePathChanged |
+                         OcaInstance::e_FlagBlockCacheChanged |
+                         OcaInstance::e_FlagMemoryTierChanged );
   m_editDataCacheBase = new QLineEdit( this );
   connect( m_editDataCacheBase, SIGNAL(editingFinished()), SLOT(setDataCache()) );
   layout->addWidget( new QLabel( "Data Cache Directory" ), ++row, 0 );
   layout->addWidget( m_editDataCacheBase, row, 1 );
 
+  m_editBlockCacheSize = new QLineEdit( this );
+  m_editBlockCacheSize->setValidator( new QIntValidator( 0, 1 << 20, this ) );
+  connect( m_editBlockCacheSize, SIGNAL(editingFinished()), SLOT(setBlockCache()) );
+  layout->addWidget( new QLabel( "Block Cache Size (MB)" ), ++row, 0 );
+  layout->addWidget( m_editBlockCacheSize, row, 1 );
+
+  m_editMemoryBlockLimit = new QLineEdit( this );
+  m_editMemoryBlockLimit->setValidator( new QIntValidator( 0, 1 << 20, this ) );
+  connect( m_editMemoryBlockLimit, SIGNAL(editingFinished()), SLOT(setMemoryTier()) );
+  layout->addWidget( new QLabel( "Max In-Memory Data File (KB)" ), ++row, 0 );
+  layout->addWidget( m_editMemoryBlockLimit, row, 1 );
+
+  m_editMemoryBudget = new QLineEdit( this );
+  m_editMemoryBudget->setValidator( new QIntValidator( 0, 1 << 20, this ) );
+  connect( m_editMemoryBudget, SIGNAL(editingFinished()), SLOT(setMemoryTier()) );
+  layout->addWidget( new QLabel( "In-Memory Data Budget (MB)" ), ++row, 0 );
+  layout->addWidget( m_editMemoryBudget, row, 1 );
+
   OcaApp::getAudioController()->checkDevices();
 }
 
@@ -124,6 +144,12 @@ void OcaDialogPreferences::onUpdateRequired( uint flags )
   m_devInput->blockSignals( false );
 
   m_editDataCacheBase->setText( OcaApp::getOcaInstance()->getDataCacheBase() );
+  m_editBlockCacheSize->setText(
+                    QString::number( OcaApp::getOcaInstance()->getBlockCacheSize() ) );
+  m_editMemoryBlockLimit->setText(
+                    QString::number( OcaApp::getOcaInstance()->getMemoryBlockLimit() ) );
+  m_editMemoryBudget->setText(
+                    QString::number( OcaApp::getOcaInstance()->getMemoryBudget() ) );
 }
 
 // -----------------------------------------------------------------------------
@@ -163,6 +189,21 @@ void OcaDialogPreferences::setDataCache()
 
 // -----------------------------------------------------------------------------
 
+void OcaDialogPreferences::setBlockCache()
+{
+  OcaApp::getOcaInstance()->setBlockCacheSize( m_editBlockCacheSize->text().toInt() );
+}
+
+// -----------------------------------------------------------------------------
+
+void OcaDialogPreferences::setMemoryTier()
+{
+  OcaApp::getOcaInstance()->setMemoryBlockLimit( m_editMemoryBlockLimit->text().toInt() );
+  OcaApp::getOcaInstance()->setMemoryBudget( m_editMemoryBudget->text().toInt() );
+}
+
+// -----------------------------------------------------------------------------
+
 bool OcaDialogPreferences::eventFilter( QObject* obj, QEvent* ev )
 {
   if( ev->type() == QEvent::KeyRelease ) {
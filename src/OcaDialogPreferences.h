@@ -44,6 +44,8 @@ class OcaDialogPreferences : public OcaDialogPropertiesBase
     void setInputDevice( const QString& dev_name );
     void setOutputDevice( const QString& dev_name );
     void setDataCache();
+    void setBlockCache();
+    void setMemoryTier();
 
   public:
     virtual bool eventFilter( QObject* obj, QEvent* ev );
@@ -57,6 +59,9 @@ class OcaDialogPreferences : public OcaDialogPropertiesBase
     QLineEdit*          m_editDefaultRate;
     OcaValidatorDouble* m_defaultRateValidator;
     QLineEdit*          m_editDataCacheBase;
+    QLineEdit*          m_editBlockCacheSize;
+    QLineEdit*          m_editMemoryBlockLimit;
+    QLineEdit*          m_editMemoryBudget;
 };
 
 
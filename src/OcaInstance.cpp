@@ -20,6 +20,8 @@
 #include "OcaInstance.h"
 
 #include "OcaWindowData.h"
+#include "OcaBlockCache.h"
+#include "OcaDataFile.h"
 
 #include <QtCore>
 
@@ -102,3 +104,74 @@ bool OcaInstance::setDataCacheBase( const QString& path )
 
 // -----------------------------------------------------------------------------
 
+int OcaInstance::getBlockCacheSize() const
+{
+  return (int)( OcaBlockCache::getBudget() >> 20 );
+}
+
+// -----------------------------------------------------------------------------
+
+bool OcaInstance::setBlockCacheSize( int size_mb )
+{
+  // the cache is shared by all windows, 0 disables it
+  if( 0 > size_mb ) {
+    return false;
+  }
+  uint flags = 0;
+  if( getBlockCacheSize() != size_mb ) {
+    OcaBlockCache::setBudget( (qint64)size_mb << 20 );
+    flags = e_FlagBlockCacheChanged;
+  }
+  emitChanged( m_mainWindowData, flags );
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+
+int OcaInstance::getMemoryBlockLimit() const
+{
+  return (int)( OcaDataFile::getMemoryLimit() >> 10 );
+}
+
+// -----------------------------------------------------------------------------
+
+bool OcaInstance::setMemoryBlockLimit( int size_kb )
+{
+  // applies to the new data files, 0 keeps all data on disk
+  if( 0 > size_kb ) {
+    return false;
+  }
+  uint flags = 0;
+  if( getMemoryBlockLimit() != size_kb ) {
+    OcaDataFile::setMemoryLimit( (qint64)size_kb << 10 );
+    flags = e_FlagMemoryTierChanged;
+  }
+  emitChanged( m_mainWindowData, flags );
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+
+int OcaInstance::getMemoryBudget() const
+{
+  return (int)( OcaDataFile::getMemoryBudget() >> 20 );
+}
+
+// -----------------------------------------------------------------------------
+
+bool OcaInstance::setMemoryBudget( int size_mb )
+{
+  if( 0 > size_mb ) {
+    return false;
+  }
+  uint flags = 0;
+  if( getMemoryBudget() != size_mb ) {
+    OcaDataFile::setMemoryBudget( (qint64)size_mb << 20 );
+    flags = e_FlagMemoryTierChanged;
+  }
+  emitChanged( m_mainWindowData, flags );
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+
@@ -38,12 +38,20 @@ class OcaInstance : public OcaObject
     OcaWindowData*  getWindowData() const { return m_mainWindowData; }
     QString         getDataCacheBase() const;
     bool            setDataCacheBase( const QString& path );
+    int             getBlockCacheSize() const;
+    bool            setBlockCacheSize( int size_mb );
+    int             getMemoryBlockLimit() const;
+    bool            setMemoryBlockLimit( int size_kb );
+    int             getMemoryBudget() const;
+    bool            setMemoryBudget( int size_mb );
 
   public:
     enum EFlags {
       e_FlagWindowAdded       = 0x001,
       e_FlagWindowRemoved     = 0x002,
       e_FlagCachePathChanged  = 0x004,
+      e_FlagBlockCacheChanged = 0x008,
+      e_FlagMemoryTierChanged = 0x010,
 
       e_FlagObjectRemoved     = 0x100,
       e_FlagALL               = 0xfff,
@@ -31,6 +31,15 @@
 #include "OcaMonitor.h"
 #include "Oca3DPlot.h"
 #include "OcaAudioController.h"
+#include "OcaAvgKernel.h"
+#include "OcaBlockCache.h"
+#include "OcaSampleFormat.h"
+#include "OcaWavFile.h"
+#include "OcaAudioImporter.h"
+#include "OcaAudioExporter.h"
+#include "OcaTrackDataBlock.h"
+#include "OcaSampleFile.h"
+#include "OcaProject.h"
 
 #include "octaudio_configinfo.h"
 
@@ -168,6 +177,114 @@ static NDArray ndarray_from_track_info( const OcaBlockListInfo& data, double rat
 
 // ----------------------------------------------------------------------------
 
+template <class TArray>
+static TArray array_from_track_block( const OcaTrack* track, qint64 len,
+                                      double t0, double duration, double* t_start )
+{
+  // the samples are read from the storage straight into the array (NDArray
+  // or FloatNDArray), it is shrunk if the track has been changed since
+  // the blocks were listed
+  TArray ar;
+  *t_start = NAN;
+  const int channels = track->getChannels();
+  if( 0 < len ) {
+    ar = TArray( dim_vector( channels, len ) );
+    long n = track->getData( ar.fortran_vec(), channels, len, t_start, t0, duration );
+    if( 0 >= n ) {
+      ar = TArray();
+      *t_start = NAN;
+    }
+    else if( n < len ) {
+      ar.resize( dim_vector( channels, n ) );
+    }
+  }
+  return ar;
+}
+
+// ----------------------------------------------------------------------------
+
+static octave_value value_from_track_block( const OcaTrack* track, qint64 len, bool single,
+                                            double t0, double duration, double* t_start )
+{
+  if( single ) {
+    return array_from_track_block<FloatNDArray>( track, len, t0, duration, t_start );
+  }
+  return array_from_track_block<NDArray>( track, len, t0, duration, t_start );
+}
+
+// ----------------------------------------------------------------------------
+
+static bool get_single_precision( octave_value val )
+{
+  // "double" (default) or "single"
+  bool single = false;
+  if( val.is_defined() ) {
+    const std::string s = val.is_string() ? val.string_value() : std::string();
+    if( "single" == s ) {
+      single = true;
+    }
+    else if( "double" != s ) {
+      error( "invalid precision" );
+    }
+  }
+  return single;
+}
+
+// ----------------------------------------------------------------------------
+
+template <class TArray>
+static long get_data_length( const TArray& ar, int channels )
+{
+  // frames of the channels x length array (or a vector for a single channel)
+  long length = ar.numel();
+  if( 1 < channels ) {
+    if( ar.dim1() == channels ) {
+      length = ar.dim2();
+    }
+    else {
+      error( "invalid number of channels (%d)", (int)ar.dim1() );
+      length = 0;
+    }
+  }
+  else {
+    Q_ASSERT( 1 == channels );
+    if( ! ar.is_vector() ) {
+      error( "data is not a vector" );
+      length = 0;
+    }
+  }
+  return length;
+}
+
+// ----------------------------------------------------------------------------
+
+static double set_track_data( OcaTrack* track, octave_value val, double t, double duration )
+{
+  // the samples are written from the interpreter buffer through a view,
+  // the const access keeps the shared array from being copied
+  double t_next = NAN;
+  const int channels = track->getChannels();
+  if( val.is_single_type() ) {
+    const FloatNDArray ar = val.float_array_value();
+    long length = get_data_length( ar, channels );
+    if( 0 < length ) {
+      const OcaFloatVector block( ar.data(), channels, length );
+      t_next = track->setData( &block, t, duration );
+    }
+  }
+  else {
+    const NDArray ar = val.array_value();
+    long length = get_data_length( ar, channels );
+    if( 0 < length ) {
+      const OcaDataVector block( ar.data(), channels, length );
+      t_next = track->setData( &block, t, duration );
+    }
+  }
+  return t_next;
+}
+
+// ----------------------------------------------------------------------------
+
 static octave_value qvariant_to_octave_value( const QVariant& var )
 {
   octave_value result;
@@ -1164,13 +1281,83 @@ OCA_BUILTIN(  track_setprop,
   return retval;
 }
 
+// ----------------------------------------------------------------------------
+
+OCA_BUILTIN(  track_mapfile,
+              "ID = oca_track_mapfile( filename, [group_id] )             # wav, rf64\n"
+              "ID = oca_track_mapfile( filename, raw_spec, [group_id] )   # raw_spec = struct( \"rate\", sr, \"channels\", n, \"format\", \"int16\", [\"offset\", bytes] )"  )
+{
+  octave_value retval;
+  octave_value name = safe_arg( args, 0 );
+  octave_value raw = safe_arg( args, 1 );
+  const bool is_raw = raw.is_map();
+  if( ! name.is_string() ) {
+    print_usage();
+    return retval;
+  }
+  OcaTrackGroup* group = id_to_group( args, is_raw ? 2 : 1 );
+  if( NULL == group ) {
+    error( "invalid group" );
+    return retval;
+  }
+
+  QString path = OCA_STR( name );
+  OcaWavFile::Info info;
+  if( is_raw ) {
+    octave_scalar_map spec = raw.scalar_map_value();
+    octave_value format = spec.getfield( "format" );
+    info.rate = spec.getfield( "rate" ).double_value();
+    info.channels = spec.getfield( "channels" ).int_value();
+    info.format = format.is_string() ? OcaSampleFormat::fromName( OCA_STR(format) ) : -1;
+    info.offset = spec.isfield( "offset" ) ? spec.getfield( "offset" ).double_value() : 0;
+    if( ( ! ( 0.0 < info.rate ) ) || ( 0 >= info.channels )
+                                  || ( 0 > info.format ) || ( 0 > info.offset ) ) {
+      error( "invalid raw_spec" );
+      return retval;
+    }
+    QFileInfo file_info( path );
+    if( ! file_info.isReadable() ) {
+      error( "can't open file '%s'", OCA_CSTR( path ) );
+      return retval;
+    }
+    info.length = ( file_info.size() - info.offset )
+                          / ( info.channels * OcaSampleFormat::getSampleSize( info.format ) );
+  }
+  else {
+    QString msg;
+    if( ! OcaWavFile::readInfo( path, &info, &msg ) ) {
+      error( "%s: %s", OCA_CSTR( msg ), OCA_CSTR( path ) );
+      return retval;
+    }
+  }
+  if( 0 >= info.length ) {
+    error( "no data in '%s'", OCA_CSTR( path ) );
+    return retval;
+  }
+
+  // the track is filled before it is shown, so the levels are ready
+  OcaTrack* track = new OcaTrack( QFileInfo( path ).completeBaseName(), info.rate );
+  track->setChannels( info.channels );
+  track->setStorageFormat( OcaSampleFormat::getName( info.format ) );
+  if( std::isnan( track->mapFile( path, info.offset, info.format, info.length, 0.0 ) ) ) {
+    delete track;
+    error( "can't map '%s'", OCA_CSTR( path ) );
+    return retval;
+  }
+  track->setReadonly( true );
+  retval = ndarray_from_ocaobj( track );
+  group->addTrack( track );
+  return retval;
+}
+
 
 // ----------------------------------------------------------------------------
 // data
 
 OCA_BUILTIN(  data_get,
-              "[data, t0] = oca_data_get( [t_spec], [id], [group_id] )    # t_spec = [t, duration]\n"
-              "     # \"\" (auto-default), \"cursor\", \"region\", \"all\""  )
+              "[data, t0] = oca_data_get( [t_spec], [id], [group_id], [precision] )    # t_spec = [t, duration]\n"
+              "     # \"\" (auto-default), \"cursor\", \"region\", \"all\"\n"
+              "     # precision: \"double\" (default), \"single\""  )
 {
   octave_value_list result;
   OcaTrackGroup* group = NULL;
@@ -1181,23 +1368,83 @@ OCA_BUILTIN(  data_get,
   else {
     Q_ASSERT( NULL != group );
     NDArray t_spec = get_time_spec( safe_arg( args, 0 ), track, group );
-    NDArray ar;
+    const bool single = get_single_precision( safe_arg( args, 3 ) );
+    octave_value ar = single ? octave_value( FloatNDArray() ) : octave_value( NDArray() );
     double t0_true = NAN;
     if( 2 == t_spec.numel() ) {
-      OcaBlockListData data;
-      track->getData( &data, t_spec(0), t_spec(1) );
+      OcaBlockListInfo info;
+      track->getDataBlocksInfo( &info, t_spec(0), t_spec(1) );
+      if( ! info.isEmpty() ) {
+        ar = value_from_track_block( track, info.first().second, single,
+                                     t_spec(0), t_spec(1), &t0_true );
+      }
+    }
+    result(0) = ar;
+    result(1) = t0_true;
+  }
+
+  return result;
+}
 
+// ----------------------------------------------------------------------------
+
+OCA_BUILTIN(  data_getavg,
+              "[mins, maxs, avgs, vars, t0, decimation] = "
+                        "oca_data_getavg( [t_spec], decimation_hint, [id], [group_id] )"  )
+{
+  octave_value_list result;
+  OcaTrackGroup* group = NULL;
+  OcaTrack* track = id_to_datatrack( args, 2, 3, &group );
+  octave_value val_dec = safe_arg( args, 1 );
+  if( NULL == track ) {
+    error( "invalid track" );
+  }
+  else if( ( ! val_dec.is_real_scalar() ) || ( ! ( 1.0 <= val_dec.double_value() ) ) ) {
+    error( "invalid decimation" );
+  }
+  else {
+    Q_ASSERT( NULL != group );
+    NDArray t_spec = get_time_spec( safe_arg( args, 0 ), track, group );
+    NDArray mins;
+    NDArray maxs;
+    NDArray avgs;
+    NDArray vars;
+    double t0_true = NAN;
+    long decimation = 1;
+    if( 2 == t_spec.numel() ) {
+      // the entries of the closest pyramid level not above the hint
+      OcaBlockListAvg data;
+      long hint = (long)qMin( val_dec.double_value(), 1.0e15 );
+      decimation = track->getAvgData( &data, t_spec(0), t_spec(1), hint );
       if( ! data.isEmpty() ) {
-        const OcaDataVector* block = data.getBlock( 0 );
+        const OcaAvgVector* block = data.getBlock( 0 );
         if( 0 < block->length() ) {
-          ar = NDArray( dim_vector( block->channels(), block->length() ) );
-          memcpy( ar.fortran_vec(), block->constData(), ar.numel() * sizeof(double) );
+          const dim_vector dims( block->channels(), block->length() );
+          mins = NDArray( dims );
+          maxs = NDArray( dims );
+          avgs = NDArray( dims );
+          vars = NDArray( dims );
+          double* p_min = mins.fortran_vec();
+          double* p_max = maxs.fortran_vec();
+          double* p_avg = avgs.fortran_vec();
+          double* p_var = vars.fortran_vec();
+          const OcaAvgData* src = block->constData();
+          for( long i = 0; i < mins.numel(); i++ ) {
+            p_min[i] = src[i].min;
+            p_max[i] = src[i].max;
+            p_avg[i] = src[i].avg;
+            p_var[i] = src[i].var;
+          }
           t0_true = data.getTime( 0 );
         }
       }
     }
-    result(0) = ar;
-    result(1) = t0_true;
+    result(0) = mins;
+    result(1) = maxs;
+    result(2) = avgs;
+    result(3) = vars;
+    result(4) = t0_true;
+    result(5) = (double)decimation;
   }
 
   return result;
@@ -1205,6 +1452,102 @@ OCA_BUILTIN(  data_get,
 
 // ----------------------------------------------------------------------------
 
+class OcaStatsTask : public QRunnable
+{
+  public:
+    OcaStatsTask( const OcaTrack* track, const NDArray& t_spec, QVector<OcaSampleStats>* dst )
+      : m_track( track ), m_t0( t_spec(0) ), m_duration( t_spec(1) ), m_dst( dst ) {}
+
+    void run()
+    {
+      m_track->getStats( m_dst, m_t0, m_duration );
+    }
+
+  protected:
+    const OcaTrack*           m_track;
+    const double              m_t0;
+    const double              m_duration;
+    QVector<OcaSampleStats>*  m_dst;
+};
+
+// ----------------------------------------------------------------------------
+
+OCA_BUILTIN(  data_stats,
+              "stats = oca_data_stats( [t_spec], [ids], [group_id] )"  )
+{
+  octave_value retval;
+  OcaTrackGroup* group = NULL;
+  QList<OcaTrack*> list = id_to_datatrack_list( args, 1, 2, &group );
+  if( list.isEmpty() ) {
+    error( "invalid track" );
+    return retval;
+  }
+  Q_ASSERT( NULL != group );
+
+  // the tracks are evaluated in parallel, each one from its pyramid
+  QList<NDArray> t_specs;
+  for( int i = 0; i < list.size(); i++ ) {
+    t_specs.append( get_time_spec( safe_arg( args, 0 ), list.at(i), group ) );
+  }
+  QVector< QVector<OcaSampleStats> > stats( list.size() );
+  QList<QRunnable*> tasks;
+  for( int i = 0; i < list.size(); i++ ) {
+    if( 2 == t_specs.at(i).numel() ) {
+      tasks.append( new OcaStatsTask( list.at(i), t_specs.at(i), &stats[i] ) );
+    }
+  }
+  if( 1 == tasks.size() ) {
+    tasks.first()->run();
+    delete tasks.first();
+  }
+  else if( ! tasks.isEmpty() ) {
+    QThreadPool pool;
+    pool.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() ) );
+    for( int i = 0; i < tasks.size(); i++ ) {
+      pool.start( tasks.at(i) );
+    }
+    pool.waitForDone();
+  }
+
+  const char* names[] = { "count", "min", "max", "mean", "var", "rms" };
+  const int N = sizeof(names) / sizeof(names[0]);
+  Cell fields[ N ];
+  for( int k = 0; k < N; k++ ) {
+    fields[k] = Cell( dim_vector( 1, list.size() ) );
+  }
+  for( int i = 0; i < list.size(); i++ ) {
+    const QVector<OcaSampleStats>& s = stats.at(i);
+    NDArray values[ N ];
+    for( int k = 0; k < N; k++ ) {
+      values[k] = NDArray( dim_vector( s.size(), 1 ), NAN );
+    }
+    for( int c = 0; c < s.size(); c++ ) {
+      values[0](c) = s.at(c).count;
+      if( 0 < s.at(c).count ) {
+        OcaAvgData d;
+        s.at(c).getAvgData( &d );
+        values[1](c) = d.min;
+        values[2](c) = d.max;
+        values[3](c) = d.avg;
+        values[4](c) = qMax( 0.0, d.var );
+        values[5](c) = sqrt( s.at(c).sumsq / s.at(c).count );
+      }
+    }
+    for( int k = 0; k < N; k++ ) {
+      fields[k](i) = values[k];
+    }
+  }
+  octave_map map( dim_vector( 1, list.size() ) );
+  for( int k = 0; k < N; k++ ) {
+    map.setfield( names[k], fields[k] );
+  }
+  retval = map;
+
+  return retval;
+}
+
+// ----------------------------------------------------------------------------
+
 OCA_BUILTIN(  data_set,
               "t_next = oca_data_set( t, data, [id], [group_id] )"  )
 {
@@ -1232,30 +1575,8 @@ OCA_BUILTIN(  data_set,
     }
     else {
       double t = val_t.double_value();
-      NDArray ar = val_data.array_value();
-      int channels = track->getChannels();
-      int length = ar.numel();
-      if( 1 < channels ) {
-        if( ar.dim1() == channels ) {
-          length = ar.dim2();
-        }
-        else {
-          error( "invalid number of channels (%d)", ar.dim1() );
-          length = 0;
-        }
-      }
-      else {
-        Q_ASSERT( 1 == channels );
-        if( ! ar.is_vector() ) {
-          error( "data is not a vector" );
-          length = 0;
-        }
-      }
-      if( 0 < length ) {
-        OcaDataVector block( channels, length );
-        memcpy( block.data(), ar.fortran_vec(), length * channels * sizeof(double) );
-        t_next = track->setData( &block, t );
-
+      t_next = set_track_data( track, val_data, t, 0 );
+      if( ! std::isnan( t_next ) ) {
         validate_Track( track );
       }
     }
@@ -1327,21 +1648,34 @@ static octave_value_list process_data_blocks( const octave_value_list& args, int
     Q_ASSERT( NULL != group );
     octave_value t_spec_val = safe_arg( args, 0 );
     NDArray t_spec = get_time_spec( t_spec_val, track, group );
-    if( 2 == t_spec.numel() ) {
+    if( ( 2 == t_spec.numel() ) && ( ! cut ) ) {
+      // each block is read into its own array
+      const bool single = get_single_precision( safe_arg( args, 3 ) );
+      OcaBlockListInfo info;
+      track->getDataBlocksInfo( &info, t_spec(0), t_spec(1) );
+      const double rate = track->getSampleRate();
+      Cell c( 1, info.size() );
+      NDArray starts( dim_vector( 1, info.size() ) );
+      for( int i = 0; i < info.size(); i++ ) {
+        const qint64 len = info.at(i).second;
+        double t_start = NAN;
+        c(i) = value_from_track_block( track, len, single,
+                                       info.at(i).first, len / rate, &t_start );
+        starts(i) = t_start;
+      }
+      result(0) = c;
+      result(1) = starts;
+    }
+    else if( 2 == t_spec.numel() ) {
       OcaBlockListData data;
-      if( cut ) {
-        if( 0 < nargout ) {
-          track->cutData( &data, t_spec(0), t_spec(1) );
-        }
-        else {
-          track->deleteData( t_spec(0), t_spec(1) );
-        }
+      if( 0 < nargout ) {
+        track->cutData( &data, t_spec(0), t_spec(1) );
       }
       else {
-        track->getData( &data, t_spec(0), t_spec(1) );
+        track->deleteData( t_spec(0), t_spec(1) );
       }
 
-      if( ( 0 < nargout ) || ( ! cut ) ) {
+      if( 0 < nargout ) {
         Cell c( 1, data.getSize() );
         NDArray starts( dim_vector( 1, data.getSize() ) );
         for( int i = 0; i < data.getSize(); i++ ) {
@@ -1364,7 +1698,8 @@ static octave_value_list process_data_blocks( const octave_value_list& args, int
 // ----------------------------------------------------------------------------
 
 OCA_BUILTIN(  data_getblocks,
-              "[blocks, starts] = oca_data_getblocks( [t_spec], [id], [group_id] )"   )
+              "[blocks, starts] = oca_data_getblocks( [t_spec], [id], [group_id], [precision] )\n"
+              "     # precision: \"double\" (default), \"single\""   )
 {
   return process_data_blocks( args, nargout, false );
 }
@@ -1497,36 +1832,285 @@ OCA_BUILTIN(  data_fill,
       if( ( ! std::isfinite( dur ) ) || ( 0.0 > dur ) ) {
         error( "invalid duration" );
       }
-      NDArray pat = dt_pat.array_value();
-      int channels = track->getChannels();
-      int length = pat.numel();
-      if( 1 < channels ) {
-        if( pat.dim1() == channels ) {
-          length = pat.dim2();
-        }
-        else {
-          error( "invalid number of channels (%d)", pat.dim1() );
-          length = 0;
-        }
-      }
-      else {
-        Q_ASSERT( 1 == channels );
-        if( ! pat.is_vector() ) {
-          error( "data is not a vector" );
-          length = 0;
+      t_next = set_track_data( track, dt_pat, t, dur );
+    }
+  }
+
+  return octave_value( t_next );
+}
+
+// ----------------------------------------------------------------------------
+
+OCA_BUILTIN(  data_import,
+              "ID = oca_data_import( filename, [id], [group_id] )"   )
+{
+  octave_value retval;
+  octave_value name = safe_arg( args, 0 );
+  if( ! name.is_string() ) {
+    print_usage();
+    return retval;
+  }
+  OcaTrackGroup* group = NULL;
+  OcaTrack* track = NULL;
+  if( safe_arg( args, 1 ).is_defined() ) {
+    track = id_to_datatrack( args, 1, 2, &group );
+    if( NULL == track ) {
+      error( "invalid track" );
+      return retval;
+    }
+    if( track->isReadonly() ) {
+      error( "readonly track '%s'", OCA_CSTR( track->getName() ) );
+      return retval;
+    }
+  }
+  else {
+    group = id_to_group( args, 2 );
+    if( NULL == group ) {
+      error( "invalid group" );
+      return retval;
+    }
+  }
+
+  QString path = OCA_STR( name );
+  OcaAudioImporter importer( path );
+  QString msg;
+  if( ! importer.open( &msg ) ) {
+    error( "%s: %s", OCA_CSTR( msg ), OCA_CSTR( path ) );
+    return retval;
+  }
+  const int channels = importer.getChannels();
+  OcaTrackDataBlock* block = ( NULL == track ) ?
+                          new OcaTrackDataBlock( channels, importer.getFormat() )
+                          : track->createBlock( channels );
+
+  // the chunks are written by this thread, so the import can be interrupted,
+  // their levels are built afterwards in parallel
+  block->setDeferredLevels( true );
+  QElapsedTimer timer;
+  timer.start();
+  qint64 t_report = 1000;
+  importer.start();
+  while( importer.writeNext( block ) ) {
+    if( 0 < octave_interrupt_state ) {
+      importer.cancel();
+      break;
+    }
+    if( ( t_report <= timer.elapsed() ) && ( 0 < importer.getLength() ) ) {
+      printf( "oca_data_import: %d%%\n",
+                          (int)( 100 * importer.getPosition() / importer.getLength() ) );
+      fflush( stdout );
+      t_report += 1000;
+    }
+  }
+  importer.wait();
+  if( 0 < octave_interrupt_state ) {
+    delete block;
+    octave_quit();
+    error( "oca_data_import: interrupted" );
+    return retval;
+  }
+  if( importer.isFailed() || ( 0 == block->getLength() ) ) {
+    delete block;
+    error( "can't import '%s'", OCA_CSTR( path ) );
+    return retval;
+  }
+
+  block->buildAllLevels();
+  block->setDeferredLevels( false );
+  if( NULL == track ) {
+    track = new OcaTrack( QFileInfo( path ).completeBaseName(), importer.getSampleRate() );
+    track->setChannels( channels );
+    track->setStorageFormat( OcaSampleFormat::getName( importer.getFormat() ) );
+    track->setData( block, 0.0 );
+    group->addTrack( track );
+  }
+  else {
+    track->deleteData( -INFINITY, INFINITY );
+    track->setSampleRate( importer.getSampleRate() );
+    track->setChannels( channels );
+    track->setData( block, 0.0 );
+    validate_Track( track );
+  }
+  delete block;
+  retval = ndarray_from_ocaobj( track );
+  return retval;
+}
+
+// ----------------------------------------------------------------------------
+
+OCA_BUILTIN(  data_export,
+              "len = oca_data_export( filename, [t_spec], [ids], [format], [dither], [group_id] )\n"
+              "     # format: \"int16\" (default), \"int24\", \"float32\", \"double\""  )
+{
+  octave_value retval;
+  octave_value name = safe_arg( args, 0 );
+  if( ! name.is_string() ) {
+    print_usage();
+    return retval;
+  }
+  OcaTrackGroup* group = NULL;
+  QList<OcaTrack*> list = id_to_datatrack_list( args, 2, 5, &group );
+  if( list.isEmpty() ) {
+    error( "invalid track" );
+    return retval;
+  }
+  Q_ASSERT( NULL != group );
+  int format = OcaSampleFormat::e_FormatInt16;
+  if( safe_arg( args, 3 ).is_defined() ) {
+    format = OcaSampleFormat::fromName( OCA_STR( safe_arg( args, 3 ) ) );
+    if( -1 == format ) {
+      error( "invalid format" );
+      return retval;
+    }
+  }
+  bool dither = false;
+  if( safe_arg( args, 4 ).is_defined() ) {
+    dither = safe_arg( args, 4 ).bool_value();
+  }
+
+  // the tracks are interleaved into one file, so they must share the rate
+  const double rate = list.first()->getSampleRate();
+  int channels = 0;
+  double t_start = INFINITY;
+  double t_end = -INFINITY;
+  for( int i = 0; i < list.size(); i++ ) {
+    OcaTrack* track = list.at(i);
+    if( rate != track->getSampleRate() ) {
+      error( "sample rate of '%s' differs", OCA_CSTR( track->getName() ) );
+      return retval;
+    }
+    channels += track->getChannels();
+    if( 0 < track->getDuration() ) {
+      t_start = qMin( t_start, track->getStartTime() );
+      t_end = qMax( t_end, track->getEndTime() );
+    }
+  }
+  NDArray t_spec = get_time_spec( safe_arg( args, 1 ), list.first(), group );
+  if( 2 != t_spec.numel() ) {
+    return retval;
+  }
+  double t0 = qMax( t_spec(0), t_start );
+  double t1 = ( INFINITY == t_spec(1) ) ? t_end : qMin( t_spec(0) + t_spec(1), t_end );
+  const qint64 total = ( t0 < t1 ) ? (qint64)round( ( t1 - t0 ) * rate ) : 0;
+
+  QString path = OCA_STR( name );
+  OcaAudioExporter exporter( path, channels, rate, format, dither );
+  QString msg;
+  if( ! exporter.open( &msg ) ) {
+    error( "%s: %s", OCA_CSTR( msg ), OCA_CSTR( path ) );
+    return retval;
+  }
+
+  // sample j of the file is at t0 + j / rate, the chunks are fetched
+  // between the sample centers and the blocks are rounded to that grid
+  const qint64 N = 0x10000;
+  QElapsedTimer timer;
+  timer.start();
+  qint64 t_report = 1000;
+  OcaDataVector chunk( channels, N );
+  for( qint64 k = 0; k < total; k += N ) {
+    const long len = qMin( N, total - k );
+    chunk.setLength( len );
+    memset( chunk.data(), 0, len * channels * sizeof(double) );
+    int ch0 = 0;
+    for( int i = 0; i < list.size(); i++ ) {
+      const OcaTrack* track = list.at(i);
+      const int C = track->getChannels();
+      OcaBlockListData data;
+      track->getData( &data, t0 + ( k - 0.5 ) / rate, len / rate );
+      for( int b = 0; b < data.getSize(); b++ ) {
+        const OcaDataVector* block = data.getBlock( b );
+        qint64 idx = (qint64)round( ( data.getTime( b ) - t0 ) * rate ) - k;
+        qint64 a = qMax( (qint64)0, -idx );
+        qint64 e = qMin( (qint64)block->length(), len - idx );
+        for( qint64 n = a; n < e; n++ ) {
+          memcpy( chunk.data() + ( idx + n ) * channels + ch0,
+                  block->constData() + n * C, C * sizeof(double) );
         }
       }
-      if( 0 < length ) {
-        OcaDataVector block( channels, length );
-        memcpy( block.data(), pat.fortran_vec(), length * channels * sizeof(double) );
-        t_next = track->setData( &block, t, dur );
-      }
+      ch0 += C;
+    }
+    // an incomplete file would look valid, so it is removed
+    if( ! exporter.write( &chunk ) ) {
+      exporter.abort();
+      error( "can't write '%s', the incomplete file is removed", OCA_CSTR( path ) );
+      return retval;
+    }
+    if( 0 < octave_interrupt_state ) {
+      exporter.abort();
+      octave_quit();
+      error( "oca_data_export: interrupted, the incomplete '%s' is removed",
+                                                                    OCA_CSTR( path ) );
+      return retval;
+    }
+    if( t_report <= timer.elapsed() ) {
+      printf( "oca_data_export: %d%%\n", (int)( 100 * k / total ) );
+      fflush( stdout );
+      t_report += 1000;
+    }
+  }
+  if( ! exporter.close() ) {
+    exporter.abort();
+    error( "can't write '%s', the incomplete file is removed", OCA_CSTR( path ) );
+    return retval;
+  }
+
+  retval = octave_value( (double)exporter.getLength() );
+  return retval;
+}
+
+// ----------------------------------------------------------------------------
+
+OCA_BUILTIN(  data_copy,
+              "t_next = oca_data_copy( t_spec, src_id, t, dst_id, [group_id] )"   )
+{
+  OcaTrackGroup* group = NULL;
+  OcaTrack* src = id_to_datatrack( args, 1, 4, &group );
+  OcaTrack* dst = id_to_datatrack( args, 3, 4 );
+  double t_next = NAN;
+  octave_value val_t = safe_arg( args, 2 );
+  if( NULL == src ) {
+    error( "invalid source track" );
+  }
+  else if( NULL == dst ) {
+    error( "invalid destination track" );
+  }
+  else if( ! val_t.is_real_scalar() ) {
+    error( "invalid t" );
+  }
+  else if( dst->isReadonly() ) {
+    error( "readonly track '%s'", OCA_CSTR( dst->getName() ) );
+  }
+  else if( src->getChannels() != dst->getChannels() ) {
+    error( "invalid number of channels (%d)", src->getChannels() );
+  }
+  else if( src->getSampleRate() != dst->getSampleRate() ) {
+    error( "sample rate mismatch (%g, %g)", src->getSampleRate(), dst->getSampleRate() );
+  }
+  else {
+    Q_ASSERT( NULL != group );
+    NDArray t_spec = get_time_spec( safe_arg( args, 0 ), src, group );
+    if( 2 == t_spec.numel() ) {
+      t_next = dst->copyData( src, t_spec(0), t_spec(1), val_t.double_value() );
+      validate_Track( dst );
     }
   }
 
   return octave_value( t_next );
 }
 
+// ----------------------------------------------------------------------------
+
+OCA_BUILTIN(  data_flush,
+              "oca_data_flush()"   )
+{
+  octave_value retval;
+  if( ! OcaSampleFile::flushPendingWrites() ) {
+    error( "can't store the written data" );
+  }
+  return retval;
+}
+
 // ----------------------------------------------------------------------------
 // group
 
@@ -2275,6 +2859,43 @@ OCA_BUILTIN(  context_remove,
   return retval;
 }
 
+// ----------------------------------------------------------------------------
+// project
+
+OCA_BUILTIN(  project_save,
+              "oca_project_save( path )"  )
+{
+  octave_value retval;
+  octave_value path = safe_arg( args, 0 );
+  if( ! path.is_string() ) {
+    print_usage();
+    return retval;
+  }
+  QString msg;
+  if( ! OcaProject::save( OCA_STR( path ), OcaOctaveHost::getWindowData(), &msg ) ) {
+    error( "%s", OCA_CSTR( msg ) );
+  }
+  return retval;
+}
+
+// ----------------------------------------------------------------------------
+
+OCA_BUILTIN(  project_load,
+              "oca_project_load( path )"  )
+{
+  octave_value retval;
+  octave_value path = safe_arg( args, 0 );
+  if( ! path.is_string() ) {
+    print_usage();
+    return retval;
+  }
+  QString msg;
+  if( ! OcaProject::load( OCA_STR( path ), OcaOctaveHost::getWindowData(), &msg ) ) {
+    error( "%s", OCA_CSTR( msg ) );
+  }
+  return retval;
+}
+
 // ----------------------------------------------------------------------------
 
 OCA_BUILTIN(  global_getprop,
@@ -2304,12 +2925,28 @@ OCA_BUILTIN(  global_getinfo,
               "ret = oca_global_getinfo( name )\n"
               "ret = oca_global_getinfo()"  )
 {
+  // the block cache counters are collected on each call
+  octave_scalar_map info = *OcaOctaveHost::getInfo();
+  OcaBlockCache::Stats stats;
+  OcaBlockCache::getStats( &stats );
+  octave_scalar_map cache;
+  cache.assign( "budget", (double)stats.budget );
+  cache.assign( "pyramid_size", (double)stats.size[ OcaBlockCache::e_PoolPyramid ] );
+  cache.assign( "pyramid_hits", (double)stats.hits[ OcaBlockCache::e_PoolPyramid ] );
+  cache.assign( "pyramid_misses", (double)stats.misses[ OcaBlockCache::e_PoolPyramid ] );
+  cache.assign( "pyramid_read", (double)stats.read[ OcaBlockCache::e_PoolPyramid ] );
+  cache.assign( "samples_size", (double)stats.size[ OcaBlockCache::e_PoolSamples ] );
+  cache.assign( "samples_hits", (double)stats.hits[ OcaBlockCache::e_PoolSamples ] );
+  cache.assign( "samples_misses", (double)stats.misses[ OcaBlockCache::e_PoolSamples ] );
+  cache.assign( "samples_read", (double)stats.read[ OcaBlockCache::e_PoolSamples ] );
+  info.assign( "block_cache", cache );
+
   octave_value retval;
   if( 0 == args.length() ) {
-    retval = *OcaOctaveHost::getInfo();
+    retval = info;
   }
   else if( args(0).is_string() ) {
-    retval = OcaOctaveHost::getInfo()->getfield( args(0).string_value() );
+    retval = info.getfield( args(0).string_value() );
   }
   else {
     print_usage();
@@ -2441,8 +3078,11 @@ void OcaOctaveHost::initialize()
   INSTALL_OCA_BUILTIN( track_getprop );
   INSTALL_OCA_BUILTIN( track_setprop );
   INSTALL_OCA_BUILTIN( track_find );
+  INSTALL_OCA_BUILTIN( track_mapfile );
 
   INSTALL_OCA_BUILTIN( data_get );
+  INSTALL_OCA_BUILTIN( data_getavg );
+  INSTALL_OCA_BUILTIN( data_stats );
   INSTALL_OCA_BUILTIN( data_set );
   INSTALL_OCA_BUILTIN( data_clear );
   INSTALL_OCA_BUILTIN( data_listblocks );
@@ -2452,6 +3092,10 @@ void OcaOctaveHost::initialize()
   INSTALL_OCA_BUILTIN( data_join );
   INSTALL_OCA_BUILTIN( data_moveblocks );
   INSTALL_OCA_BUILTIN( data_fill );
+  INSTALL_OCA_BUILTIN( data_import );
+  INSTALL_OCA_BUILTIN( data_export );
+  INSTALL_OCA_BUILTIN( data_copy );
+  INSTALL_OCA_BUILTIN( data_flush );
 
   INSTALL_OCA_BUILTIN( group_add );
   INSTALL_OCA_BUILTIN( group_remove );
@@ -2496,6 +3140,9 @@ void OcaOctaveHost::initialize()
   INSTALL_OCA_BUILTIN( context_set );
   INSTALL_OCA_BUILTIN( context_remove );
 
+  INSTALL_OCA_BUILTIN( project_save );
+  INSTALL_OCA_BUILTIN( project_load );
+
   INSTALL_OCA_BUILTIN( global_getprop );
   INSTALL_OCA_BUILTIN( global_setprop );
   INSTALL_OCA_BUILTIN( global_getinfo );
@@ -2512,6 +3159,7 @@ void OcaOctaveHost::initialize()
   if( NULL != Oca_BUILD_REVISION ) {
     info->assign( "build_revision", OCA_BUILD_REVISION );
   }
+  info->assign( "avg_kernel", OcaAvgKernel::getKernelName() );
 
 #if CHECK_OCTAVE_VERSION(4,4)
   octave_interpreter->execute();
@@ -0,0 +1,432 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaPackFile.h"
+
+#include <QtCore>
+
+#if defined( Q_OS_LINUX ) || defined( Q_OS_MAC )
+#include <fcntl.h>
+#include <errno.h>
+#endif
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <winioctl.h>
+#include <io.h>
+#endif
+
+#if defined( Q_OS_LINUX ) || defined( Q_OS_WIN ) || ( defined( Q_OS_MAC ) && defined( F_PUNCHHOLE ) )
+#define OCA_PUNCH_HOLES
+#endif
+
+const qint64 OcaPackFile::s_SEGMENT_SIZE = 0x100000;
+const int OcaPackFile::s_SEGMENT_COUNT = ( 8 <= sizeof(void*) ) ? 1024 : 256;
+
+QMutex OcaPackFile::s_mutex;
+QList<OcaPackFile*> OcaPackFile::s_packs;
+int OcaPackFile::s_counter = 0;
+
+// ------------------------------------------------------------------------------------
+
+OcaPackFile::OcaPackFile( const QString& dir )
+:
+  m_dir( dir ),
+  m_file( QString( "%1/pack%2.bin" ) . arg( dir ) . arg( s_counter++, 4, 16, QLatin1Char('0') ) ),
+  m_count( s_SEGMENT_COUNT ),
+  m_maps( s_SEGMENT_COUNT, NULL ),
+  m_state( s_SEGMENT_COUNT, e_StateFree ),
+  m_keep( s_SEGMENT_COUNT, 0 ),
+  m_used( 0 ),
+  m_kept( 0 ),
+  m_hint( 0 ),
+  m_sealed( false ),
+  m_owned( true )
+{
+  // the file is sparse, only the written segments take space,
+  // without hole punching it grows with the used segments instead
+  if( m_file.open( QIODevice::ReadWrite | QIODevice::Truncate ) ) {
+#ifdef Q_OS_WIN
+    DWORD bytes = 0;
+    DeviceIoControl( (HANDLE)_get_osfhandle( m_file.handle() ), FSCTL_SET_SPARSE,
+                                                  NULL, 0, NULL, 0, &bytes, NULL );
+#endif
+#ifdef OCA_PUNCH_HOLES
+    if( ! m_file.resize( s_SEGMENT_SIZE * m_count ) ) {
+      m_file.close();
+    }
+#endif
+  }
+  if( ! isOpen() ) {
+    fprintf( stderr, "OcaPackFile: can't create %s\n",
+                                              m_file.fileName().toLocal8Bit().data() );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaPackFile::OcaPackFile( const QString& dir, const QString& path )
+:
+  m_dir( dir ),
+  m_file( path ),
+  m_count( 0 ),
+  m_used( 0 ),
+  m_kept( 0 ),
+  m_hint( 0 ),
+  m_sealed( true ),
+  m_owned( false )
+{
+  // an existing file is used as is, without write access the freed
+  // segments are just not punched
+  if( m_file.open( QIODevice::ReadWrite ) || m_file.open( QIODevice::ReadOnly ) ) {
+    if( 0 == m_file.size() % s_SEGMENT_SIZE ) {
+      m_count = m_file.size() / s_SEGMENT_SIZE;
+    }
+    else {
+      m_file.close();
+    }
+  }
+  m_maps.fill( NULL, m_count );
+  m_state.fill( e_StateFree, m_count );
+  m_keep.fill( 0, m_count );
+  m_hint = m_count;
+  if( ! isOpen() ) {
+    fprintf( stderr, "OcaPackFile: can't open %s\n",
+                                              m_file.fileName().toLocal8Bit().data() );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaPackFile::~OcaPackFile()
+{
+  Q_ASSERT( isUnused() );
+  for( int i = 0; i < m_count; i++ ) {
+    unmapData( i );
+  }
+  if( m_owned ) {
+    m_file.remove();
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaPackFile::allocSegment( Segment* segment, const QString& dir )
+{
+  QMutexLocker locker( &s_mutex );
+  OcaPackFile* pack = NULL;
+  for( int i = 0; i < s_packs.size(); i++ ) {
+    if( ( s_packs[i]->m_used < s_packs[i]->m_count ) && ( ! s_packs[i]->m_sealed )
+                                                  && ( s_packs[i]->m_dir == dir ) ) {
+      pack = s_packs[i];
+      break;
+    }
+  }
+  if( NULL == pack ) {
+    pack = new OcaPackFile( dir );
+    if( ! pack->isOpen() ) {
+      delete pack;
+      return false;
+    }
+    s_packs.append( pack );
+  }
+
+  int index = pack->alloc();
+  if( 0 > index ) {
+    if( pack->isUnused() ) {
+      s_packs.removeOne( pack );
+      delete pack;
+    }
+    return false;
+  }
+  segment->pack = pack;
+  segment->index = index;
+  segment->data = pack->m_maps[ index ];
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPackFile::freeSegment( const Segment& segment )
+{
+  QMutexLocker locker( &s_mutex );
+  OcaPackFile* pack = segment.pack;
+  pack->free( segment.index );
+  if( pack->isUnused() ) {
+    s_packs.removeOne( pack );
+    delete pack;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaPackFile::openSegment( Segment* segment, const QString& path, int index )
+{
+  QMutexLocker locker( &s_mutex );
+  if( 0 > index ) {
+    return false;
+  }
+  OcaPackFile* pack = NULL;
+  for( int i = 0; i < s_packs.size(); i++ ) {
+    if( ( s_packs[i]->m_file.fileName() == path ) || s_packs[i]->m_links.contains( path ) ) {
+      pack = s_packs[i];
+      break;
+    }
+  }
+  if( NULL == pack ) {
+    pack = new OcaPackFile( QFileInfo( path ).path(), path );
+    if( ! pack->isOpen() ) {
+      delete pack;
+      return false;
+    }
+    s_packs.append( pack );
+  }
+  // every segment belongs to one data file only
+  if( ( pack->m_count <= index ) || ( e_StateUsed == pack->m_state[ index ] )
+                                              || ( NULL == pack->mapData( index ) ) ) {
+    if( pack->isUnused() ) {
+      s_packs.removeOne( pack );
+      delete pack;
+    }
+    return false;
+  }
+
+  pack->m_state[ index ] = e_StateUsed;
+  pack->m_used++;
+  segment->pack = pack;
+  segment->index = index;
+  segment->data = pack->m_maps[ index ];
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPackFile::keepSegment( const Segment& segment )
+{
+  QMutexLocker locker( &s_mutex );
+  OcaPackFile* pack = segment.pack;
+  if( 0 == pack->m_keep[ segment.index ]++ ) {
+    pack->m_kept++;
+  }
+  pack->m_sealed = true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPackFile::unkeepSegment( const Segment& segment )
+{
+  QMutexLocker locker( &s_mutex );
+  OcaPackFile* pack = segment.pack;
+  Q_ASSERT( 0 < pack->m_keep[ segment.index ] );
+  if( 0 < --pack->m_keep[ segment.index ] ) {
+    return;
+  }
+  pack->m_kept--;
+  if( e_StateStale == pack->m_state[ segment.index ] ) {
+    pack->unmapData( segment.index );
+    pack->punch( segment.index );
+  }
+  if( pack->isUnused() ) {
+    s_packs.removeOne( pack );
+    delete pack;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+QStringList OcaPackFile::getFileNames( const Segment& segment )
+{
+  // the path of the pack and its hard links
+  QMutexLocker locker( &s_mutex );
+  return QStringList( segment.pack->m_file.fileName() ) + segment.pack->m_links;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaPackFile::linkFile( const Segment& segment, const QString& path )
+{
+  // A hard link shares the data, so it is remembered as another name of the pack.
+  // Across file systems the used and kept segments are copied instead.
+  QMutexLocker locker( &s_mutex );
+  OcaPackFile* pack = segment.pack;
+#ifdef Q_OS_UNIX
+  if( 0 == link( QFile::encodeName( pack->m_file.fileName() ).constData(),
+                                          QFile::encodeName( path ).constData() ) ) {
+    pack->m_links.append( path );
+    return true;
+  }
+#endif
+  QFile file( path );
+  if( ! ( file.open( QIODevice::WriteOnly | QIODevice::Truncate )
+                            && file.resize( pack->m_file.size() ) ) ) {
+    return false;
+  }
+  for( int i = 0; i < pack->m_count; i++ ) {
+    if( NULL != pack->m_maps[i] ) {
+      // the used and kept segments are mapped
+      const char* data = (const char*)pack->m_maps[i];
+      if( ! ( file.seek( i * s_SEGMENT_SIZE )
+                        && ( s_SEGMENT_SIZE == file.write( data, s_SEGMENT_SIZE ) ) ) ) {
+        file.remove();
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaPackFile::alloc()
+{
+  // first fit keeps the used part of the file compact
+  Q_ASSERT( m_used < m_count );
+  int index = m_hint;
+  while( e_StateUsed == m_state[ index ] ) {
+    index++;
+  }
+  if( ( ! reserve( index ) ) || ( NULL == mapData( index ) ) ) {
+    return -1;
+  }
+  if( e_StateStale == m_state[ index ] ) {
+    memset( m_maps[ index ], 0, s_SEGMENT_SIZE );
+  }
+  m_state[ index ] = e_StateUsed;
+  m_used++;
+  m_hint = index + 1;
+  while( ( m_hint < m_count ) && ( e_StateUsed == m_state[ m_hint ] ) ) {
+    m_hint++;
+  }
+  return index;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPackFile::free( int index )
+{
+  // the kept segments are punched when the project releases them
+  Q_ASSERT( e_StateUsed == m_state[ index ] );
+  m_state[ index ] = e_StateStale;
+  if( 0 == m_keep[ index ] ) {
+    unmapData( index );
+    punch( index );
+  }
+  m_used--;
+  m_hint = qMin( m_hint, index );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPackFile::punch( int index )
+{
+  // the pack files of the projects may be linked to other projects
+  Q_ASSERT( e_StateStale == m_state[ index ] );
+  if( ! m_owned ) {
+    return;
+  }
+  // the punched range reads back as zeros
+  const qint64 ofs = index * s_SEGMENT_SIZE;
+#if defined( Q_OS_LINUX )
+  if( 0 == fallocate( m_file.handle(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                                                ofs, s_SEGMENT_SIZE ) ) {
+    m_state[ index ] = e_StateFree;
+  }
+#elif defined( Q_OS_WIN )
+  FILE_ZERO_DATA_INFORMATION zero;
+  zero.FileOffset.QuadPart = ofs;
+  zero.BeyondFinalZero.QuadPart = ofs + s_SEGMENT_SIZE;
+  DWORD bytes = 0;
+  if( DeviceIoControl( (HANDLE)_get_osfhandle( m_file.handle() ), FSCTL_SET_ZERO_DATA,
+                                    &zero, sizeof(zero), NULL, 0, &bytes, NULL ) ) {
+    m_state[ index ] = e_StateFree;
+  }
+#elif defined( OCA_PUNCH_HOLES )
+  fpunchhole_t hole;
+  memset( &hole, 0, sizeof(hole) );
+  hole.fp_offset = ofs;
+  hole.fp_length = s_SEGMENT_SIZE;
+  if( 0 == fcntl( m_file.handle(), F_PUNCHHOLE, &hole ) ) {
+    m_state[ index ] = e_StateFree;
+  }
+#else
+  // the unused segments at the end of the file are truncated
+  Q_UNUSED( ofs );
+  int count = m_count;
+  while( ( 0 < count ) && ( e_StateUsed != m_state[ count - 1 ] )
+                                                    && ( 0 == m_keep[ count - 1 ] ) ) {
+    count--;
+  }
+  if( ( m_file.size() > count * s_SEGMENT_SIZE )
+                                        && m_file.resize( count * s_SEGMENT_SIZE ) ) {
+    for( int i = count; i < m_count; i++ ) {
+      m_state[i] = e_StateFree;
+    }
+  }
+#endif
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaPackFile::reserve( int index )
+{
+  // The blocks of the segment are allocated before it is mapped: a write to a hole
+  // of the mapping raises SIGBUS when the disk is full, while here the allocation
+  // just fails and the data file falls back to the file io. The zeros written
+  // also grow the file where the holes are not punched.
+  const qint64 ofs = index * s_SEGMENT_SIZE;
+#ifdef Q_OS_LINUX
+  if( 0 == fallocate( m_file.handle(), 0, ofs, s_SEGMENT_SIZE ) ) {
+    return true;
+  }
+  if( ENOSPC == errno ) {
+    return false;
+  }
+#endif
+  static const QByteArray zeros( s_SEGMENT_SIZE, 0 );
+  return m_file.seek( ofs ) && ( s_SEGMENT_SIZE == m_file.write( zeros ) ) && m_file.flush();
+}
+
+// ------------------------------------------------------------------------------------
+
+uchar* OcaPackFile::mapData( int index )
+{
+  if( NULL == m_maps[ index ] ) {
+    const qint64 ofs = index * s_SEGMENT_SIZE;
+    m_maps[ index ] = m_file.map( ofs, s_SEGMENT_SIZE );
+    if( NULL == m_maps[ index ] ) {
+      fprintf( stderr, "OcaPackFile: can't map a segment of %s\n",
+                                              m_file.fileName().toLocal8Bit().data() );
+    }
+  }
+  return m_maps[ index ];
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPackFile::unmapData( int index )
+{
+  if( NULL != m_maps[ index ] ) {
+    m_file.unmap( m_maps[ index ] );
+    m_maps[ index ] = NULL;
+  }
+}
+
+// ------------------------------------------------------------------------------------
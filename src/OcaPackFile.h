@@ -0,0 +1,107 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaPackFile_h
+#define OcaPackFile_h
+
+#include <QFile>
+#include <QMutex>
+#include <QList>
+#include <QStringList>
+#include <QVector>
+
+// Sparse file in the data cache directory divided into segments of s_SEGMENT_SIZE
+// bytes. The segments are handed out to the data files of all tracks, each one is
+// mapped separately while it is in use (or kept), so the address space taken follows
+// the stored data. The space of the freed segments is given back to the file system
+// (hole punching), where that is not supported the file is truncated after its last
+// segment in use. The disk space of a segment is allocated before it is handed out,
+// so a full disk fails the allocation instead of the writes to the mapping.
+// The file is removed with its last segment. The packs have fewer segments
+// on 32-bit targets.
+// The segments saved in a project (see OcaProject) are kept: they are neither
+// punched nor reused until released by the project, and no new segments are
+// allocated in such a (sealed) file. The pack files of a loaded project are opened
+// in place, sealed and never removed.
+
+class OcaPackFile
+{
+  public:
+    struct Segment {
+      OcaPackFile*  pack;
+      int           index;
+      uchar*        data;
+    };
+
+  public:
+    static bool allocSegment( Segment* segment, const QString& dir );
+    static void freeSegment( const Segment& segment );
+    static bool openSegment( Segment* segment, const QString& path, int index );
+    static void keepSegment( const Segment& segment );
+    static void unkeepSegment( const Segment& segment );
+    static QStringList getFileNames( const Segment& segment );
+    static bool linkFile( const Segment& segment, const QString& path );
+
+  public:
+    static const qint64 s_SEGMENT_SIZE;
+
+  protected:
+    OcaPackFile( const QString& dir );
+    OcaPackFile( const QString& dir, const QString& path );
+    ~OcaPackFile();
+
+  protected:
+    int  alloc();
+    void free( int index );
+    void punch( int index );
+    bool reserve( int index );
+    uchar* mapData( int index );
+    void unmapData( int index );
+    bool isOpen() const { return m_file.isOpen(); }
+    bool isUnused() const { return ( 0 == m_used ) && ( 0 == m_kept ); }
+
+  protected:
+    enum ESegmentState {
+      e_StateFree,
+      e_StateUsed,
+      e_StateStale,
+    };
+
+  protected:
+    QString         m_dir;
+    QFile           m_file;
+    QStringList     m_links;
+    int             m_count;
+    QVector<uchar*> m_maps;
+    QVector<quint8> m_state;
+    QVector<int>    m_keep;
+    int             m_used;
+    int             m_kept;
+    int             m_hint;
+    bool            m_sealed;
+    bool            m_owned;
+
+  protected:
+    static QMutex             s_mutex;
+    static QList<OcaPackFile*> s_packs;
+    static int                s_counter;
+    static const int          s_SEGMENT_COUNT;
+};
+
+#endif // OcaPackFile_h
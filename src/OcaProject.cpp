@@ -0,0 +1,1030 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaProject.h"
+
+#include "OcaWindowData.h"
+#include "OcaTrackGroup.h"
+#include "OcaTrack.h"
+#include "OcaSmartTrack.h"
+#include "OcaMonitor.h"
+#include "OcaTrackDataBlock.h"
+#include "OcaSampleFile.h"
+#include "OcaDataFile.h"
+#include "OcaBlockCache.h"
+
+#include <QtCore>
+#include <QColor>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include <cmath>
+
+const QString OcaProject::s_PROJECT_FILE( "project.json" );
+const QString OcaProject::s_FORMAT( "octaudio-project" );
+const int OcaProject::s_VERSION = 1;
+QMutex OcaProject::s_mutex;
+QHash<QString,OcaProject::Entry> OcaProject::s_projects;
+
+// ------------------------------------------------------------------------------------
+
+bool OcaProject::save( const QString& path, OcaWindowData* window, QString* error )
+{
+  QDir dir( path );
+  if( ! dir.mkpath( "." ) ) {
+    *error = QString( "can't create %1" ) . arg( path );
+    return false;
+  }
+  SaveContext ctx;
+  ctx.dir = QDir( dir.canonicalPath() );
+  ctx.counter = 0;
+  const QSet<QString> previous = readDataFiles( ctx.dir );
+
+  // the objects are referenced by their kind and position
+  QList<OcaTrackGroup*> groups;
+  QList<OcaMonitor*> monitors;
+  int tracks = 0;
+  int smart_tracks = 0;
+  for( uint i = 0; i < window->getGroupCount(); i++ ) {
+    OcaTrackGroup* group = window->getGroupAt( i );
+    groups.append( group );
+    ctx.keys.insert( group, QString( "g%1" ) . arg( i ) );
+    for( uint j = 0; j < group->getTrackCount(); j++ ) {
+      OcaTrackBase* t = group->getTrackAt( j );
+      if( NULL != qobject_cast<OcaTrack*>( t ) ) {
+        ctx.keys.insert( t, QString( "t%1" ) . arg( tracks++ ) );
+      }
+      else if( NULL != qobject_cast<OcaSmartTrack*>( t ) ) {
+        ctx.keys.insert( t, QString( "s%1" ) . arg( smart_tracks++ ) );
+      }
+    }
+  }
+  for( uint i = 0; i < window->getMonitorCount(); i++ ) {
+    OcaMonitor* monitor = window->getMonitorAt( i );
+    monitors.append( monitor );
+    ctx.keys.insert( monitor, QString( "m%1" ) . arg( i ) );
+  }
+
+  QJsonArray groups_desc;
+  for( int i = 0; i < groups.size(); i++ ) {
+    OcaTrackGroup* group = groups[i];
+    QJsonArray tracks_desc;
+    for( uint j = 0; j < group->getTrackCount(); j++ ) {
+      OcaTrackBase* t = group->getTrackAt( j );
+      OcaTrack* track = qobject_cast<OcaTrack*>( t );
+      OcaSmartTrack* smart_track = qobject_cast<OcaSmartTrack*>( t );
+      QJsonObject desc;
+      if( NULL != track ) {
+        desc = saveTrack( track, &ctx );
+      }
+      else if( NULL != smart_track ) {
+        desc.insert( "id", ctx.keys.value( t ) );
+        desc.insert( "props", saveProperties( t, ctx, QStringList() ) );
+        desc.insert( "auto_scale", smart_track->isAutoScaleOn() );
+        desc.insert( "subtracks", saveSubtracks( smart_track, ctx ) );
+      }
+      else {
+        continue;
+      }
+      desc.insert( "height", group->getTrackHeight( t ) );
+      tracks_desc.append( desc );
+    }
+    QJsonObject desc;
+    desc.insert( "id", ctx.keys.value( group ) );
+    desc.insert( "props", saveProperties( group, ctx, QStringList() ) );
+    desc.insert( "tracks", tracks_desc );
+    groups_desc.append( desc );
+  }
+
+  QJsonArray monitors_desc;
+  for( int i = 0; i < monitors.size(); i++ ) {
+    QJsonObject desc;
+    desc.insert( "id", ctx.keys.value( monitors[i] ) );
+    desc.insert( "props", saveProperties( monitors[i], ctx, QStringList() ) );
+    desc.insert( "auto_scale", monitors[i]->isAutoScaleOn() );
+    desc.insert( "subtracks", saveSubtracks( monitors[i], ctx ) );
+    monitors_desc.append( desc );
+  }
+
+  QJsonObject window_desc;
+  window_desc.insert( "default_rate", window->getDefaultSampleRate() );
+  if( ctx.keys.contains( window->getActiveGroup() ) ) {
+    QJsonObject ref;
+    ref.insert( "object", ctx.keys.value( window->getActiveGroup() ) );
+    window_desc.insert( "active_group", ref );
+  }
+
+  // the sample files collected from the tracks
+  QJsonArray files_desc;
+  for( int i = 0; ctx.error.isEmpty() && ( i < ctx.entry.files.size() ); i++ ) {
+    OcaSampleFile* file = ctx.entry.files[i];
+    const QJsonObject desc = saveSampleFile( file, &ctx );
+    ctx.entry.descs.insert( QJsonDocument( desc ).toJson( QJsonDocument::Compact ), file );
+    files_desc.append( desc );
+  }
+
+  QJsonObject root;
+  root.insert( "format", s_FORMAT );
+  root.insert( "version", s_VERSION );
+  root.insert( "window", window_desc );
+  root.insert( "groups", groups_desc );
+  root.insert( "monitors", monitors_desc );
+  root.insert( "files", files_desc );
+
+  // the files created for this project or by its previous version
+  QStringList data_files = ( ctx.names & ( ctx.owned + previous ) ).values();
+  data_files.sort();
+  root.insert( "data_files", QJsonArray::fromStringList( data_files ) );
+
+  // the data reaches the disk before the project file refers to it
+  foreach( const QString& name, ctx.names ) {
+    if( ctx.error.isEmpty() && ! syncFile( ctx.dir.filePath( name ) ) ) {
+      ctx.error = QString( "can't sync %1" ) . arg( name );
+    }
+  }
+  if( ctx.error.isEmpty() ) {
+    QSaveFile file( ctx.dir.filePath( s_PROJECT_FILE ) );
+    const QByteArray data = QJsonDocument( root ).toJson();
+    if( ! ( file.open( QIODevice::WriteOnly )
+                            && ( data.size() == file.write( data ) ) && file.commit() ) ) {
+      ctx.error = QString( "can't write %1" ) . arg( file.fileName() );
+    }
+  }
+  if( ! ctx.error.isEmpty() ) {
+    releaseEntry( ctx.entry );
+    for( int i = 0; i < ctx.created.size(); i++ ) {
+      ctx.dir.remove( ctx.created[i] );
+    }
+    *error = ctx.error;
+    return false;
+  }
+
+  // the previous version of the project releases its data
+  Entry entry;
+  {
+    QMutexLocker locker( &s_mutex );
+    entry = s_projects.take( ctx.dir.path() );
+    s_projects.insert( ctx.dir.path(), ctx.entry );
+  }
+  releaseEntry( entry );
+  foreach( const QString& name, previous ) {
+    if( ! ctx.names.contains( name ) ) {
+      ctx.dir.remove( name );
+    }
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaProject::load( const QString& path, OcaWindowData* window, QString* error )
+{
+  if( ! QDir( path ).exists() ) {
+    *error = QString( "%1 not found" ) . arg( path );
+    return false;
+  }
+  LoadContext ctx;
+  ctx.dir = QDir( QDir( path ).canonicalPath() );
+  QFile file( ctx.dir.filePath( s_PROJECT_FILE ) );
+  if( ! file.open( QIODevice::ReadOnly ) ) {
+    *error = QString( "can't open %1" ) . arg( file.fileName() );
+    return false;
+  }
+  QJsonParseError parse_error;
+  const QJsonObject root = QJsonDocument::fromJson( file.readAll(), &parse_error ).object();
+  if( ( QJsonParseError::NoError != parse_error.error )
+                        || ( s_FORMAT != root.value( "format" ).toString() )
+                        || ( s_VERSION < root.value( "version" ).toInt() ) ) {
+    *error = QString( "invalid project file %1" ) . arg( file.fileName() );
+    return false;
+  }
+  {
+    QMutexLocker locker( &s_mutex );
+    ctx.current = s_projects.value( ctx.dir.path() );
+  }
+
+  // the data is checked first, no object is created unless all of it is valid
+  QList<OcaSampleFile*> files;
+  const QJsonArray files_desc = root.value( "files" ).toArray();
+  for( int i = 0; ctx.error.isEmpty() && ( i < files_desc.size() ); i++ ) {
+    OcaSampleFile* f = loadSampleFile( files_desc[i].toObject(), &ctx );
+    if( NULL != f ) {
+      files.append( f );
+    }
+    else if( ctx.error.isEmpty() ) {
+      ctx.error = QString( "invalid data file %1" ) . arg( i );
+    }
+  }
+  const QJsonArray groups_desc = root.value( "groups" ).toArray();
+  for( int i = 0; ctx.error.isEmpty() && ( i < groups_desc.size() ); i++ ) {
+    const QJsonArray tracks_desc = groups_desc[i].toObject().value( "tracks" ).toArray();
+    for( int j = 0; ctx.error.isEmpty() && ( j < tracks_desc.size() ); j++ ) {
+      const QJsonObject desc = tracks_desc[j].toObject();
+      if( desc.contains( "blocks" ) && ! checkTrack( desc, files ) ) {
+        ctx.error = QString( "invalid track %1" ) . arg( desc.value( "id" ).toString() );
+      }
+    }
+  }
+  if( ! ctx.error.isEmpty() ) {
+    for( int i = 0; i < files.size(); i++ ) {
+      files[i]->release();
+    }
+    releaseEntry( ctx.entry );
+    *error = ctx.error;
+    return false;
+  }
+  {
+    QMutexLocker locker( &s_mutex );
+    Entry& entry = s_projects[ ctx.dir.path() ];
+    entry.files += ctx.entry.files;
+    entry.segments += ctx.entry.segments;
+    entry.descs.unite( ctx.entry.descs );
+  }
+
+  QList<OcaTrackGroup*> groups;
+  QList<QPair<OcaTrack*,bool> > tracks;
+  QList<QPair<OcaSmartTrack*,QJsonObject> > smart_tracks;
+  QList<QPair<QObject*,QJsonObject> > objects;
+  for( int i = 0; i < groups_desc.size(); i++ ) {
+    const QJsonObject desc = groups_desc[i].toObject();
+    const QJsonObject props = desc.value( "props" ).toObject();
+    OcaTrackGroup* group = new OcaTrackGroup( props.value( "name" ).toString(),
+                          props.value( "rate" ).toDouble( window->getDefaultSampleRate() ) );
+    ctx.objects.insert( desc.value( "id" ).toString(), group );
+    groups.append( group );
+    objects.append( qMakePair<QObject*,QJsonObject>( group, props ) );
+
+    const QJsonArray tracks_desc = desc.value( "tracks" ).toArray();
+    for( int j = 0; j < tracks_desc.size(); j++ ) {
+      const QJsonObject track_desc = tracks_desc[j].toObject();
+      const QJsonObject track_props = track_desc.value( "props" ).toObject();
+      OcaTrackBase* t = NULL;
+      if( track_desc.contains( "blocks" ) ) {
+        OcaTrack* track = loadTrack( track_desc, files, &ctx );
+        tracks.append( qMakePair( track, track_desc.value( "readonly" ).toBool() ) );
+        t = track;
+      }
+      else {
+        OcaSmartTrack* smart_track =
+                                new OcaSmartTrack( track_props.value( "name" ).toString() );
+        ctx.objects.insert( track_desc.value( "id" ).toString(), smart_track );
+        smart_tracks.append( qMakePair( smart_track, track_desc ) );
+        t = smart_track;
+      }
+      objects.append( qMakePair<QObject*,QJsonObject>( t, track_props ) );
+      group->addTrack( t );
+      if( track_desc.contains( "height" ) ) {
+        group->setTrackHeight( t, track_desc.value( "height" ).toInt() );
+      }
+    }
+  }
+
+  QList<OcaMonitor*> monitors;
+  const QJsonArray monitors_desc = root.value( "monitors" ).toArray();
+  for( int i = 0; i < monitors_desc.size(); i++ ) {
+    const QJsonObject desc = monitors_desc[i].toObject();
+    const QJsonObject props = desc.value( "props" ).toObject();
+    QObject* group = ctx.objects.value(
+                              props.value( "group" ).toObject().value( "object" ).toString() );
+    OcaMonitor* monitor = new OcaMonitor( props.value( "name" ).toString(),
+                                                  qobject_cast<OcaTrackGroup*>( group ) );
+    ctx.objects.insert( desc.value( "id" ).toString(), monitor );
+    monitors.append( monitor );
+    smart_tracks.append( qMakePair<OcaSmartTrack*,QJsonObject>( monitor, desc ) );
+    objects.append( qMakePair<QObject*,QJsonObject>( monitor, props ) );
+  }
+
+  // the subtracks and the object properties may refer to any group
+  for( int i = 0; i < smart_tracks.size(); i++ ) {
+    OcaSmartTrack* smart_track = smart_tracks[i].first;
+    const QJsonObject& desc = smart_tracks[i].second;
+    loadSubtracks( smart_track, desc.value( "subtracks" ).toArray(), ctx );
+    smart_track->setAutoScaleOn( desc.value( "auto_scale" ).toBool() );
+  }
+  for( int i = 0; i < objects.size(); i++ ) {
+    loadProperties( objects[i].first, objects[i].second, ctx );
+  }
+  for( int i = 0; i < tracks.size(); i++ ) {
+    tracks[i].first->setReadonly( tracks[i].second );
+  }
+  for( int i = 0; i < groups.size(); i++ ) {
+    window->addGroup( groups[i] );
+  }
+  for( int i = 0; i < monitors.size(); i++ ) {
+    window->addMonitor( monitors[i] );
+  }
+  loadProperties( window, root.value( "window" ).toObject(), ctx );
+
+  for( int i = 0; i < files.size(); i++ ) {
+    files[i]->release();
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaProject::releaseEntry( const Entry& entry )
+{
+  for( int i = 0; i < entry.files.size(); i++ ) {
+    entry.files[i]->release();
+  }
+  for( int i = 0; i < entry.segments.size(); i++ ) {
+    OcaPackFile::unkeepSegment( entry.segments[i] );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+QJsonObject OcaProject::saveProperties( const QObject* obj, const SaveContext& ctx,
+                                                              const QStringList& skip )
+{
+  // the writable properties, the objects are saved as references
+  QJsonObject result;
+  const QMetaObject* meta_object = obj->metaObject();
+  for( int i = OcaObject::staticMetaObject.propertyOffset();
+                                              i < meta_object->propertyCount(); i++ ) {
+    const QMetaProperty p = meta_object->property( i );
+    if( ( ! p.isReadable() ) || ( ! p.isWritable() ) || skip.contains( p.name() ) ) {
+      continue;
+    }
+    const QVariant v = p.read( obj );
+    QJsonValue value;
+    if( QMetaType::typeFlags( p.userType() ) & QMetaType::PointerToQObject ) {
+      const QObject* o = v.value<QObject*>();
+      if( ctx.keys.contains( o ) ) {
+        QJsonObject ref;
+        ref.insert( "object", ctx.keys.value( o ) );
+        value = ref;
+      }
+    }
+    else if( QMetaType::QColor == p.userType() ) {
+      value = v.value<QColor>().name( QColor::HexArgb );
+    }
+    else if( ( QMetaType::Double == p.userType() ) && ! std::isfinite( v.toDouble() ) ) {
+      continue;
+    }
+    else {
+      value = QJsonValue::fromVariant( v );
+    }
+    result.insert( p.name(), value );
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaProject::loadProperties( QObject* obj, const QJsonObject& props,
+                                                              const LoadContext& ctx )
+{
+  const QMetaObject* meta_object = obj->metaObject();
+  for( QJsonObject::const_iterator it = props.begin(); props.end() != it; ++it ) {
+    const int idx = meta_object->indexOfProperty( it.key().toLatin1().constData() );
+    if( OcaObject::staticMetaObject.propertyOffset() > idx ) {
+      continue;
+    }
+    const QMetaProperty p = meta_object->property( idx );
+    if( ! p.isWritable() ) {
+      continue;
+    }
+    const int type = p.userType();
+    QVariant v;
+    if( QMetaType::typeFlags( type ) & QMetaType::PointerToQObject ) {
+      QObject* o = ctx.objects.value( it.value().toObject().value( "object" ).toString() );
+      if( qMetaTypeId<OcaTrackGroup*>() == type ) {
+        v.setValue( qobject_cast<OcaTrackGroup*>( o ) );
+      }
+      else if( qMetaTypeId<OcaTrack*>() == type ) {
+        v.setValue( qobject_cast<OcaTrack*>( o ) );
+      }
+      else if( qMetaTypeId<OcaTrackBase*>() == type ) {
+        v.setValue( qobject_cast<OcaTrackBase*>( o ) );
+      }
+      else {
+        continue;
+      }
+    }
+    else {
+      v = it.value().toVariant();
+      if( ! v.convert( type ) ) {
+        continue;
+      }
+    }
+    p.write( obj, v );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+QJsonArray OcaProject::saveSubtracks( const OcaSmartTrack* track, const SaveContext& ctx )
+{
+  QJsonArray result;
+  for( uint i = 0; i < track->getSubtrackCount(); i++ ) {
+    OcaTrack* t = track->getSubtrack( i );
+    if( ! ctx.keys.contains( t ) ) {
+      continue;
+    }
+    QJsonObject desc;
+    desc.insert( "track", ctx.keys.value( t ) );
+    desc.insert( "color", track->getSubtrackColor( t ).name( QColor::HexArgb ) );
+    if( std::isfinite( track->getSubtrackScale( t ) ) ) {
+      desc.insert( "scale", track->getSubtrackScale( t ) );
+    }
+    if( std::isfinite( track->getSubtrackZero( t ) ) ) {
+      desc.insert( "zero", track->getSubtrackZero( t ) );
+    }
+    desc.insert( "auto_scale", track->isSubtrackAutoScaleOn( t ) );
+    result.append( desc );
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaProject::loadSubtracks( OcaSmartTrack* track, const QJsonArray& subtracks,
+                                                              const LoadContext& ctx )
+{
+  for( int i = 0; i < subtracks.size(); i++ ) {
+    const QJsonObject desc = subtracks[i].toObject();
+    OcaTrack* t = qobject_cast<OcaTrack*>(
+                                  ctx.objects.value( desc.value( "track" ).toString() ) );
+    if( ( NULL == t ) || ( -1 == track->addSubtrack( t ) ) ) {
+      continue;
+    }
+    track->setSubtrackColor( t, QColor( desc.value( "color" ).toString() ) );
+    if( desc.contains( "scale" ) ) {
+      track->setSubtrackScale( t, desc.value( "scale" ).toDouble() );
+    }
+    if( desc.contains( "zero" ) ) {
+      track->setSubtrackZero( t, desc.value( "zero" ).toDouble() );
+    }
+    track->setSubtrackAutoScaleOn( t, desc.value( "auto_scale" ).toBool() );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+QJsonObject OcaProject::saveTrack( OcaTrack* track, SaveContext* ctx )
+{
+  // the storage settings are restored before the data
+  QStringList skip;
+  skip << "start" << "rate" << "channels" << "storage_format"
+       << "pyramid_factors" << "pyramid_format" << "readonly";
+  QJsonObject desc;
+  desc.insert( "id", ctx->keys.value( track ) );
+  desc.insert( "props", saveProperties( track, *ctx, skip ) );
+  desc.insert( "rate", track->getSampleRate() );
+  desc.insert( "channels", track->getChannels() );
+  desc.insert( "storage_format", track->getStorageFormat() );
+  desc.insert( "pyramid_factors", track->getPyramidFactors() );
+  desc.insert( "pyramid_format", track->getPyramidFormat() );
+  desc.insert( "readonly", track->isReadonly() );
+
+  QJsonArray blocks;
+  OcaLock lock( track );
+  desc.insert( "origin", track->m_origin );
+  for( int b = 0; b < track->m_blocks.size(); b++ ) {
+    // the extents are triplets of the file index, the start and the length
+    const OcaTrackDataBlock* block = track->m_blocks[b].data;
+    QJsonArray extents;
+    for( int i = 0; i < block->m_extents.size(); i++ ) {
+      const OcaTrackDataBlock::Extent& e = block->m_extents[i];
+      int idx = ctx->fileIndex.value( e.file, -1 );
+      if( -1 == idx ) {
+        // a referenced file is shared, so it is never written again
+        e.file->ref();
+        idx = ctx->entry.files.size();
+        ctx->entry.files.append( e.file );
+        ctx->fileIndex.insert( e.file, idx );
+      }
+      extents.append( idx );
+      extents.append( (double)e.start );
+      extents.append( (double)e.length );
+    }
+    QJsonObject block_desc;
+    block_desc.insert( "pos", (double)track->m_blocks[b].pos );
+    block_desc.insert( "extents", extents );
+    blocks.append( block_desc );
+  }
+  desc.insert( "blocks", blocks );
+  return desc;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaProject::checkTrack( const QJsonObject& desc, const QList<OcaSampleFile*>& files )
+{
+  const int channels = desc.value( "channels" ).toInt();
+  if( ( 0 >= channels ) || ! ( 0 < desc.value( "rate" ).toDouble() ) ) {
+    return false;
+  }
+  const QJsonArray blocks = desc.value( "blocks" ).toArray();
+  if( ( ! blocks.isEmpty() ) && ! std::isfinite( desc.value( "origin" ).toDouble( NAN ) ) ) {
+    return false;
+  }
+  // the blocks are sorted and do not overlap
+  qint64 end = 0;
+  for( int i = 0; i < blocks.size(); i++ ) {
+    const QJsonObject block = blocks[i].toObject();
+    const QJsonArray extents = block.value( "extents" ).toArray();
+    const double pos = block.value( "pos" ).toDouble( NAN );
+    if( ( ( 0 < i ) && ( end > pos ) ) || ( floor( pos ) != pos ) || extents.isEmpty()
+                                                  || ( 0 != extents.size() % 3 ) ) {
+      return false;
+    }
+    end = (qint64)pos;
+    for( int k = 0; k < extents.size(); k += 3 ) {
+      const int idx = extents[k].toInt( -1 );
+      const qint64 start = (qint64)extents[k+1].toDouble( -1 );
+      const qint64 length = (qint64)extents[k+2].toDouble( -1 );
+      if( ( 0 > idx ) || ( files.size() <= idx ) || ( 0 > start ) || ( 0 >= length )
+                  || ( files[idx]->getLength() < start + length )
+                  || ( files[idx]->getChannels() != channels ) ) {
+        return false;
+      }
+      end += length;
+    }
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaTrack* OcaProject::loadTrack( const QJsonObject& desc, const QList<OcaSampleFile*>& files,
+                                                                    LoadContext* ctx )
+{
+  // the blocks are put in place as they were saved
+  OcaTrack* track = new OcaTrack( desc.value( "props" ).toObject().value( "name" ).toString(),
+                                                          desc.value( "rate" ).toDouble() );
+  ctx->objects.insert( desc.value( "id" ).toString(), track );
+  track->setChannels( desc.value( "channels" ).toInt() );
+  track->setStorageFormat( desc.value( "storage_format" ).toString() );
+  track->setPyramidFactors( desc.value( "pyramid_factors" ).toString() );
+  track->setPyramidFormat( desc.value( "pyramid_format" ).toString() );
+
+  QVector<OcaTrack::Block> blocks;
+  const QJsonArray blocks_desc = desc.value( "blocks" ).toArray();
+  for( int i = 0; i < blocks_desc.size(); i++ ) {
+    const QJsonObject block_desc = blocks_desc[i].toObject();
+    const QJsonArray extents = block_desc.value( "extents" ).toArray();
+    OcaTrackDataBlock* block = track->createBlock( track->getChannels() );
+    for( int k = 0; k < extents.size(); k += 3 ) {
+      OcaTrackDataBlock::Extent e;
+      e.file = files[ extents[k].toInt() ];
+      e.start = (qint64)extents[k+1].toDouble();
+      e.length = (qint64)extents[k+2].toDouble();
+      e.pos = 0;
+      block->appendExtent( e );
+    }
+    OcaTrack::Block b = { (qint64)block_desc.value( "pos" ).toDouble(), block };
+    blocks.append( b );
+  }
+
+  uint flags = 0;
+  {
+    OcaTrack::WLock lock( track );
+    track->m_origin = desc.value( "origin" ).toDouble();
+    track->m_blocks = blocks;
+    flags = ( OcaTrack::e_FlagTrackDataChanged | track->updateDuration() );
+  }
+  track->emitChanged( flags );
+  return track;
+}
+
+// ------------------------------------------------------------------------------------
+
+QJsonObject OcaProject::saveSampleFile( OcaSampleFile* file, SaveContext* ctx )
+{
+  QJsonObject desc;
+  desc.insert( "channels", file->getChannels() );
+  desc.insert( "format", OcaSampleFormat::getName( file->getFormat() ) );
+  if( file->isPattern() ) {
+    const OcaDataVector& pattern = file->m_pattern;
+    const QByteArray data( (const char*)pattern.constData(),
+                              pattern.length() * pattern.channels() * sizeof(double) );
+    desc.insert( "pattern", QString::fromLatin1( data.toBase64() ) );
+    return desc;
+  }
+
+  // the queued writes are stored and the levels are completed,
+  // so the project opens without building them
+  QReadLocker locker( &file->m_lock );
+  while( ( ! file->m_dirty.isEmpty() ) || ( ! file->m_pending.isEmpty() ) ) {
+    locker.unlock();
+    if( ! file->flush() ) {
+      ctx->error = "can't store the written data";
+      return QJsonObject();
+    }
+    file->buildAllLevels();
+    locker.relock();
+  }
+  desc.insert( "length", (double)file->m_length );
+  QJsonArray factors;
+  for( int i = 0; i < file->m_factors.size(); i++ ) {
+    factors.append( file->m_factors[i] );
+  }
+  desc.insert( "pyramid_factors", factors );
+  desc.insert( "pyramid_format", OcaSampleFormat::getName( file->m_pyramidFormat ) );
+  QJsonArray files;
+  for( int i = 0; i < file->m_files.size(); i++ ) {
+    if( NULL == file->m_files[i] ) {
+      files.append( QJsonValue() );
+    }
+    else {
+      files.append( saveDataFile( file->m_files[i], ctx ) );
+    }
+  }
+  desc.insert( "files", files );
+  if( NULL != file->m_packed ) {
+    const QVector<qint64>& index = file->m_frameIndex;
+    desc.insert( "packed", saveDataFile( file->m_packed, ctx ) );
+    desc.insert( "frames", writeFile( (const char*)index.constData(),
+                                          index.size() * sizeof(qint64), ".idx", ctx ) );
+  }
+  return desc;
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleFile* OcaProject::loadSampleFile( const QJsonObject& desc, LoadContext* ctx )
+{
+  // the files still used in this session are taken as they are
+  const QByteArray key = QJsonDocument( desc ).toJson( QJsonDocument::Compact );
+  OcaSampleFile* file = ctx->current.descs.value( key );
+  if( NULL != file ) {
+    file->ref();
+    return file;
+  }
+
+  const int channels = desc.value( "channels" ).toInt();
+  const int format = OcaSampleFormat::fromName( desc.value( "format" ).toString() );
+  if( ( 0 >= channels ) || ( 0 > format ) ) {
+    return NULL;
+  }
+  if( desc.contains( "pattern" ) ) {
+    const QByteArray data =
+                QByteArray::fromBase64( desc.value( "pattern" ).toString().toLatin1() );
+    const long len = data.size() / ( channels * sizeof(double) );
+    if( ( 0 >= len ) || ( (long)( len * channels * sizeof(double) ) != data.size() ) ) {
+      return NULL;
+    }
+    OcaDataVector pattern( channels, len );
+    memcpy( pattern.data(), data.constData(), data.size() );
+    file = new OcaSampleFile( &pattern, format );
+  }
+  else {
+    QVector<int> factors;
+    const QJsonArray factors_desc = desc.value( "pyramid_factors" ).toArray();
+    for( int i = 0; i < factors_desc.size(); i++ ) {
+      factors.append( factors_desc[i].toInt() );
+      if( 2 > factors.last() ) {
+        return NULL;
+      }
+    }
+    const int pyramid_format =
+                      OcaSampleFormat::fromName( desc.value( "pyramid_format" ).toString() );
+    const qint64 length = (qint64)desc.value( "length" ).toDouble( -1 );
+    if( factors.isEmpty() || ( 0 > pyramid_format ) || ( 0 > length ) ) {
+      return NULL;
+    }
+
+    QList<OcaDataFile*> files;
+    OcaDataFile* packed = NULL;
+    QVector<qint64> frame_index;
+    bool ok = true;
+    const QJsonArray files_desc = desc.value( "files" ).toArray();
+    for( int i = 0; ok && ( i < files_desc.size() ); i++ ) {
+      OcaDataFile* f = NULL;
+      if( ! ( ( 0 == i ) && files_desc[i].isNull() ) ) {
+        f = loadDataFile( files_desc[i].toObject(), ( 0 == i ) ? OcaBlockCache::e_PoolSamples
+                                                  : OcaBlockCache::e_PoolPyramid, ctx );
+        ok = ( NULL != f );
+      }
+      files.append( f );
+    }
+    if( ok && desc.contains( "packed" ) ) {
+      packed = loadDataFile( desc.value( "packed" ).toObject(),
+                                                  OcaBlockCache::e_PoolSamples, ctx );
+      QFile index( ctx->dir.filePath( desc.value( "frames" ).toString() ) );
+      ok = ( NULL != packed ) && index.open( QIODevice::ReadOnly );
+      if( ok ) {
+        const QByteArray data = index.readAll();
+        frame_index.resize( data.size() / sizeof(qint64) );
+        memcpy( frame_index.data(), data.constData(), frame_index.size() * sizeof(qint64) );
+      }
+    }
+    if( ! ( ok && ( ! files.isEmpty() ) && ( ( NULL == packed ) == ( NULL != files[0] ) ) ) ) {
+      qDeleteAll( files );
+      delete packed;
+      return NULL;
+    }
+    file = new OcaSampleFile( channels, format, factors, pyramid_format,
+                                                  length, files, packed, frame_index );
+    if( ! checkSampleFile( file ) ) {
+      file->release();
+      return NULL;
+    }
+  }
+
+  file->ref();
+  ctx->entry.files.append( file );
+  ctx->entry.descs.insert( key, file );
+  return file;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaProject::checkSampleFile( const OcaSampleFile* file )
+{
+  // the files must cover the samples and the levels prepareLevels() would make
+  const qint64 length = file->m_length;
+  if( NULL != file->m_packed ) {
+    const QVector<qint64>& index = file->m_frameIndex;
+    const long L = OcaSampleFile::s_FRAME_LENGTH;
+    if( ( ( length + L - 1 ) / L + 1 != index.size() ) || ( 0 != index.first() )
+                                      || ( file->m_packed->getSize() < index.last() ) ) {
+      return false;
+    }
+    for( int i = 1; i < index.size(); i++ ) {
+      if( index[i] < index[i-1] ) {
+        return false;
+      }
+    }
+  }
+  else if( file->m_files[0]->getSize() < length * file->m_frameSize ) {
+    return false;
+  }
+  qint64 n = length;
+  int level = 0;
+  while( 0 < ( n /= file->getLevelFactor( level + 1 ) ) ) {
+    level++;
+    if( ( file->m_files.size() <= level )
+                    || ( file->m_files[level]->getSize() < n * file->m_entrySize ) ) {
+      return false;
+    }
+  }
+  return ( level + 1 == file->m_files.size() );
+}
+
+// ------------------------------------------------------------------------------------
+
+QJsonObject OcaProject::saveDataFile( OcaDataFile* file, SaveContext* ctx )
+{
+  // the data of the shared files does not change, only the pack segments
+  // and the contents kept in memory are taken as they are now
+  QJsonObject desc;
+  const qint64 size = file->getSize();
+  desc.insert( "size", (double)size );
+  if( ! file->m_segments.isEmpty() ) {
+    // runs of the segments of a pack: the name, the first index and the count
+    QJsonArray runs;
+    QString name;
+    int start = 0;
+    int count = 0;
+    const int n = ( size + OcaPackFile::s_SEGMENT_SIZE - 1 ) / OcaPackFile::s_SEGMENT_SIZE;
+    for( int k = 0; k < n; k++ ) {
+      const OcaPackFile::Segment& segment = file->m_segments[k];
+      const QString pack = linkPack( segment, ctx );
+      if( pack.isEmpty() ) {
+        return desc;
+      }
+      OcaPackFile::keepSegment( segment );
+      ctx->entry.segments.append( segment );
+      if( ( pack == name ) && ( start + count == segment.index ) ) {
+        count++;
+        continue;
+      }
+      if( 0 < count ) {
+        runs << name << start << count;
+      }
+      name = pack;
+      start = segment.index;
+      count = 1;
+    }
+    if( 0 < count ) {
+      runs << name << start << count;
+    }
+    desc.insert( "segments", runs );
+  }
+  else if( file->m_external || file->m_packFailed ) {
+    if( file->m_packFailed ) {
+      QMutexLocker locker( &file->m_mutex );
+      file->m_file.flush();
+    }
+    desc.insert( "file", linkFile( file->m_file.fileName(), file->m_packFailed, ctx ) );
+    desc.insert( "offset", (double)file->m_offset );
+  }
+  else if( 0 < size ) {
+    QByteArray data( size, 0 );
+    if( size == file->read( data.data(), 0, size ) ) {
+      desc.insert( "file", writeFile( data.constData(), size, ".bin", ctx ) );
+    }
+    else {
+      ctx->error = "can't read the data in memory";
+    }
+  }
+  return desc;
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaDataFile* OcaProject::loadDataFile( const QJsonObject& desc, int cache_pool,
+                                                                    LoadContext* ctx )
+{
+  const qint64 size = (qint64)desc.value( "size" ).toDouble( -1 );
+  if( 0 > size ) {
+    return NULL;
+  }
+  if( desc.contains( "file" ) ) {
+    const QString path = ctx->dir.absoluteFilePath( desc.value( "file" ).toString() );
+    const qint64 offset = (qint64)desc.value( "offset" ).toDouble();
+    if( ( 0 > offset ) || ( QFileInfo( path ).size() < offset + size ) ) {
+      return NULL;
+    }
+    OcaDataFile* file = new OcaDataFile( path, offset, size, cache_pool );
+    if( size != file->getSize() ) {
+      delete file;
+      return NULL;
+    }
+    return file;
+  }
+
+  QVector<OcaPackFile::Segment> segments;
+  const QJsonArray runs = desc.value( "segments" ).toArray();
+  bool ok = ( 0 == runs.size() % 3 );
+  for( int i = 0; ok && ( i < runs.size() ); i += 3 ) {
+    const QString path = ctx->dir.filePath( runs[i].toString() );
+    const int start = runs[i+1].toInt();
+    const int count = runs[i+2].toInt();
+    for( int k = 0; ok && ( k < count ); k++ ) {
+      OcaPackFile::Segment segment;
+      ok = OcaPackFile::openSegment( &segment, path, start + k );
+      if( ok ) {
+        segments.append( segment );
+      }
+    }
+  }
+  if( ok && ( size <= segments.size() * OcaPackFile::s_SEGMENT_SIZE ) ) {
+    // the segments are kept as long as the project refers to them
+    for( int k = 0; k < segments.size(); k++ ) {
+      OcaPackFile::keepSegment( segments[k] );
+      ctx->entry.segments.append( segments[k] );
+    }
+    return new OcaDataFile( segments, size, cache_pool );
+  }
+  for( int k = 0; k < segments.size(); k++ ) {
+    OcaPackFile::freeSegment( segments[k] );
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------------------
+
+QString OcaProject::writeFile( const char* data, qint64 size, const QString& suffix,
+                                                                    SaveContext* ctx )
+{
+  const QString name = createName( "d", suffix, ctx );
+  QFile file( ctx->dir.filePath( name ) );
+  ctx->created.append( name );
+  if( ! ( file.open( QIODevice::WriteOnly ) && ( size == file.write( data, size ) ) ) ) {
+    ctx->error = QString( "can't write %1" ) . arg( file.fileName() );
+  }
+  return name;
+}
+
+// ------------------------------------------------------------------------------------
+
+QString OcaProject::linkFile( const QString& path, bool copy, SaveContext* ctx )
+{
+  // A file of the directory is referred by its name, other files are hard linked.
+  // An external file that can't be linked is referred by its absolute path,
+  // a file of the cache is copied.
+  const QFileInfo info( path );
+  if( info.canonicalPath() == ctx->dir.path() ) {
+    ctx->names.insert( info.fileName() );
+    return info.fileName();
+  }
+  const QString name = createName( "d", ".bin", ctx );
+  const QString dst = ctx->dir.filePath( name );
+  bool ok = false;
+#ifdef Q_OS_UNIX
+  ok = ( 0 == link( QFile::encodeName( path ).constData(),
+                                                  QFile::encodeName( dst ).constData() ) );
+#endif
+  if( ( ! ok ) && copy ) {
+    ok = QFile::copy( path, dst );
+  }
+  if( ok ) {
+    ctx->created.append( name );
+    return name;
+  }
+  ctx->names.remove( name );
+  if( copy ) {
+    ctx->error = QString( "can't copy %1" ) . arg( path );
+  }
+  return info.absoluteFilePath();
+}
+
+// ------------------------------------------------------------------------------------
+
+QString OcaProject::linkPack( const OcaPackFile::Segment& segment, SaveContext* ctx )
+{
+  QHash<OcaPackFile*,QString>::const_iterator it = ctx->packs.constFind( segment.pack );
+  if( ctx->packs.constEnd() != it ) {
+    return it.value();
+  }
+  // the pack may be in the directory already (loaded or linked before)
+  QString name;
+  const QStringList paths = OcaPackFile::getFileNames( segment );
+  for( int i = 0; ( i < paths.size() ) && name.isEmpty(); i++ ) {
+    const QFileInfo info( paths[i] );
+    if( info.exists() && ( info.canonicalPath() == ctx->dir.path() ) ) {
+      name = info.fileName();
+    }
+  }
+  if( name.isEmpty() ) {
+    name = createName( "p", ".pack", ctx );
+    if( ! OcaPackFile::linkFile( segment, ctx->dir.filePath( name ) ) ) {
+      ctx->error = QString( "can't link %1" ) . arg( ctx->dir.filePath( name ) );
+      return QString();
+    }
+    ctx->created.append( name );
+  }
+  ctx->names.insert( name );
+  ctx->packs.insert( segment.pack, name );
+  return name;
+}
+
+// ------------------------------------------------------------------------------------
+
+QString OcaProject::createName( const QString& prefix, const QString& suffix,
+                                                                    SaveContext* ctx )
+{
+  for( ; ; ) {
+    const QString name = QString( "%1%2%3" ) . arg( prefix )
+                          . arg( ctx->counter++, 6, 10, QLatin1Char('0') ) . arg( suffix );
+    if( ! ( ctx->names.contains( name ) || ctx->dir.exists( name ) ) ) {
+      ctx->names.insert( name );
+      ctx->owned.insert( name );
+      return name;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+QSet<QString> OcaProject::readDataFiles( const QDir& dir )
+{
+  // the data files listed by the project file of the directory, if any
+  QSet<QString> names;
+  QFile file( dir.filePath( s_PROJECT_FILE ) );
+  if( file.open( QIODevice::ReadOnly ) ) {
+    const QJsonObject root = QJsonDocument::fromJson( file.readAll() ).object();
+    if( s_FORMAT == root.value( "format" ).toString() ) {
+      const QJsonArray list = root.value( "data_files" ).toArray();
+      for( int i = 0; i < list.size(); i++ ) {
+        const QString name = list[i].toString();
+        if( ( ! name.isEmpty() ) && ( QFileInfo( name ).fileName() == name ) ) {
+          names.insert( name );
+        }
+      }
+    }
+  }
+  return names;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaProject::syncFile( const QString& path )
+{
+  // also writes back the mapped pages of the pack files
+  QFile file( path );
+  if( ! file.open( QIODevice::ReadOnly ) ) {
+    return false;
+  }
+#ifdef Q_OS_UNIX
+  return ( 0 == fsync( file.handle() ) );
+#else
+  return true;
+#endif
+}
+
+// ------------------------------------------------------------------------------------
+
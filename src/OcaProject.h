@@ -0,0 +1,125 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaProject_h
+#define OcaProject_h
+
+#include "OcaPackFile.h"
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QDir>
+#include <QMutex>
+#include <QByteArray>
+
+class QObject;
+class QJsonObject;
+class QJsonArray;
+class OcaWindowData;
+class OcaTrack;
+class OcaSmartTrack;
+class OcaSampleFile;
+class OcaDataFile;
+
+// Project directory with the groups, tracks, smart tracks and monitors of the window
+// and their properties (project.json), and with the data of the tracks.
+// The data is not copied. The pack files of the cache are hard linked to the project
+// and the saved segments are kept (see OcaPackFile), the saved sample files stay
+// referenced, so the following writes go to new files. Only the data kept in memory
+// and the frame indices of the compressed files are written.
+// The project lists the data files it owns, saving again removes only the listed files
+// that are no longer used, the other files of the directory are left alone.
+// A loaded project uses its files in place as read-only sample files with complete
+// levels, so it is opened without reading the data.
+
+class OcaProject
+{
+  public:
+    static bool save( const QString& path, OcaWindowData* window, QString* error );
+    static bool load( const QString& path, OcaWindowData* window, QString* error );
+
+  protected:
+    // the files and segments used by the current project.json of a directory
+    struct Entry {
+      QList<OcaSampleFile*>               files;
+      QList<OcaPackFile::Segment>         segments;
+      QHash<QByteArray,OcaSampleFile*>    descs;
+    };
+
+    struct SaveContext {
+      QDir                                dir;
+      QHash<const QObject*,QString>       keys;
+      QHash<OcaSampleFile*,int>           fileIndex;
+      Entry                               entry;
+      QHash<OcaPackFile*,QString>         packs;
+      QSet<QString>                       names;
+      QSet<QString>                       owned;
+      QStringList                         created;
+      int                                 counter;
+      QString                             error;
+    };
+
+    struct LoadContext {
+      QDir                                dir;
+      QHash<QString,QObject*>             objects;
+      Entry                               entry;
+      Entry                               current;
+      QString                             error;
+    };
+
+  protected:
+    static void releaseEntry( const Entry& entry );
+    static QJsonObject saveProperties( const QObject* obj, const SaveContext& ctx,
+                                                          const QStringList& skip );
+    static void loadProperties( QObject* obj, const QJsonObject& props,
+                                                          const LoadContext& ctx );
+    static QJsonArray saveSubtracks( const OcaSmartTrack* track, const SaveContext& ctx );
+    static void loadSubtracks( OcaSmartTrack* track, const QJsonArray& subtracks,
+                                                          const LoadContext& ctx );
+    static QJsonObject saveTrack( OcaTrack* track, SaveContext* ctx );
+    static bool checkTrack( const QJsonObject& desc, const QList<OcaSampleFile*>& files );
+    static OcaTrack* loadTrack( const QJsonObject& desc, const QList<OcaSampleFile*>& files,
+                                                          LoadContext* ctx );
+    static QJsonObject saveSampleFile( OcaSampleFile* file, SaveContext* ctx );
+    static OcaSampleFile* loadSampleFile( const QJsonObject& desc, LoadContext* ctx );
+    static bool checkSampleFile( const OcaSampleFile* file );
+    static QJsonObject saveDataFile( OcaDataFile* file, SaveContext* ctx );
+    static OcaDataFile* loadDataFile( const QJsonObject& desc, int cache_pool,
+                                                          LoadContext* ctx );
+    static QString writeFile( const char* data, qint64 size, const QString& suffix,
+                                                          SaveContext* ctx );
+    static QString linkFile( const QString& path, bool copy, SaveContext* ctx );
+    static QString linkPack( const OcaPackFile::Segment& segment, SaveContext* ctx );
+    static QString createName( const QString& prefix, const QString& suffix,
+                                                          SaveContext* ctx );
+    static bool syncFile( const QString& path );
+    static QSet<QString> readDataFiles( const QDir& dir );
+
+  protected:
+    static const QString        s_PROJECT_FILE;
+    static const QString        s_FORMAT;
+    static const int            s_VERSION;
+    static QMutex               s_mutex;
+    static QHash<QString,Entry> s_projects;
+};
+
+#endif // OcaProject_h
@@ -0,0 +1,97 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaPyramidBuilder.h"
+#include "OcaSampleFile.h"
+#include "OcaTrack.h"
+
+#include <QtCore>
+
+// ------------------------------------------------------------------------------------
+
+OcaPyramidBuilder::OcaPyramidBuilder( QObject* parent )
+: QThread( parent ),
+  m_run( true )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPyramidBuilder::run()
+{
+  while( m_run ) {
+    OcaSampleFile::buildDirtyLevels( 100 );
+    notifyWaiters();
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPyramidBuilder::stop()
+{
+  m_run = false;
+  wait();
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPyramidBuilder::addWaiter( oca_ulong id )
+{
+  QMutexLocker locker( &m_mutex );
+  if( ! m_waiters.contains( id ) ) {
+    m_waiters.append( id );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaPyramidBuilder::notifyWaiters()
+{
+  // each track is notified once its own files are built,
+  // the tracks still being written don't hold back the others
+  QList<oca_ulong> waiters;
+  {
+    QMutexLocker locker( &m_mutex );
+    waiters.swap( m_waiters );
+  }
+  QList<oca_ulong> remaining;
+  for( int i = 0; i < waiters.size(); i++ ) {
+    OcaTrack* track = qobject_cast<OcaTrack*>( OcaObject::getObject( waiters[i] ) );
+    if( NULL == track ) {
+      continue;
+    }
+    if( track->hasDirtyLevels() ) {
+      remaining.append( waiters[i] );
+    }
+    else {
+      track->onLevelsBuilt();
+    }
+  }
+  if( ! remaining.isEmpty() ) {
+    QMutexLocker locker( &m_mutex );
+    foreach( oca_ulong id, remaining ) {
+      if( ! m_waiters.contains( id ) ) {
+        m_waiters.append( id );
+      }
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
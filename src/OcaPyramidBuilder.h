@@ -0,0 +1,49 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaPyramidBuilder_h
+#define OcaPyramidBuilder_h
+
+#include "octaudio.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QList>
+
+// Worker thread rebuilding the dirty levels of the sample files.
+// Each waiting track is notified once the levels of its own files are up to date.
+
+class OcaPyramidBuilder : public QThread
+{
+  public:
+    OcaPyramidBuilder( QObject* parent = NULL );
+    void run();
+    void stop();
+    void addWaiter( oca_ulong id );
+
+  protected:
+    void notifyWaiters();
+
+  protected:
+    volatile bool     m_run;
+    QMutex            m_mutex;
+    QList<oca_ulong>  m_waiters;
+};
+
+#endif // OcaPyramidBuilder_h
@@ -0,0 +1,422 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaSampleCodec.h"
+#include "OcaSampleFormat.h"
+#include "OcaDataVector.h"
+
+#include <QtCore>
+
+enum EMethod {
+  e_MethodRaw       = 0,
+  e_MethodRice      = 1,
+  e_MethodPlanes    = 2,
+};
+
+// unary part of a rice code longer than this is replaced by the plain value
+static const int RICE_ESCAPE = 32;
+
+// ------------------------------------------------------------------------------------
+
+class OcaBitWriter
+{
+  public:
+    OcaBitWriter( QByteArray* dst ) : m_dst( dst ), m_acc( 0 ), m_bits( 0 ) {}
+
+  public:
+    void write( quint32 v, int n ) {
+      Q_ASSERT( 32 >= n );
+      m_acc |= (quint64)( v & ( ( 1ull << n ) - 1 ) ) << m_bits;
+      m_bits += n;
+      while( 8 <= m_bits ) {
+        m_dst->append( (char)( m_acc & 0xff ) );
+        m_acc >>= 8;
+        m_bits -= 8;
+      }
+    }
+    void writeRice( quint32 u, int k ) {
+      quint32 q = u >> k;
+      if( RICE_ESCAPE > q ) {
+        write( ( 1u << q ) - 1, q + 1 );
+        write( u, k );
+      }
+      else {
+        write( 0xffffffff, RICE_ESCAPE );
+        write( u, 32 );
+      }
+    }
+    void flush() {
+      if( 0 < m_bits ) {
+        m_dst->append( (char)( m_acc & 0xff ) );
+      }
+      m_acc = 0;
+      m_bits = 0;
+    }
+
+  protected:
+    QByteArray* m_dst;
+    quint64     m_acc;
+    int         m_bits;
+};
+
+// ------------------------------------------------------------------------------------
+
+class OcaBitReader
+{
+  public:
+    OcaBitReader( const uchar* p, const uchar* end )
+      : m_p( p ), m_end( end ), m_acc( 0 ), m_bits( 0 ) {}
+
+  public:
+    bool read( int n, quint32* v ) {
+      while( m_bits < n ) {
+        if( m_p == m_end ) {
+          return false;
+        }
+        m_acc |= (quint64)*(m_p++) << m_bits;
+        m_bits += 8;
+      }
+      *v = m_acc & ( ( 1ull << n ) - 1 );
+      m_acc >>= n;
+      m_bits -= n;
+      return true;
+    }
+    bool readRice( int k, quint32* u ) {
+      quint32 q = 0;
+      for(;;) {
+        if( 0 == m_bits ) {
+          if( m_p == m_end ) {
+            return false;
+          }
+          m_acc = *(m_p++);
+          m_bits = 8;
+        }
+        bool one = ( m_acc & 1 );
+        m_acc >>= 1;
+        m_bits--;
+        if( ! one ) {
+          break;
+        }
+        if( RICE_ESCAPE == ++q ) {
+          return read( 32, u );
+        }
+      }
+      quint32 low = 0;
+      if( ! read( k, &low ) ) {
+        return false;
+      }
+      *u = ( q << k ) | low;
+      return true;
+    }
+
+  protected:
+    const uchar*  m_p;
+    const uchar*  m_end;
+    quint64       m_acc;
+    int           m_bits;
+};
+
+// ------------------------------------------------------------------------------------
+
+static inline qint32 get_sample( const uchar* p, int format )
+{
+  if( OcaSampleFormat::e_FormatInt16 == format ) {
+    return (qint16)( p[0] | ( p[1] << 8 ) );
+  }
+  return (qint32)( ( (quint32)p[0] << 8 ) | ( (quint32)p[1] << 16 )
+                                          | ( (quint32)p[2] << 24 ) ) >> 8;
+}
+
+// ------------------------------------------------------------------------------------
+
+static inline void put_sample( uchar* p, int format, qint32 v )
+{
+  p[0] = v & 0xff;
+  p[1] = ( v >> 8 ) & 0xff;
+  if( OcaSampleFormat::e_FormatInt24 == format ) {
+    p[2] = ( v >> 16 ) & 0xff;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static inline qint64 predict( const qint32* x, long i, int order )
+{
+  order = qMin( (long)order, i );
+  switch( order ) {
+    case 1:
+      return x[i-1];
+    case 2:
+      return 2 * (qint64)x[i-1] - x[i-2];
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------------------
+
+static void encode_rice( QByteArray* dst, int format, int channels, const uchar* src, long len )
+{
+  const int S = OcaSampleFormat::getSampleSize( format );
+  OcaBareArray<qint32> x( 1, len );
+  OcaBareArray<quint32> u( 1, len );
+  qint32* xv = x.data();
+  quint32* uv = u.data();
+
+  dst->append( (char)e_MethodRice );
+  OcaBitWriter w( dst );
+  for( int c = 0; c < channels; c++ ) {
+    quint64 cost[3] = { 0, 0, 0 };
+    for( long i = 0; i < len; i++ ) {
+      xv[i] = get_sample( src + ( i * channels + c ) * S, format );
+      if( 2 <= i ) {
+        cost[0] += qAbs( (qint64)xv[i] );
+        cost[1] += qAbs( xv[i] - predict( xv, i, 1 ) );
+        cost[2] += qAbs( xv[i] - predict( xv, i, 2 ) );
+      }
+    }
+    int order = 0;
+    for( int o = 1; o < 3; o++ ) {
+      if( cost[o] < cost[order] ) {
+        order = o;
+      }
+    }
+
+    quint64 sum = 0;
+    for( long i = 0; i < len; i++ ) {
+      qint64 r = xv[i] - predict( xv, i, order );
+      uv[i] = (quint32)( ( (quint64)r << 1 ) ^ (quint64)( r >> 63 ) );
+      sum += uv[i];
+    }
+    int k = 0;
+    while( ( 28 > k ) && ( ( (quint64)len << ( k + 1 ) ) <= sum ) ) {
+      k++;
+    }
+
+    w.write( order, 2 );
+    w.write( k, 5 );
+    for( long i = 0; i < len; i++ ) {
+      w.writeRice( uv[i], k );
+    }
+  }
+  w.flush();
+}
+
+// ------------------------------------------------------------------------------------
+
+static bool decode_rice( uchar* dst, int format, int channels, long len,
+                                                    const uchar* src, const uchar* end )
+{
+  const int S = OcaSampleFormat::getSampleSize( format );
+  OcaBareArray<qint32> x( 1, len );
+  qint32* xv = x.data();
+
+  OcaBitReader r( src, end );
+  for( int c = 0; c < channels; c++ ) {
+    quint32 order = 0;
+    quint32 k = 0;
+    if( ( ! r.read( 2, &order ) ) || ( ! r.read( 5, &k ) ) || ( 2 < order ) ) {
+      return false;
+    }
+    for( long i = 0; i < len; i++ ) {
+      quint32 u = 0;
+      if( ! r.readRice( k, &u ) ) {
+        return false;
+      }
+      qint64 res = (qint64)( u >> 1 ) ^ -(qint64)( u & 1 );
+      xv[i] = res + predict( xv, i, order );
+      put_sample( dst + ( i * channels + c ) * S, format, xv[i] );
+    }
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+static void encode_runs( QByteArray* dst, const uchar* p, long n )
+{
+  // 0x00-0x7f: 1-128 literal bytes follow, 0x80-0xff: the next byte repeated 3-130 times
+  long i = 0;
+  while( i < n ) {
+    long run = 1;
+    while( ( i + run < n ) && ( p[i+run] == p[i] ) && ( 130 > run ) ) {
+      run++;
+    }
+    if( 3 <= run ) {
+      dst->append( (char)( 0x80 + run - 3 ) );
+      dst->append( (char)p[i] );
+      i += run;
+    }
+    else {
+      long j = i;
+      while( ( j < n ) && ( 128 > j - i ) ) {
+        if( ( j + 2 < n ) && ( p[j] == p[j+1] ) && ( p[j] == p[j+2] ) ) {
+          break;
+        }
+        j++;
+      }
+      dst->append( (char)( j - i - 1 ) );
+      dst->append( (const char*)p + i, j - i );
+      i = j;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static bool decode_runs( uchar* dst, long n, const uchar* src, const uchar* end )
+{
+  uchar* dst_end = dst + n;
+  while( dst < dst_end ) {
+    if( src == end ) {
+      return false;
+    }
+    int c = *(src++);
+    if( 0x80 <= c ) {
+      long run = c - 0x80 + 3;
+      if( ( src == end ) || ( dst_end - dst < run ) ) {
+        return false;
+      }
+      memset( dst, *(src++), run );
+      dst += run;
+    }
+    else {
+      long len = c + 1;
+      if( ( end - src < len ) || ( dst_end - dst < len ) ) {
+        return false;
+      }
+      memcpy( dst, src, len );
+      src += len;
+      dst += len;
+    }
+  }
+  return ( src == end );
+}
+
+// ------------------------------------------------------------------------------------
+
+static void encode_planes( QByteArray* dst, int format, int channels,
+                                                    const uchar* src, long len )
+{
+  const int W = OcaSampleFormat::getSampleSize( format );
+  const long n = len * channels;
+  OcaBareArray<uchar> planes( W, n );
+  uchar* pv = planes.data();
+
+  for( int c = 0; c < channels; c++ ) {
+    quint64 prev = 0;
+    for( long i = 0; i < len; i++ ) {
+      quint64 v = 0;
+      memcpy( &v, src + ( i * channels + c ) * W, W );
+      quint64 d = v ^ prev;
+      prev = v;
+      for( int b = 0; b < W; b++ ) {
+        pv[ b * n + i * channels + c ] = ( d >> ( 8 * b ) ) & 0xff;
+      }
+    }
+  }
+
+  dst->append( (char)e_MethodPlanes );
+  encode_runs( dst, pv, n * W );
+}
+
+// ------------------------------------------------------------------------------------
+
+static bool decode_planes( uchar* dst, int format, int channels, long len,
+                                                    const uchar* src, const uchar* end )
+{
+  const int W = OcaSampleFormat::getSampleSize( format );
+  const long n = len * channels;
+  OcaBareArray<uchar> planes( W, n );
+  const uchar* pv = planes.data();
+  if( ! decode_runs( planes.data(), n * W, src, end ) ) {
+    return false;
+  }
+
+  for( int c = 0; c < channels; c++ ) {
+    quint64 prev = 0;
+    for( long i = 0; i < len; i++ ) {
+      quint64 d = 0;
+      for( int b = 0; b < W; b++ ) {
+        d |= (quint64)pv[ b * n + i * channels + c ] << ( 8 * b );
+      }
+      prev ^= d;
+      memcpy( dst + ( i * channels + c ) * W, &prev, W );
+    }
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleCodec::encode( QByteArray* dst, int format, int channels,
+                                                    const char* src, long len )
+{
+  const long raw_size = len * channels * OcaSampleFormat::getSampleSize( format );
+  const int start = dst->size();
+  const uchar* p = (const uchar*)src;
+
+  switch( format ) {
+    case OcaSampleFormat::e_FormatInt16:
+    case OcaSampleFormat::e_FormatInt24:
+      encode_rice( dst, format, channels, p, len );
+      break;
+    case OcaSampleFormat::e_FormatFloat32:
+    case OcaSampleFormat::e_FormatDouble:
+      encode_planes( dst, format, channels, p, len );
+      break;
+  }
+
+  if( dst->size() - start > raw_size ) {
+    dst->truncate( start );
+  }
+  if( dst->size() == start ) {
+    dst->append( (char)e_MethodRaw );
+    dst->append( src, raw_size );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleCodec::decode( char* dst, int format, int channels, long len,
+                                                    const char* src, long size )
+{
+  if( 1 > size ) {
+    return false;
+  }
+  const long raw_size = len * channels * OcaSampleFormat::getSampleSize( format );
+  const uchar* p = (const uchar*)src + 1;
+  const uchar* end = (const uchar*)src + size;
+
+  switch( src[0] ) {
+    case e_MethodRaw:
+      if( size - 1 != raw_size ) {
+        return false;
+      }
+      memcpy( dst, p, raw_size );
+      return true;
+    case e_MethodRice:
+      return decode_rice( (uchar*)dst, format, channels, len, p, end );
+    case e_MethodPlanes:
+      return decode_planes( (uchar*)dst, format, channels, len, p, end );
+  }
+  return false;
+}
+
+// ------------------------------------------------------------------------------------
+
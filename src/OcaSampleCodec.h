@@ -0,0 +1,39 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaSampleCodec_h
+#define OcaSampleCodec_h
+
+#include <QByteArray>
+
+// Lossless codec for frames of stored samples (see OcaSampleFormat).
+// Integer formats use a fixed polynomial predictor and Rice coding,
+// floating point formats use xor delta, byte planes and run length coding.
+// A frame falls back to the raw bytes if it does not compress.
+
+class OcaSampleCodec
+{
+  public:
+    static void encode( QByteArray* dst, int format, int channels,
+                                                    const char* src, long len );
+    static bool decode( char* dst, int format, int channels, long len,
+                                                    const char* src, long size );
+};
+
+#endif // OcaSampleCodec_h
@@ -0,0 +1,60 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaSampleCompressor.h"
+#include "OcaSampleFile.h"
+
+#include <QtCore>
+
+const int OcaSampleCompressor::s_SCAN_INTERVAL = 10000;
+const qint64 OcaSampleCompressor::s_IDLE_TIME = 120000;
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleCompressor::OcaSampleCompressor( QObject* parent )
+: QThread( parent ),
+  m_run( true )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleCompressor::run()
+{
+  int t = 0;
+  while( m_run ) {
+    if( s_SCAN_INTERVAL <= t ) {
+      OcaSampleFile::compressIdleFiles( s_IDLE_TIME, &m_run );
+      t = 0;
+    }
+    msleep( 100 );
+    t += 100;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleCompressor::stop()
+{
+  m_run = false;
+  wait();
+}
+
+// ------------------------------------------------------------------------------------
+
@@ -0,0 +1,42 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaSampleCompressor_h
+#define OcaSampleCompressor_h
+
+#include <QThread>
+
+// Worker thread compressing the sample files which were not accessed for a while.
+
+class OcaSampleCompressor : public QThread
+{
+  public:
+    OcaSampleCompressor( QObject* parent = NULL );
+    void run();
+    void stop();
+
+  protected:
+    volatile bool m_run;
+
+  protected:
+    static const int s_SCAN_INTERVAL;
+    static const qint64 s_IDLE_TIME;
+};
+
+#endif // OcaSampleCompressor_h
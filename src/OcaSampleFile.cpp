@@ -0,0 +1,1668 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaSampleFile.h"
+#include "OcaDataFile.h"
+#include "OcaSampleFormat.h"
+#include "OcaSampleCodec.h"
+#include "OcaAvgKernel.h"
+#include "OcaApp.h"
+
+#include <QtCore>
+
+const long OcaSampleFile::s_FRAME_LENGTH = 4096;
+const qint64 OcaSampleFile::s_PATTERN_LENGTH = Q_INT64_C(0x4000000000000000);
+const qint64 OcaSampleFile::s_BUILD_PIECE = 0x20000;
+const qint64 OcaSampleFile::s_PENDING_PIECE = 0x100000;
+const qint64 OcaSampleFile::s_PENDING_LIMIT = 0x4000000;
+QAtomicInt OcaSampleFile::s_counter( 0 );
+QMutex OcaSampleFile::s_registryMutex;
+QList<OcaSampleFile*> OcaSampleFile::s_registry;
+QList<OcaSampleFile*> OcaSampleFile::s_dirtyFiles;
+QWaitCondition OcaSampleFile::s_buildCondition;
+QList<OcaSampleFile*> OcaSampleFile::s_pendingFiles;
+QAtomicInteger<qint64> OcaSampleFile::s_pendingSize( 0 );
+QMutex OcaSampleFile::s_flushMutex;
+
+// ------------------------------------------------------------------------------------
+
+static int getEntrySize( int pyramid_format )
+{
+  Q_ASSERT( ( OcaSampleFormat::e_FormatDouble == pyramid_format )
+            || ( OcaSampleFormat::e_FormatFloat32 == pyramid_format ) );
+  return ( OcaSampleFormat::e_FormatFloat32 == pyramid_format ) ?
+                                        4 * sizeof(float) : sizeof(OcaAvgData);
+}
+
+// ------------------------------------------------------------------------------------
+
+static void narrow_entries( float* dst, const OcaAvgData* src, long count )
+{
+  // min and max are rounded outwards, so that the envelope still covers the data
+  for( long i = 0; i < count; i++ ) {
+    float min = src->min;
+    float max = src->max;
+    if( min > src->min ) {
+      min = nextafterf( min, -INFINITY );
+    }
+    if( max < src->max ) {
+      max = nextafterf( max, INFINITY );
+    }
+    dst[0] = min;
+    dst[1] = max;
+    dst[2] = src->avg;
+    dst[3] = src->var;
+    dst += 4;
+    src++;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static void widen_entries( OcaAvgData* dst, const float* src, long count )
+{
+  for( long i = 0; i < count; i++ ) {
+    dst->min = src[0];
+    dst->max = src[1];
+    dst->avg = src[2];
+    dst->var = src[3];
+    dst++;
+    src += 4;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleFile::OcaSampleFile( int channels, int format,
+                                      const QVector<int>& factors, int pyramid_format )
+:
+  m_refCount( 1 ),
+  m_pinCount( 0 ),
+  m_channels( channels ),
+  m_format( format ),
+  m_frameSize( channels * OcaSampleFormat::getSampleSize( format ) ),
+  m_factors( factors ),
+  m_pyramidFormat( pyramid_format ),
+  m_entrySize( channels * getEntrySize( pyramid_format ) ),
+  m_length( 0 ),
+  m_readonly( false ),
+  m_packed( NULL ),
+  m_serial( 0 ),
+  m_storeFailed( false ),
+  m_checkedSerial( (quint32)-1 ),
+  m_accessTime( 0 ),
+  m_tailsValid( false ),
+  m_deferredLevels( false )
+{
+  Q_ASSERT( 0 < m_channels );
+  Q_ASSERT( ! m_factors.isEmpty() );
+  m_dataDir = OcaApp::getDataCacheDir();
+  m_files.append( createFile( OcaBlockCache::e_PoolSamples ) );
+  touch();
+  QMutexLocker locker( &s_registryMutex );
+  s_registry.append( this );
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleFile::OcaSampleFile( const QString& path, qint64 offset, qint64 length,
+        int channels, int format, const QVector<int>& factors, int pyramid_format )
+:
+  m_refCount( 1 ),
+  m_pinCount( 0 ),
+  m_channels( channels ),
+  m_format( format ),
+  m_frameSize( channels * OcaSampleFormat::getSampleSize( format ) ),
+  m_factors( factors ),
+  m_pyramidFormat( pyramid_format ),
+  m_entrySize( channels * getEntrySize( pyramid_format ) ),
+  m_length( 0 ),
+  m_readonly( true ),
+  m_packed( NULL ),
+  m_serial( 0 ),
+  m_storeFailed( false ),
+  m_checkedSerial( (quint32)-1 ),
+  m_accessTime( 0 ),
+  m_tailsValid( false ),
+  m_deferredLevels( false )
+{
+  Q_ASSERT( 0 < m_channels );
+  Q_ASSERT( ! m_factors.isEmpty() );
+  m_dataDir = OcaApp::getDataCacheDir();
+  OcaDataFile* file = new OcaDataFile( path, offset, length * m_frameSize,
+                                                      OcaBlockCache::e_PoolSamples );
+  m_files.append( file );
+  m_length = file->getSize() / m_frameSize;
+  touch();
+  if( 0 < m_length ) {
+    markDirty( 0, m_length );
+  }
+  QMutexLocker locker( &s_registryMutex );
+  s_registry.append( this );
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleFile::OcaSampleFile( int channels, int format, const QVector<int>& factors,
+                  int pyramid_format, qint64 length, const QList<OcaDataFile*>& files,
+                  OcaDataFile* packed, const QVector<qint64>& frame_index )
+:
+  m_refCount( 1 ),
+  m_pinCount( 0 ),
+  m_channels( channels ),
+  m_format( format ),
+  m_frameSize( channels * OcaSampleFormat::getSampleSize( format ) ),
+  m_factors( factors ),
+  m_pyramidFormat( pyramid_format ),
+  m_entrySize( channels * getEntrySize( pyramid_format ) ),
+  m_length( length ),
+  m_readonly( true ),
+  m_files( files ),
+  m_packed( packed ),
+  m_frameIndex( frame_index ),
+  m_serial( 0 ),
+  m_storeFailed( false ),
+  m_checkedSerial( (quint32)-1 ),
+  m_accessTime( 0 ),
+  m_tailsValid( false ),
+  m_deferredLevels( false )
+{
+  // takes the files, the levels are complete
+  Q_ASSERT( 0 < m_channels );
+  Q_ASSERT( ! m_factors.isEmpty() );
+  Q_ASSERT( ( NULL == m_packed ) == ( NULL != m_files.value( 0 ) ) );
+  m_dataDir = OcaApp::getDataCacheDir();
+  touch();
+  QMutexLocker locker( &s_registryMutex );
+  s_registry.append( this );
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleFile::OcaSampleFile( const OcaDataVector* pattern, int format )
+:
+  m_refCount( 1 ),
+  m_pinCount( 0 ),
+  m_channels( pattern->channels() ),
+  m_format( format ),
+  m_frameSize( m_channels * OcaSampleFormat::getSampleSize( format ) ),
+  m_factors( getDefaultPyramidFactors() ),
+  m_pyramidFormat( OcaSampleFormat::e_FormatDouble ),
+  m_entrySize( m_channels * getEntrySize( OcaSampleFormat::e_FormatDouble ) ),
+  m_length( s_PATTERN_LENGTH ),
+  m_readonly( true ),
+  m_packed( NULL ),
+  m_serial( 0 ),
+  m_storeFailed( false ),
+  m_checkedSerial( (quint32)-1 ),
+  m_accessTime( 0 ),
+  m_tailsValid( false ),
+  m_deferredLevels( false )
+{
+  // the prefix sums give the statistics of any part of the pattern,
+  // the pattern files are not registered as they have nothing to compress or build
+  Q_ASSERT( ! pattern->isEmpty() );
+  const long P = pattern->length();
+  const int C = m_channels;
+  m_pattern.alloc( C, P );
+  if( OcaSampleFormat::e_FormatDouble == format ) {
+    memcpy( m_pattern.data(), pattern->constData(), P * C * sizeof(double) );
+  }
+  else {
+    OcaBareArray<char> buffer( m_frameSize, P );
+    OcaSampleFormat::encode( format, buffer.data(), pattern->constData(), P * C );
+    OcaSampleFormat::decode( format, m_pattern.data(), buffer.constData(), P * C );
+  }
+
+  m_patternSums.resize( ( P + 1 ) * C * 2 );
+  m_patternStats.resize( C );
+  double* sums = m_patternSums.data();
+  for( int c = 0; c < C; c++ ) {
+    m_patternStats[c].clear();
+    sums[ 2 * c ] = 0;
+    sums[ 2 * c + 1 ] = 0;
+  }
+  const double* v = m_pattern.constData();
+  for( long i = 0; i < P; i++ ) {
+    for( int c = 0; c < C; c++ ) {
+      const double x = *(v++);
+      m_patternStats[c].add( x );
+      sums[ 2 * ( ( i + 1 ) * C + c ) ] = sums[ 2 * ( i * C + c ) ] + x;
+      sums[ 2 * ( ( i + 1 ) * C + c ) + 1 ] = sums[ 2 * ( i * C + c ) + 1 ] + x * x;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleFile* OcaSampleFile::clonePattern( int format ) const
+{
+  Q_ASSERT( isPattern() );
+  return new OcaSampleFile( &m_pattern, format );
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleFile::~OcaSampleFile()
+{
+  {
+    QMutexLocker locker( &s_registryMutex );
+    s_registry.removeOne( this );
+    s_dirtyFiles.removeOne( this );
+    s_pendingFiles.removeOne( this );
+  }
+  dropPending( 0, m_length );
+  delete m_packed;
+  m_packed = NULL;
+  for( int i = 0; i < m_files.size(); i++ ) {
+    delete m_files[i];
+  }
+  m_files.clear();
+  if( ! isPattern() ) {
+    m_dataDir.rmdir( m_dataDir.path() );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaDataFile* OcaSampleFile::createFile( int cache_pool )
+{
+  // the files are also created by the worker threads
+  int n = s_counter.fetchAndAddOrdered( 1 );
+  QString name = QString( "%1.bin" ) . arg( n, 6, 16, QLatin1Char('0') );
+  return new OcaDataFile( m_dataDir.filePath( name ), cache_pool );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::getAvailableDecimation( long decimation_hint,
+                                                      const QVector<int>& factors )
+{
+  // the highest level not above the hint
+  qint64 result = 1;
+  for( int i = 0; ; i++ ) {
+    qint64 d = result * factors[ i % factors.size() ];
+    if( d > decimation_hint ) {
+      break;
+    }
+    result = d;
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+QVector<int> OcaSampleFile::getDefaultPyramidFactors()
+{
+  return QVector<int>() << 32;
+}
+
+// ------------------------------------------------------------------------------------
+
+QVector<int> OcaSampleFile::getPyramidFactors() const
+{
+  QReadLocker locker( &m_lock );
+  return m_factors;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::setPyramidFactors( const QVector<int>& factors )
+{
+  QWriteLocker locker( &m_lock );
+  Q_ASSERT( ! factors.isEmpty() );
+  if( ( m_factors == factors ) || isPattern() ) {
+    return;
+  }
+  m_factors = factors;
+  resetLevels();
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaSampleFile::getPyramidFormat() const
+{
+  QReadLocker locker( &m_lock );
+  return m_pyramidFormat;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::setPyramidFormat( int format )
+{
+  QWriteLocker locker( &m_lock );
+  if( ( m_pyramidFormat == format ) || isPattern() ) {
+    return;
+  }
+  m_pyramidFormat = format;
+  m_entrySize = m_channels * getEntrySize( format );
+  resetLevels();
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::resetLevels()
+{
+  // the levels are rebuilt from scratch
+  m_tailsValid = false;
+  while( 1 < m_files.size() ) {
+    delete m_files.takeLast();
+  }
+  markDirty( 0, m_length );
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaSampleFile::getLevelFactor( int level ) const
+{
+  Q_ASSERT( 0 < level );
+  return m_factors[ ( level - 1 ) % m_factors.size() ];
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaSampleFile::getLevelDecimation( int level ) const
+{
+  qint64 result = 1;
+  for( int i = 1; i <= level; i++ ) {
+    result *= getLevelFactor( i );
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaSampleFile::getLevel( long decimation ) const
+{
+  int level = 0;
+  qint64 d = 1;
+  while( d < decimation ) {
+    d *= getLevelFactor( ++level );
+  }
+  return ( d == decimation ) ? level : -1;
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaSampleFile::getLevelLength( int level ) const
+{
+  if( ( 0 > level ) || ( m_files.size() <= level ) ) {
+    return 0;
+  }
+  return m_length / getLevelDecimation( level );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::read( double* dst, qint64 ofs, long len ) const
+{
+  QReadLocker locker( &m_lock );
+  touch();
+  return readSamples( dst, ofs, len );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::read( float* dst, qint64 ofs, long len ) const
+{
+  QReadLocker locker( &m_lock );
+  touch();
+  return readSamples( dst, ofs, len );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readSamples( double* dst, qint64 ofs, long len ) const
+{
+  len = qMin( (qint64)len, m_length - ofs );
+  if( ( 0 >= len ) || ( 0 > ofs ) ) {
+    return 0;
+  }
+  if( isPattern() ) {
+    return readPattern( dst, ofs, len );
+  }
+  const int K = m_frameSize;
+  long result = 0;
+  if( OcaSampleFormat::e_FormatDouble == m_format ) {
+    result = readRaw( (char*)dst, ofs, len );
+  }
+  else {
+    const long BS = 0x10000 / m_channels;
+    OcaBareArray<char> buffer( K, qMin( len, BS ) );
+    while( result < len ) {
+      long n = readRaw( buffer.data(), ofs + result, qMin( len - result, BS ) );
+      if( 0 >= n ) {
+        break;
+      }
+      OcaSampleFormat::decode( m_format, dst + result * m_channels,
+                                                    buffer.constData(), n * m_channels );
+      result += n;
+    }
+  }
+  Q_ASSERT( result == len );
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readSamples( float* dst, qint64 ofs, long len ) const
+{
+  // float32 samples are passed through as stored, the others are narrowed
+  // from doubles in blocks
+  len = qMin( (qint64)len, m_length - ofs );
+  if( ( 0 >= len ) || ( 0 > ofs ) ) {
+    return 0;
+  }
+  if( ( OcaSampleFormat::e_FormatFloat32 == m_format ) && ( ! isPattern() ) ) {
+    return readRaw( (char*)dst, ofs, len );
+  }
+  const long BS = 0x10000 / m_channels;
+  OcaDataVector buffer( m_channels, qMin( len, BS ) );
+  long result = 0;
+  while( result < len ) {
+    long n = readSamples( buffer.data(), ofs + result, qMin( len - result, BS ) );
+    if( 0 >= n ) {
+      break;
+    }
+    OcaSampleFormat::decode( OcaSampleFormat::e_FormatDouble, dst + result * m_channels,
+                                      (const char*)buffer.constData(), n * m_channels );
+    result += n;
+  }
+  Q_ASSERT( result == len );
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::write( const double* src, qint64 ofs, long len )
+{
+  return writeSamples( src, ofs, len );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::write( const float* src, qint64 ofs, long len )
+{
+  return writeSamples( src, ofs, len );
+}
+
+// ------------------------------------------------------------------------------------
+
+template <typename Type>
+long OcaSampleFile::writeSamples( const Type* src, qint64 ofs, long len )
+{
+  QWriteLocker locker( &m_lock );
+  Q_ASSERT( ! m_readonly );
+  if( ( ofs > m_length ) || ( 0 > ofs ) || ( 0 >= len ) || m_readonly ) {
+    return 0;
+  }
+  touch();
+  unpack();
+  m_serial++;
+  const int K = m_frameSize;
+  long result = 0;
+  bool append = false;
+  QByteArray data;
+  if( m_storeFailed ) {
+    // the failed queue is retried first, if it still can't be stored
+    // the failure is reported instead of queueing more
+    while( storePending() ) {
+    }
+    if( m_storeFailed ) {
+      return 0;
+    }
+  }
+  if( s_PENDING_PIECE >= len * K ) {
+    data.resize( len * K );
+    OcaSampleFormat::encode( m_format, data.data(), src, len * m_channels );
+    addPending( ofs, data );
+    result = len;
+    append = ( ofs == m_length ) && ( ! m_deferredLevels )
+                  && ( m_tailsValid || ( m_dirty.isEmpty() && loadTails() ) );
+  }
+  else {
+    // the large writes are stored right away, after the queued ones
+    while( storePending() ) {
+    }
+    if( m_storeFailed ) {
+      return 0;
+    }
+    if( (int)sizeof(Type) * m_channels == K ) {
+      // double or float32 samples in the stored format
+      result = m_files[0]->write( (const char*)src, ofs * K, len * K ) / K;
+    }
+    else {
+      const long BS = 0x10000 / m_channels;
+      OcaBareArray<char> buffer( K, qMin( len, BS ) );
+      while( result < len ) {
+        long n = qMin( len - result, BS );
+        OcaSampleFormat::encode( m_format, buffer.data(), src + result * m_channels,
+                                                                          n * m_channels );
+        n = m_files[0]->write( buffer.constData(), ( ofs + result ) * K, n * K ) / K;
+        if( 0 >= n ) {
+          break;
+        }
+        result += n;
+      }
+    }
+  }
+  Q_ASSERT( result == len );
+  m_length = qMax( m_length, ofs + result );
+  if( ! append ) {
+    m_tailsValid = false;
+    markDirty( ofs, result );
+  }
+  else if( OcaSampleFormat::e_FormatDouble == m_format ) {
+    appendLevels( (const double*)data.constData(), result );
+  }
+  else {
+    // the levels are built from the stored (quantized) samples
+    OcaDataVector samples( m_channels, result );
+    OcaSampleFormat::decode( m_format, samples.data(), data.constData(), result * m_channels );
+    appendLevels( samples.constData(), result );
+  }
+  if( s_PENDING_LIMIT < s_pendingSize.load() ) {
+    locker.unlock();
+    flush();
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readAvg( OcaAvgData* dst, long decimation, qint64 idx, long len ) const
+{
+  QReadLocker locker( &m_lock );
+  int level = getLevel( decimation );
+  if( 0 >= level ) {
+    return 0;
+  }
+  if( isPattern() ) {
+    return readPatternAvg( dst, decimation, idx, len );
+  }
+  // only the entries before the first stale one are returned
+  qint64 D = decimation;
+  qint64 a = 0;
+  qint64 b = 0;
+  if( findDirty( idx * D, len * D, &a, &b ) ) {
+    len = qMax( (qint64)0, a / D - idx );
+  }
+  return readEntries( dst, level, idx, len );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readShiftedAvg( OcaAvgData* dst, long decimation,
+                                                     qint64 ofs, long len ) const
+{
+  QReadLocker locker( &m_lock );
+  const int level = getLevel( decimation );
+  if( ( 0 >= level ) || ( 0 > ofs ) ) {
+    return 0;
+  }
+  const qint64 D = decimation;
+  len = qMin( (qint64)len, ( m_length - ofs ) / D );
+  if( 0 >= len ) {
+    return 0;
+  }
+  if( 0 == ofs % D ) {
+    locker.unlock();
+    return readAvg( dst, decimation, ofs / D, len );
+  }
+  QVector<OcaSampleStats> stats( m_channels );
+  if( isPattern() ) {
+    for( long i = 0; i < len; i++ ) {
+      for( int ch = 0; ch < m_channels; ch++ ) {
+        stats[ch].clear();
+      }
+      getPatternStats( stats.data(), ofs + i * D, D );
+      for( int ch = 0; ch < m_channels; ch++ ) {
+        stats[ch].getAvgData( dst++ );
+      }
+    }
+    return len;
+  }
+  // only the entries before the first stale one are returned
+  qint64 a = 0;
+  qint64 b = 0;
+  if( findDirty( ofs, len * D, &a, &b ) ) {
+    len = qMax( (qint64)0, ( a - ofs ) / D );
+  }
+
+  // the entries are combined from the highest lower level the offset is aligned to,
+  // its entries are read at once
+  int k = qMin( level, m_files.size() ) - 1;
+  while( ( 0 < k ) && ( 0 != ofs % getLevelDecimation( k ) ) ) {
+    k--;
+  }
+  if( 0 < k ) {
+    const qint64 Dk = getLevelDecimation( k );
+    const int F = D / Dk;
+    const long BS = qMax( 1L, 4096L / F );
+    OcaAvgVector src( m_channels, qMin( len, BS ) * F );
+    long result = 0;
+    while( result < len ) {
+      long m = qMin( len - result, BS );
+      long n = readEntries( src.data(), k, ofs / Dk + result * F, m * F ) / F;
+      if( 0 >= n ) {
+        break;
+      }
+      OcaAvgKernel::calcAvg2( dst + result * m_channels, src.constData(), m_channels, n, F );
+      result += n;
+    }
+    return result;
+  }
+
+  // otherwise each entry is split at the chunks of the lower levels
+  for( long i = 0; i < len; i++ ) {
+    for( int ch = 0; ch < m_channels; ch++ ) {
+      stats[ch].clear();
+    }
+    getStats( stats.data(), ofs + i * D, D, level - 1 );
+    for( int ch = 0; ch < m_channels; ch++ ) {
+      stats[ch].getAvgData( dst++ );
+    }
+  }
+  return len;
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readPatternAvg( OcaAvgData* dst, long decimation,
+                                                      qint64 idx, long len ) const
+{
+  const qint64 D = decimation;
+  const long P = m_pattern.length();
+  len = qMin( (qint64)len, m_length / D - idx );
+  if( ( 0 >= len ) || ( 0 > idx ) ) {
+    return 0;
+  }
+  if( D < P ) {
+    // short entries are computed from the samples as usual
+    const long BS = qMax( (qint64)1, 0x10000 / D );
+    OcaDataVector src( m_channels, qMin( (long)BS, len ) * D );
+    for( long i = 0; i < len; i += BS ) {
+      long m = qMin( len - i, BS );
+      readPattern( src.data(), ( idx + i ) * D, m * D );
+      OcaAvgKernel::calcAvg( dst + i * m_channels, src.constData(), m_channels, m, D );
+    }
+    return len;
+  }
+  QVector<OcaSampleStats> stats( m_channels );
+  OcaAvgData* d = dst;
+  for( long i = 0; i < len; i++ ) {
+    for( int ch = 0; ch < m_channels; ch++ ) {
+      stats[ch].clear();
+    }
+    getPatternStats( stats.data(), ( idx + i ) * D, D );
+    for( int ch = 0; ch < m_channels; ch++ ) {
+      stats[ch].getAvgData( d++ );
+    }
+  }
+  return len;
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readPattern( double* dst, qint64 ofs, long len ) const
+{
+  const long P = m_pattern.length();
+  const int C = m_channels;
+  long result = 0;
+  while( result < len ) {
+    long i = ( ofs + result ) % P;
+    long n = qMin( len - result, P - i );
+    memcpy( dst + result * C, m_pattern.constData() + i * C, n * C * sizeof(double) );
+    result += n;
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::getPatternStats( OcaSampleStats* dst, qint64 ofs, qint64 len ) const
+{
+  // whole periods come from the period statistics and the remainder
+  // from the prefix sums, only the ranges shorter than a period are scanned
+  const long P = m_pattern.length();
+  const int C = m_channels;
+  if( 0 >= len ) {
+    return;
+  }
+  if( P > len ) {
+    OcaDataVector data( C, len );
+    readPattern( data.data(), ofs, len );
+    const double* v = data.constData();
+    for( long i = 0; i < len; i++ ) {
+      for( int ch = 0; ch < C; ch++ ) {
+        dst[ch].add( *(v++) );
+      }
+    }
+    return;
+  }
+  const qint64 n = len / P;
+  const long a = ofs % P;
+  const long b = a + len % P;
+  const double* sums = m_patternSums.constData();
+  for( int ch = 0; ch < C; ch++ ) {
+    OcaSampleStats s = m_patternStats[ch];
+    s.count = len;
+    s.sum = s.sum * n + sums[ 2 * ( qMin( b, P ) * C + ch ) ] - sums[ 2 * ( a * C + ch ) ];
+    s.sumsq = s.sumsq * n + sums[ 2 * ( qMin( b, P ) * C + ch ) + 1 ]
+                                                      - sums[ 2 * ( a * C + ch ) + 1 ];
+    if( P < b ) {
+      s.sum += sums[ 2 * ( ( b - P ) * C + ch ) ];
+      s.sumsq += sums[ 2 * ( ( b - P ) * C + ch ) + 1 ];
+    }
+    dst[ch].add( s );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readEntries( OcaAvgData* dst, int level, qint64 idx, long len ) const
+{
+  Q_ASSERT( 0 < level );
+  len = qMin( (qint64)len, getLevelLength( level ) - idx );
+  if( ( 0 >= len ) || ( 0 > idx ) ) {
+    return 0;
+  }
+  const int K = m_entrySize;
+  if( OcaSampleFormat::e_FormatDouble == m_pyramidFormat ) {
+    return m_files[level]->read( (char*)dst, idx * K, len * K ) / K;
+  }
+  OcaBareArray<float> buffer( m_channels * 4, len );
+  len = m_files[level]->read( (char*)buffer.data(), idx * K, len * K ) / K;
+  widen_entries( dst, buffer.constData(), len * m_channels );
+  return len;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::truncate( qint64 len )
+{
+  QWriteLocker locker( &m_lock );
+  if( ( 0 > len ) || ( m_length <= len ) || m_readonly ) {
+    return;
+  }
+  touch();
+  unpack();
+  m_serial++;
+  m_tailsValid = false;
+  dropPending( len, m_length - len );
+  if( m_files[0]->getSize() > len * m_frameSize ) {
+    m_files[0]->resize( len * m_frameSize );
+  }
+  removeDirty( len, m_length - len );
+  m_length = len;
+  updateLevels( len, 0 );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::updateLevels( qint64 ofs, qint64 len )
+{
+  // Only complete chunks are stored, so every entry is exact.
+  // The changed range [a,b) is propagated level by level.
+  const int levels = prepareLevels();
+  qint64 a = ofs;
+  qint64 b = ofs + len;
+  for( int level = 1; level <= levels; level++ ) {
+    const int F = getLevelFactor( level );
+    a = a / F;
+    b = qMin( ( b + F - 1 ) / F, getLevelLength( level ) );
+    reduceLevel( level, a, b );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaSampleFile::prepareLevels()
+{
+  // creates the missing level files and drops the ones not needed anymore
+  const int K = m_entrySize;
+  qint64 n = m_length;
+  int level = 0;
+  for( ; ; ) {
+    n /= getLevelFactor( level + 1 );
+    if( 0 == n ) {
+      break;
+    }
+    level++;
+    if( m_files.size() == level ) {
+      m_files.append( createFile( OcaBlockCache::e_PoolPyramid ) );
+    }
+    OcaDataFile* f = m_files[level];
+    if( f->getSize() > n * K ) {
+      f->resize( n * K );
+    }
+  }
+  while( m_files.size() > level + 1 ) {
+    delete m_files.takeLast();
+  }
+  return level;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::reduceLevel( int level, qint64 a, qint64 b )
+{
+  // computes the entries [a,b) of the level from the level below
+  Q_ASSERT( 0 < level );
+  const long BS = 4096;
+  const int F = getLevelFactor( level );
+  const int K = m_entrySize;
+  OcaDataFile* f = m_files[level];
+  OcaDataVector src;
+  OcaAvgVector src2;
+  OcaAvgVector avg( m_channels, BS );
+  OcaBareArray<float> narrow;
+  if( OcaSampleFormat::e_FormatFloat32 == m_pyramidFormat ) {
+    narrow.alloc( m_channels * 4, BS );
+  }
+
+  for( qint64 c = a; c < b; c += BS ) {
+    long m = qMin( b - c, (qint64)BS );
+    if( 1 == level ) {
+      if( src.isEmpty() ) {
+        src.alloc( m_channels, BS * F );
+      }
+      readSamples( src.data(), c * F, m * F );
+      OcaAvgKernel::calcAvg( avg.data(), src.constData(), m_channels, m, F );
+    }
+    else {
+      if( src2.isEmpty() ) {
+        src2.alloc( m_channels, BS * F );
+      }
+      readEntries( src2.data(), level - 1, c * F, m * F );
+      OcaAvgKernel::calcAvg2( avg.data(), src2.constData(), m_channels, m, F );
+    }
+    if( narrow.isEmpty() ) {
+      f->write( (const char*)avg.constData(), c * K, m * K );
+    }
+    else {
+      narrow_entries( narrow.data(), avg.constData(), m * m_channels );
+      f->write( (const char*)narrow.constData(), c * K, m * K );
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::loadTails()
+{
+  // the levels are complete, the incomplete chunks are read once
+  const int C = m_channels;
+  const long n = m_length % getLevelFactor( 1 );
+  m_tailSamples.resize( n * C );
+  readSamples( m_tailSamples.data(), m_length - n, n );
+  m_tailEntries.clear();
+  for( int level = 1; level < m_files.size(); level++ ) {
+    const qint64 L = getLevelLength( level );
+    const long r = L % getLevelFactor( level + 1 );
+    QVector<OcaAvgData> entries( r * C );
+    readEntries( entries.data(), level, L - r, r );
+    m_tailEntries.append( entries );
+  }
+  m_tailsValid = true;
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::appendLevels( const double* src, long len )
+{
+  // The appended samples complete the tail chunks, the complete ones are reduced
+  // and stored level by level. The stored float entries are widened back, so
+  // the upper levels are the same as the ones built by reduceLevel().
+  const int C = m_channels;
+  const int K = m_entrySize;
+  const int levels = prepareLevels();
+
+  QVector<double> samples = m_tailSamples;
+  samples.resize( m_tailSamples.size() + len * C );
+  memcpy( samples.data() + m_tailSamples.size(), src, len * C * sizeof(double) );
+  int F = getLevelFactor( 1 );
+  long m = samples.size() / C / F;
+  QVector<OcaAvgData> entries( m * C );
+  OcaAvgKernel::calcAvg( entries.data(), samples.constData(), C, m, F );
+  m_tailSamples = samples.mid( m * F * C );
+
+  OcaBareArray<float> narrow;
+  for( int level = 1; ( level <= levels ) && ( 0 < m ); level++ ) {
+    const qint64 idx = getLevelLength( level ) - m;
+    OcaDataFile* f = m_files[level];
+    if( OcaSampleFormat::e_FormatFloat32 == m_pyramidFormat ) {
+      narrow.alloc( C * 4, m );
+      narrow_entries( narrow.data(), entries.constData(), m * C );
+      f->write( (const char*)narrow.constData(), idx * K, m * K );
+      widen_entries( entries.data(), narrow.constData(), m * C );
+      narrow.clear();
+    }
+    else {
+      f->write( (const char*)entries.constData(), idx * K, m * K );
+    }
+
+    if( m_tailEntries.size() < level ) {
+      m_tailEntries.append( QVector<OcaAvgData>() );
+    }
+    QVector<OcaAvgData> tail = m_tailEntries[ level - 1 ] + entries;
+    F = getLevelFactor( level + 1 );
+    m = tail.size() / C / F;
+    entries.resize( m * C );
+    OcaAvgKernel::calcAvg2( entries.data(), tail.constData(), C, m, F );
+    m_tailEntries[ level - 1 ] = tail.mid( m * F * C );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::getStats( OcaSampleStats* dst, qint64 ofs, qint64 len ) const
+{
+  QReadLocker locker( &m_lock );
+  if( isPattern() ) {
+    getPatternStats( dst, ofs, qMin( len, m_length - ofs ) );
+    return;
+  }
+  // single precision levels are rounded, they would make the results inexact
+  const bool exact_levels = ( OcaSampleFormat::e_FormatDouble == m_pyramidFormat );
+  getStats( dst, ofs, len, exact_levels ? m_files.size() - 1 : 0 );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::getStats( OcaSampleStats* dst, qint64 ofs,
+                                                  qint64 len, int max_level ) const
+{
+  if( 0 >= len ) {
+    return;
+  }
+  const long BS = 4096;
+
+  // the stale parts are computed from the samples
+  qint64 a = 0;
+  qint64 b = 0;
+  if( ( 0 < max_level ) && findDirty( ofs, len, &a, &b ) ) {
+    a = qMax( a, ofs );
+    b = qMin( b, ofs + len );
+    getStats( dst, ofs, a - ofs, max_level );
+    getStats( dst, a, b - a, 0 );
+    getStats( dst, b, ofs + len - b, max_level );
+    return;
+  }
+
+  // use the highest level having complete chunks inside the range,
+  // the edges are handled by the lower levels
+  for( int k = qMin( max_level, m_files.size() - 1 ); 0 < k; k-- ) {
+    qint64 D = getLevelDecimation( k );
+    if( D > len ) {
+      continue;
+    }
+    qint64 c0 = ( ofs + D - 1 ) / D;
+    qint64 c1 = qMin( ( ofs + len ) / D, getLevelLength( k ) );
+    if( c0 < c1 ) {
+      getStats( dst, ofs, c0 * D - ofs, k - 1 );
+      OcaAvgVector avg( m_channels, qMin( c1 - c0, (qint64)BS ) );
+      for( qint64 c = c0; c < c1; ) {
+        long n = readEntries( avg.data(), k, c, qMin( c1 - c, (qint64)BS ) );
+        if( 0 >= n ) {
+          break;
+        }
+        const OcaAvgData* v = avg.constData();
+        for( long i = 0; i < n; i++ ) {
+          for( int ch = 0; ch < m_channels; ch++ ) {
+            dst[ch].add( *(v++), D );
+          }
+        }
+        c += n;
+      }
+      getStats( dst, c1 * D, ofs + len - c1 * D, k - 1 );
+      return;
+    }
+  }
+
+  OcaDataVector data( m_channels, qMin( len, (qint64)BS ) );
+  while( 0 < len ) {
+    long n = readSamples( data.data(), ofs, qMin( len, (qint64)BS ) );
+    if( 0 >= n ) {
+      break;
+    }
+    const double* v = data.constData();
+    for( long i = 0; i < n; i++ ) {
+      for( int ch = 0; ch < m_channels; ch++ ) {
+        dst[ch].add( *(v++) );
+      }
+    }
+    ofs += n;
+    len -= n;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::touch() const
+{
+  m_accessTime.store( QDateTime::currentMSecsSinceEpoch() );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readRaw( char* dst, qint64 ofs, long len ) const
+{
+  long result = 0;
+  if( NULL != m_packed ) {
+    result = readPacked( dst, ofs, len );
+  }
+  else {
+    result = m_files[0]->read( dst, ofs * m_frameSize, len * m_frameSize ) / m_frameSize;
+  }
+  if( ! m_pending.isEmpty() ) {
+    result = readPending( dst, ofs, len, result );
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readPacked( char* dst, qint64 ofs, long len ) const
+{
+  const int K = m_frameSize;
+  QByteArray src;
+  OcaBareArray<char> frame;
+  long result = 0;
+  while( result < len ) {
+    qint64 pos = ofs + result;
+    int f = pos / s_FRAME_LENGTH;
+    qint64 start = f * (qint64)s_FRAME_LENGTH;
+    long n = qMin( m_length - start, (qint64)s_FRAME_LENGTH );
+    long skip = pos - start;
+    long m = qMin( len - result, n - skip );
+    long size = m_frameIndex[f+1] - m_frameIndex[f];
+    src.resize( size );
+    if( size != m_packed->read( src.data(), m_frameIndex[f], size ) ) {
+      break;
+    }
+    char* p = dst + result * K;
+    if( ( 0 != skip ) || ( m != n ) ) {
+      if( frame.isEmpty() ) {
+        frame.alloc( K, s_FRAME_LENGTH );
+      }
+      p = frame.data();
+    }
+    if( ! OcaSampleCodec::decode( p, m_format, m_channels, n, src.constData(), size ) ) {
+      fprintf( stderr, "OcaSampleFile: corrupted frame %d\n", f );
+      break;
+    }
+    if( p != dst + result * K ) {
+      memcpy( dst + result * K, p + skip * K, m * K );
+    }
+    result += m;
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::unpack()
+{
+  if( NULL == m_packed ) {
+    return;
+  }
+  const int K = m_frameSize;
+  OcaDataFile* file = createFile( OcaBlockCache::e_PoolSamples );
+  OcaBareArray<char> buffer( K, s_FRAME_LENGTH );
+  for( qint64 ofs = 0; ofs < m_length; ofs += s_FRAME_LENGTH ) {
+    long n = readPacked( buffer.data(), ofs, qMin( m_length - ofs, (qint64)s_FRAME_LENGTH ) );
+    file->write( buffer.constData(), ofs * K, n * K );
+  }
+  Q_ASSERT( NULL == m_files[0] );
+  m_files[0] = file;
+  delete m_packed;
+  m_packed = NULL;
+  m_frameIndex.clear();
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::isCompressed() const
+{
+  QReadLocker locker( &m_lock );
+  return ( NULL != m_packed );
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::compress( const volatile bool* run )
+{
+  quint32 serial = 0;
+  {
+    QReadLocker locker( &m_lock );
+    if( ( NULL != m_packed ) || ( m_serial == m_checkedSerial )
+          || ( s_FRAME_LENGTH > m_length ) || m_readonly || ( ! m_pending.isEmpty() ) ) {
+      return false;
+    }
+    serial = m_serial;
+  }
+
+  // the frames are encoded without blocking the writers,
+  // the work is discarded if the file was changed meanwhile
+  const int K = m_frameSize;
+  OcaDataFile* packed = createFile( OcaBlockCache::e_PoolSamples );
+  QVector<qint64> index;
+  index.append( 0 );
+  OcaBareArray<char> buffer( K, s_FRAME_LENGTH );
+  QByteArray frame;
+  bool ok = true;
+  for( qint64 ofs = 0; ok; ofs += s_FRAME_LENGTH ) {
+    long n = 0;
+    {
+      QReadLocker locker( &m_lock );
+      if( ( serial != m_serial ) || ( ( NULL != run ) && ! *run ) ) {
+        ok = false;
+        break;
+      }
+      if( m_length <= ofs ) {
+        break;
+      }
+      n = qMin( m_length - ofs, (qint64)s_FRAME_LENGTH );
+      ok = ( n == readRaw( buffer.data(), ofs, n ) );
+    }
+    frame.resize( 0 );
+    OcaSampleCodec::encode( &frame, m_format, m_channels, buffer.constData(), n );
+    ok = ok && ( frame.size() == packed->write( frame.constData(),
+                                                      index.last(), frame.size() ) );
+    index.append( index.last() + frame.size() );
+  }
+
+  QWriteLocker locker( &m_lock );
+  if( ok && ( serial == m_serial ) ) {
+    // not worth it unless at least 10% is saved
+    if( index.last() * 10 < m_length * K * 9 ) {
+      delete m_files[0];
+      m_files[0] = NULL;
+      m_packed = packed;
+      m_frameIndex = index;
+      return true;
+    }
+    m_checkedSerial = serial;
+  }
+  delete packed;
+  return false;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::pin()
+{
+  // called with s_registryMutex locked, so the file can not be deleted meanwhile;
+  // the reference is taken first, so ( ref - pin ) never drops below the number
+  // of the real owners and isShared() stays true for a shared file
+  for( ; ; ) {
+    int count = m_refCount.load();
+    if( 0 == count ) {
+      return false;
+    }
+    if( m_refCount.testAndSetOrdered( count, count + 1 ) ) {
+      m_pinCount.ref();
+      return true;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::unpin()
+{
+  m_pinCount.deref();
+  release();
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::compressIdleFiles( qint64 idle_time, const volatile bool* run )
+{
+  qint64 t = QDateTime::currentMSecsSinceEpoch() - idle_time;
+  QList<OcaSampleFile*> list;
+  {
+    QMutexLocker locker( &s_registryMutex );
+    for( int i = 0; i < s_registry.size(); i++ ) {
+      OcaSampleFile* file = s_registry[i];
+      if( ( t > file->m_accessTime.load() ) && file->pin() ) {
+        list.append( file );
+      }
+    }
+  }
+  for( int i = 0; i < list.size(); i++ ) {
+    if( *run ) {
+      list[i]->compress( run );
+    }
+    list[i]->unpin();
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaSampleFile::readPending( char* dst, qint64 ofs, long len, long result ) const
+{
+  // The queued samples are newer than the stored ones. The result is extended
+  // over the queued writes following the stored samples.
+  const int K = m_frameSize;
+  QMap<qint64,QByteArray>::const_iterator it = m_pending.lowerBound( ofs );
+  if( m_pending.constBegin() != it ) {
+    --it;
+    if( it.key() + it.value().size() / K <= ofs ) {
+      ++it;
+    }
+  }
+  for( ; ( m_pending.constEnd() != it ) && ( it.key() < ofs + len ); ++it ) {
+    const qint64 a = qMax( ofs, it.key() );
+    const qint64 b = qMin( ofs + len, it.key() + it.value().size() / K );
+    memcpy( dst + ( a - ofs ) * K, it.value().constData() + ( a - it.key() ) * K,
+                                                                        ( b - a ) * K );
+    if( a <= ofs + result ) {
+      result = qMax( result, (long)( b - ofs ) );
+    }
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::addPending( qint64 ofs, const QByteArray& data )
+{
+  // the queued writes don't overlap, a write adjacent to the previous one
+  // is appended to it
+  const int K = m_frameSize;
+  dropPending( ofs, data.size() / K );
+  QMap<qint64,QByteArray>::iterator it = m_pending.lowerBound( ofs );
+  if( m_pending.begin() != it ) {
+    --it;
+  }
+  if( ( m_pending.end() != it ) && ( it.key() + it.value().size() / K == ofs )
+                          && ( s_PENDING_PIECE >= it.value().size() + data.size() ) ) {
+    it.value().append( data );
+  }
+  else {
+    m_pending.insert( ofs, data );
+  }
+  s_pendingSize.fetchAndAddOrdered( data.size() );
+
+  QMutexLocker locker( &s_registryMutex );
+  if( ! s_pendingFiles.contains( this ) ) {
+    s_pendingFiles.append( this );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::dropPending( qint64 ofs, qint64 len )
+{
+  const int K = m_frameSize;
+  const qint64 a = ofs;
+  const qint64 b = ofs + len;
+  QMap<qint64,QByteArray>::iterator it = m_pending.lowerBound( a );
+  if( m_pending.begin() != it ) {
+    --it;
+    if( it.key() + it.value().size() / K <= a ) {
+      ++it;
+    }
+  }
+  while( ( m_pending.end() != it ) && ( it.key() < b ) ) {
+    const qint64 start = it.key();
+    const QByteArray data = it.value();
+    const qint64 end = start + data.size() / K;
+    it = m_pending.erase( it );
+    s_pendingSize.fetchAndAddOrdered( - data.size() );
+    if( start < a ) {
+      m_pending.insert( start, data.left( ( a - start ) * K ) );
+      s_pendingSize.fetchAndAddOrdered( ( a - start ) * K );
+    }
+    if( end > b ) {
+      m_pending.insert( b, data.mid( ( b - start ) * K ) );
+      s_pendingSize.fetchAndAddOrdered( ( end - b ) * K );
+      break;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::storePending()
+{
+  // Stores the first queued write, called with the write lock.
+  // The queue starts at or below the stored length, so the file never gets holes.
+  if( m_pending.isEmpty() ) {
+    m_storeFailed = false;
+    return false;
+  }
+  Q_ASSERT( NULL == m_packed );
+  QMap<qint64,QByteArray>::iterator it = m_pending.begin();
+  const qint64 size = it.value().size();
+  if( size != m_files[0]->write( it.value().constData(), it.key() * m_frameSize, size ) ) {
+    // the piece stays queued (and readable), it is retried by the next flush
+    fprintf( stderr, "OcaSampleFile: failed to store %lld samples\n",
+                                                      (long long)( size / m_frameSize ) );
+    m_storeFailed = true;
+    return false;
+  }
+  m_storeFailed = false;
+  m_pending.erase( it );
+  s_pendingSize.fetchAndAddOrdered( - size );
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::flush()
+{
+  // One piece at a time, so that the readers are not blocked for long.
+  // Returns false if some queued data can't be stored, the file is
+  // registered again so that they are retried later.
+  for( ; ; ) {
+    QWriteLocker locker( &m_lock );
+    if( ! storePending() ) {
+      if( m_pending.isEmpty() ) {
+        return true;
+      }
+      QMutexLocker registry_locker( &s_registryMutex );
+      if( ! s_pendingFiles.contains( this ) ) {
+        s_pendingFiles.append( this );
+      }
+      return false;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::flushPendingWrites()
+{
+  // The calls are serialized, so everything queued before the call
+  // is stored when it returns, even if another thread took it first.
+  QMutexLocker flush_locker( &s_flushMutex );
+  QList<OcaSampleFile*> list;
+  {
+    QMutexLocker locker( &s_registryMutex );
+    for( int i = 0; i < s_pendingFiles.size(); i++ ) {
+      if( s_pendingFiles[i]->pin() ) {
+        list.append( s_pendingFiles[i] );
+      }
+    }
+    s_pendingFiles.clear();
+  }
+  bool result = true;
+  for( int i = 0; i < list.size(); i++ ) {
+    if( ! list[i]->flush() ) {
+      result = false;
+    }
+    list[i]->unpin();
+  }
+  return result;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::markDirty( qint64 ofs, qint64 len )
+{
+  if( 0 >= len ) {
+    return;
+  }
+  qint64 a = ofs;
+  qint64 b = ofs + len;
+  QMap<qint64,qint64>::iterator it = m_dirty.lowerBound( a );
+  if( m_dirty.begin() != it ) {
+    --it;
+    if( it.value() < a ) {
+      ++it;
+    }
+  }
+  // merge with the overlapping and adjacent ranges
+  while( ( m_dirty.end() != it ) && ( it.key() <= b ) ) {
+    a = qMin( a, it.key() );
+    b = qMax( b, it.value() );
+    it = m_dirty.erase( it );
+  }
+  m_dirty.insert( a, b );
+  if( m_deferredLevels ) {
+    // left to buildAllLevels()
+    return;
+  }
+
+  QMutexLocker locker( &s_registryMutex );
+  if( ! s_dirtyFiles.contains( this ) ) {
+    s_dirtyFiles.append( this );
+  }
+  s_buildCondition.wakeOne();
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::removeDirty( qint64 ofs, qint64 len )
+{
+  qint64 a = ofs;
+  qint64 b = ofs + len;
+  QMap<qint64,qint64>::iterator it = m_dirty.lowerBound( a );
+  if( m_dirty.begin() != it ) {
+    --it;
+    if( it.value() <= a ) {
+      ++it;
+    }
+  }
+  while( ( m_dirty.end() != it ) && ( it.key() < b ) ) {
+    qint64 start = it.key();
+    qint64 end = it.value();
+    it = m_dirty.erase( it );
+    if( start < a ) {
+      m_dirty.insert( start, a );
+    }
+    if( end > b ) {
+      m_dirty.insert( b, end );
+      break;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::findDirty( qint64 ofs, qint64 len,
+                                                  qint64* start, qint64* end ) const
+{
+  if( 0 >= len ) {
+    return false;
+  }
+  QMap<qint64,qint64>::const_iterator it = m_dirty.lowerBound( ofs );
+  if( m_dirty.constBegin() != it ) {
+    --it;
+    if( it.value() <= ofs ) {
+      ++it;
+    }
+  }
+  if( ( m_dirty.constEnd() == it ) || ( it.key() >= ofs + len ) ) {
+    return false;
+  }
+  *start = it.key();
+  *end = it.value();
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::buildLevels()
+{
+  // one piece at a time, so that the readers are not blocked for long
+  QWriteLocker locker( &m_lock );
+  if( m_dirty.isEmpty() ) {
+    return false;
+  }
+  qint64 a = m_dirty.begin().key();
+  qint64 b = qMin( m_dirty.begin().value(), ( a / s_BUILD_PIECE + 1 ) * s_BUILD_PIECE );
+  updateLevels( a, b - a );
+  removeDirty( a, b - a );
+  return ! m_dirty.isEmpty();
+}
+
+// ------------------------------------------------------------------------------------
+
+class OcaSampleFile::PieceBuilder : public QRunnable
+{
+  public:
+    PieceBuilder( OcaSampleFile* file, int levels, qint64 end,
+                                          qint64 piece, QAtomicInteger<qint64>* next )
+      : m_file( file ), m_levels( levels ), m_end( end ), m_piece( piece ), m_next( next ) {}
+
+    void run()
+    {
+      for( ; ; ) {
+        const qint64 a = m_next->fetchAndAddOrdered( m_piece );
+        if( a >= m_end ) {
+          break;
+        }
+        const qint64 b = qMin( a + m_piece, m_end );
+        for( int level = 1; level <= m_levels; level++ ) {
+          const qint64 D = m_file->getLevelDecimation( level );
+          m_file->reduceLevel( level, a / D,
+                                    qMin( ( b + D - 1 ) / D, m_file->getLevelLength( level ) ) );
+        }
+      }
+    }
+
+  protected:
+    OcaSampleFile*  m_file;
+    const int       m_levels;
+    const qint64    m_end;
+    const qint64    m_piece;
+    QAtomicInteger<qint64>* m_next;
+};
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::hasDirtyLevels() const
+{
+  QReadLocker locker( &m_lock );
+  return ! m_dirty.isEmpty();
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::buildAllLevels()
+{
+  // Builds the whole dirty range at once, used for the large imported files.
+  // The pieces are reduced by several threads up to the highest level whose
+  // entries don't cross the piece boundaries, so the threads never write
+  // the same entries. The upper levels are small and built afterwards.
+  QWriteLocker locker( &m_lock );
+  if( m_dirty.isEmpty() ) {
+    return;
+  }
+  unpack();
+  const qint64 a = m_dirty.firstKey();
+  const qint64 b = m_dirty.last();
+  const int levels = prepareLevels();
+  const int K = m_entrySize;
+  for( int level = 1; level <= levels; level++ ) {
+    // the files are grown in advance, the threads only fill them
+    const qint64 size = getLevelLength( level ) * K;
+    if( m_files[level]->getSize() < size ) {
+      m_files[level]->resize( size );
+    }
+  }
+
+  int k = 0;
+  while( ( k < levels ) && ( s_BUILD_PIECE >= getLevelDecimation( k + 1 ) ) ) {
+    k++;
+  }
+  if( 0 < k ) {
+    const qint64 D = getLevelDecimation( k );
+    const qint64 piece = s_BUILD_PIECE / D * D;
+    QAtomicInteger<qint64> next( a / piece * piece );
+    const int threads = qMax( 1, QThread::idealThreadCount() );
+    QThreadPool pool;
+    pool.setMaxThreadCount( threads );
+    for( int i = 0; i < threads; i++ ) {
+      pool.start( new PieceBuilder( this, k, b, piece, &next ) );
+    }
+    pool.waitForDone();
+  }
+  for( int level = k + 1; level <= levels; level++ ) {
+    const qint64 D = getLevelDecimation( level );
+    reduceLevel( level, a / D, qMin( ( b + D - 1 ) / D, getLevelLength( level ) ) );
+  }
+
+  m_dirty.clear();
+  QMutexLocker registry_locker( &s_registryMutex );
+  s_dirtyFiles.removeOne( this );
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFile::setDeferredLevels( bool deferred )
+{
+  QWriteLocker locker( &m_lock );
+  m_deferredLevels = deferred;
+  if( ( ! deferred ) && ( ! m_dirty.isEmpty() ) ) {
+    // the ranges written meanwhile go to the background builder
+    QMutexLocker registry_locker( &s_registryMutex );
+    if( ! s_dirtyFiles.contains( this ) ) {
+      s_dirtyFiles.append( this );
+    }
+    s_buildCondition.wakeOne();
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::buildDirtyLevels( unsigned long timeout )
+{
+  OcaSampleFile* file = NULL;
+  {
+    QMutexLocker locker( &s_registryMutex );
+    if( s_dirtyFiles.isEmpty() ) {
+      s_buildCondition.wait( &s_registryMutex, timeout );
+    }
+    while( ( NULL == file ) && ( ! s_dirtyFiles.isEmpty() ) ) {
+      file = s_dirtyFiles.takeFirst();
+      if( ! file->pin() ) {
+        file = NULL;
+      }
+    }
+  }
+  if( NULL == file ) {
+    return false;
+  }
+  if( file->buildLevels() ) {
+    // round robin between the files
+    QMutexLocker locker( &s_registryMutex );
+    if( ! s_dirtyFiles.contains( file ) ) {
+      s_dirtyFiles.append( file );
+    }
+  }
+  file->unpin();
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaSampleFile::hasDirtyFiles()
+{
+  QMutexLocker locker( &s_registryMutex );
+  return ! s_dirtyFiles.isEmpty();
+}
+
+// ------------------------------------------------------------------------------------
+
@@ -0,0 +1,216 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaSampleFile_h
+#define OcaSampleFile_h
+
+#include "OcaDataVector.h"
+#include "OcaSampleFormat.h"
+
+#include <QList>
+#include <QVector>
+#include <QDir>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QReadWriteLock>
+#include <QMutex>
+#include <QMap>
+#include <QWaitCondition>
+
+class OcaDataFile;
+
+// Reference counted sample storage shared by track data blocks.
+// Level 0 keeps the samples (in one of OcaSampleFormat formats), level k keeps
+// statistics of complete chunks of getLevelDecimation(k) samples. Level k is made of
+// chunks of getLevelFactor(k) entries of level k-1, the factors of the levels
+// repeat the given pyramid factors. The level entries are stored either as doubles
+// or as floats (e_FormatFloat32 pyramid format), floats are widened on read.
+// Positions are in file coordinates. readShiftedAvg() returns the entries of chunks
+// starting at any sample offset, e.g. for a file shared by a block at a shifted position.
+// Level 0 of a file that was not accessed for a while can be compressed in frames
+// of s_FRAME_LENGTH samples (see OcaSampleCodec), the frames are decoded on read
+// and the whole file is decompressed back on the first write.
+// The levels are not updated by write(), the changed ranges are marked dirty and
+// rebuilt later by buildDirtyLevels(). Until then the statistics of the dirty ranges
+// are computed from the samples.
+// The small writes at the end of the file update the levels right away: the incomplete
+// chunk of each level (the tail) is kept in memory and reduced once it completes,
+// so the appended data, such as the recorded ones, are never marked dirty.
+// With setDeferredLevels(true) all the writes are only marked dirty and left to
+// buildAllLevels(), which reduces them in parallel, e.g. for the imported data.
+// Small writes are not stored right away, the encoded samples are queued (adjacent
+// ones coalesced up to s_PENDING_PIECE bytes) and stored by flushPendingWrites().
+// The reads see the queued samples. The writers store their queue themselves when
+// the total size of the queues grows above s_PENDING_LIMIT.
+// A pattern file stores nothing, its samples endlessly repeat the given pattern
+// (quantized to the given format) and the statistics are computed on the fly.
+// An external file uses the samples of an existing file in place (see OcaDataFile),
+// only its levels are stored in the cache.
+// The files of a loaded project are adopted with their complete levels
+// (see OcaProject), they are read-only as well.
+// Pattern, external and project files can't be written, so they are always shared.
+
+class OcaSampleFile
+{
+  public:
+    OcaSampleFile( int channels, int format, const QVector<int>& factors,
+                                    int pyramid_format = OcaSampleFormat::e_FormatDouble );
+    OcaSampleFile( const OcaDataVector* pattern, int format );
+    OcaSampleFile( const QString& path, qint64 offset, qint64 length, int channels,
+                        int format, const QVector<int>& factors, int pyramid_format );
+
+  protected:
+    OcaSampleFile( int channels, int format, const QVector<int>& factors,
+                    int pyramid_format, qint64 length, const QList<OcaDataFile*>& files,
+                    OcaDataFile* packed, const QVector<qint64>& frame_index );
+    ~OcaSampleFile();
+
+  public:
+    void ref() { m_refCount.ref(); }
+    void release() { if( ! m_refCount.deref() ) { delete this; } }
+    bool isShared() const
+                { return m_readonly || ( 1 < m_refCount.load() - m_pinCount.load() ); }
+
+  public:
+    static long getAvailableDecimation( long decimation_hint, const QVector<int>& factors );
+    static QVector<int> getDefaultPyramidFactors();
+
+  public:
+    int    getChannels() const { return m_channels; }
+    int    getFormat() const { return m_format; }
+    qint64 getLength() const { return m_length; }
+    bool   isPattern() const { return ! m_pattern.isEmpty(); }
+    bool   isReadonly() const { return m_readonly; }
+    OcaSampleFile* clonePattern( int format ) const;
+    QVector<int> getPyramidFactors() const;
+    void setPyramidFactors( const QVector<int>& factors );
+    int  getPyramidFormat() const;
+    void setPyramidFormat( int format );
+
+    long read( double* dst, qint64 ofs, long len ) const;
+    long read( float* dst, qint64 ofs, long len ) const;
+    long write( const double* src, qint64 ofs, long len );
+    long write( const float* src, qint64 ofs, long len );
+    long readAvg( OcaAvgData* dst, long decimation, qint64 idx, long len ) const;
+    long readShiftedAvg( OcaAvgData* dst, long decimation, qint64 ofs, long len ) const;
+    void getStats( OcaSampleStats* dst, qint64 ofs, qint64 len ) const;
+    void truncate( qint64 len );
+
+    bool isCompressed() const;
+    bool compress( const volatile bool* run = NULL );
+    static void compressIdleFiles( qint64 idle_time, const volatile bool* run );
+
+    bool flush();
+    static bool flushPendingWrites();
+    static bool hasPendingWrites() { return 0 < s_pendingSize.load(); }
+
+    bool buildLevels();
+    bool hasDirtyLevels() const;
+    void buildAllLevels();
+    void setDeferredLevels( bool deferred );
+    static bool buildDirtyLevels( unsigned long timeout );
+    static bool hasDirtyFiles();
+
+  protected:
+    int    getLevelFactor( int level ) const;
+    qint64 getLevelDecimation( int level ) const;
+    int    getLevel( long decimation ) const;
+    qint64 getLevelLength( int level ) const;
+    void resetLevels();
+    void markDirty( qint64 ofs, qint64 len );
+    void removeDirty( qint64 ofs, qint64 len );
+    bool findDirty( qint64 ofs, qint64 len, qint64* start, qint64* end ) const;
+    long readRaw( char* dst, qint64 ofs, long len ) const;
+    long readPacked( char* dst, qint64 ofs, long len ) const;
+    long readSamples( double* dst, qint64 ofs, long len ) const;
+    long readSamples( float* dst, qint64 ofs, long len ) const;
+    template <typename Type> long writeSamples( const Type* src, qint64 ofs, long len );
+    long readPending( char* dst, qint64 ofs, long len, long result ) const;
+    void addPending( qint64 ofs, const QByteArray& data );
+    void dropPending( qint64 ofs, qint64 len );
+    bool storePending();
+    bool loadTails();
+    void appendLevels( const double* src, long len );
+    long readEntries( OcaAvgData* dst, int level, qint64 idx, long len ) const;
+    void unpack();
+    void touch() const;
+    bool pin();
+    void unpin();
+    void updateLevels( qint64 ofs, qint64 len );
+    int  prepareLevels();
+    void reduceLevel( int level, qint64 a, qint64 b );
+    void getStats( OcaSampleStats* dst, qint64 ofs, qint64 len, int max_level ) const;
+    long readPattern( double* dst, qint64 ofs, long len ) const;
+    long readPatternAvg( OcaAvgData* dst, long decimation, qint64 idx, long len ) const;
+    void getPatternStats( OcaSampleStats* dst, qint64 ofs, qint64 len ) const;
+    OcaDataFile* createFile( int cache_pool );
+
+  protected:
+    QAtomicInt          m_refCount;
+    QAtomicInt          m_pinCount;
+    mutable QReadWriteLock m_lock;
+    int                 m_channels;
+    int                 m_format;
+    int                 m_frameSize;
+    QVector<int>        m_factors;
+    int                 m_pyramidFormat;
+    int                 m_entrySize;
+    qint64              m_length;
+    const bool          m_readonly;
+    QList<OcaDataFile*> m_files;
+    QDir                m_dataDir;
+    OcaDataFile*        m_packed;
+    QVector<qint64>     m_frameIndex;
+    QMap<qint64,qint64> m_dirty;
+    QMap<qint64,QByteArray> m_pending;
+    quint32             m_serial;
+    bool                m_storeFailed;
+    quint32             m_checkedSerial;
+    mutable QAtomicInteger<qint64> m_accessTime;
+    bool                m_tailsValid;
+    bool                m_deferredLevels;
+    QVector<double>     m_tailSamples;
+    QVector< QVector<OcaAvgData> > m_tailEntries;
+    OcaDataVector       m_pattern;
+    QVector<double>     m_patternSums;
+    QVector<OcaSampleStats> m_patternStats;
+
+  protected:
+    class PieceBuilder;
+    friend class PieceBuilder;
+    friend class OcaProject;
+
+  protected:
+    static const long s_FRAME_LENGTH;
+    static const qint64 s_BUILD_PIECE;
+    static const qint64 s_PATTERN_LENGTH;
+    static const qint64 s_PENDING_PIECE;
+    static const qint64 s_PENDING_LIMIT;
+    static QAtomicInt s_counter;
+    static QMutex s_registryMutex;
+    static QList<OcaSampleFile*> s_registry;
+    static QList<OcaSampleFile*> s_dirtyFiles;
+    static QWaitCondition s_buildCondition;
+    static QList<OcaSampleFile*> s_pendingFiles;
+    static QAtomicInteger<qint64> s_pendingSize;
+    static QMutex s_flushMutex;
+};
+
+#endif // OcaSampleFile_h
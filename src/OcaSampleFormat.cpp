@@ -0,0 +1,348 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaSampleFormat.h"
+
+#include <QtCore>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const double INT16_SCALE = 32768.0;
+static const double INT24_SCALE = 8388608.0;
+
+// ------------------------------------------------------------------------------------
+
+int OcaSampleFormat::getSampleSize( int format )
+{
+  switch( format ) {
+    case e_FormatDouble:
+      return sizeof(double);
+    case e_FormatFloat32:
+      return sizeof(float);
+    case e_FormatInt16:
+      return 2;
+    case e_FormatInt24:
+      return 3;
+  }
+  Q_ASSERT( false );
+  return 0;
+}
+
+// ------------------------------------------------------------------------------------
+
+QString OcaSampleFormat::getName( int format )
+{
+  switch( format ) {
+    case e_FormatDouble:
+      return "double";
+    case e_FormatFloat32:
+      return "float32";
+    case e_FormatInt16:
+      return "int16";
+    case e_FormatInt24:
+      return "int24";
+  }
+  return QString();
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaSampleFormat::fromName( const QString& name )
+{
+  for( int format = e_FormatDouble; format <= e_FormatInt24; format++ ) {
+    if( getName( format ) == name ) {
+      return format;
+    }
+  }
+  return -1;
+}
+
+// ------------------------------------------------------------------------------------
+
+static inline int to_int( double v, double scale, double max )
+{
+  // same rounding and clipping (nan goes to the minimum) as the sse2 code
+  v = qMax( -scale, qMin( max, v * scale ) );
+  return lrint( v );
+}
+
+// ------------------------------------------------------------------------------------
+
+static void encode_float32( float* dst, const double* src, long count )
+{
+  long i = 0;
+#ifdef __SSE2__
+  for( ; i + 4 <= count; i += 4 ) {
+    __m128 lo = _mm_cvtpd_ps( _mm_loadu_pd( src + i ) );
+    __m128 hi = _mm_cvtpd_ps( _mm_loadu_pd( src + i + 2 ) );
+    _mm_storeu_ps( dst + i, _mm_movelh_ps( lo, hi ) );
+  }
+#endif
+  for( ; i < count; i++ ) {
+    dst[i] = src[i];
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static void decode_float32( double* dst, const float* src, long count )
+{
+  long i = 0;
+#ifdef __SSE2__
+  for( ; i + 4 <= count; i += 4 ) {
+    __m128 v = _mm_loadu_ps( src + i );
+    _mm_storeu_pd( dst + i, _mm_cvtps_pd( v ) );
+    _mm_storeu_pd( dst + i + 2, _mm_cvtps_pd( _mm_movehl_ps( v, v ) ) );
+  }
+#endif
+  for( ; i < count; i++ ) {
+    dst[i] = src[i];
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static void encode_int16( qint16* dst, const double* src, long count )
+{
+  const double max = INT16_SCALE - 1;
+  long i = 0;
+#ifdef __SSE2__
+  const __m128d s = _mm_set1_pd( INT16_SCALE );
+  const __m128d lo = _mm_set1_pd( -INT16_SCALE );
+  const __m128d hi = _mm_set1_pd( max );
+  for( ; i + 8 <= count; i += 8 ) {
+    __m128i v[4];
+    for( int k = 0; k < 4; k++ ) {
+      __m128d x = _mm_mul_pd( _mm_loadu_pd( src + i + 2 * k ), s );
+      x = _mm_max_pd( _mm_min_pd( hi, x ), lo );
+      v[k] = _mm_cvtpd_epi32( x );
+    }
+    __m128i a = _mm_unpacklo_epi64( v[0], v[1] );
+    __m128i b = _mm_unpacklo_epi64( v[2], v[3] );
+    _mm_storeu_si128( (__m128i*)( dst + i ), _mm_packs_epi32( a, b ) );
+  }
+#endif
+  for( ; i < count; i++ ) {
+    dst[i] = to_int( src[i], INT16_SCALE, max );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static void decode_int16( double* dst, const qint16* src, long count )
+{
+  const double k = 1.0 / INT16_SCALE;
+  long i = 0;
+#ifdef __SSE2__
+  const __m128d s = _mm_set1_pd( k );
+  for( ; i + 8 <= count; i += 8 ) {
+    __m128i v = _mm_loadu_si128( (const __m128i*)( src + i ) );
+    __m128i a = _mm_srai_epi32( _mm_unpacklo_epi16( v, v ), 16 );
+    __m128i b = _mm_srai_epi32( _mm_unpackhi_epi16( v, v ), 16 );
+    _mm_storeu_pd( dst + i, _mm_mul_pd( _mm_cvtepi32_pd( a ), s ) );
+    _mm_storeu_pd( dst + i + 2, _mm_mul_pd( _mm_cvtepi32_pd( _mm_srli_si128( a, 8 ) ), s ) );
+    _mm_storeu_pd( dst + i + 4, _mm_mul_pd( _mm_cvtepi32_pd( b ), s ) );
+    _mm_storeu_pd( dst + i + 6, _mm_mul_pd( _mm_cvtepi32_pd( _mm_srli_si128( b, 8 ) ), s ) );
+  }
+#endif
+  for( ; i < count; i++ ) {
+    dst[i] = src[i] * k;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static void encode_int24( uchar* dst, const double* src, long count )
+{
+  const double max = INT24_SCALE - 1;
+  long i = 0;
+#ifdef __SSE2__
+  // the low three bytes of the four lanes are moved together
+  const __m128d s = _mm_set1_pd( INT24_SCALE );
+  const __m128d lo = _mm_set1_pd( -INT24_SCALE );
+  const __m128d hi = _mm_set1_pd( max );
+  const __m128i m0 = _mm_set_epi32( 0, 0, 0, 0x00ffffff );
+  const __m128i m1 = _mm_set_epi32( 0, 0, 0x0000ffff, (int)0xff000000 );
+  const __m128i m2 = _mm_set_epi32( 0, 0x000000ff, (int)0xffff0000, 0 );
+  const __m128i m3 = _mm_set_epi32( 0, (int)0xffffff00, 0, 0 );
+  for( ; i + 4 <= count; i += 4 ) {
+    __m128d a = _mm_mul_pd( _mm_loadu_pd( src + i ), s );
+    __m128d b = _mm_mul_pd( _mm_loadu_pd( src + i + 2 ), s );
+    a = _mm_max_pd( _mm_min_pd( hi, a ), lo );
+    b = _mm_max_pd( _mm_min_pd( hi, b ), lo );
+    __m128i v = _mm_unpacklo_epi64( _mm_cvtpd_epi32( a ), _mm_cvtpd_epi32( b ) );
+    __m128i r = _mm_or_si128(
+                  _mm_or_si128( _mm_and_si128( v, m0 ),
+                                _mm_and_si128( _mm_srli_si128( v, 1 ), m1 ) ),
+                  _mm_or_si128( _mm_and_si128( _mm_srli_si128( v, 2 ), m2 ),
+                                _mm_and_si128( _mm_srli_si128( v, 3 ), m3 ) ) );
+    _mm_storel_epi64( (__m128i*)dst, r );
+    int tail = _mm_cvtsi128_si32( _mm_srli_si128( r, 8 ) );
+    memcpy( dst + 8, &tail, 4 );
+    dst += 12;
+  }
+#endif
+  for( ; i < count; i++ ) {
+    int v = to_int( src[i], INT24_SCALE, max );
+    dst[0] = v & 0xff;
+    dst[1] = ( v >> 8 ) & 0xff;
+    dst[2] = ( v >> 16 ) & 0xff;
+    dst += 3;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static void decode_int24( double* dst, const uchar* src, long count )
+{
+  const double k = 1.0 / INT24_SCALE;
+  long i = 0;
+#ifdef __SSE2__
+  // the samples go to the high three bytes of the lanes, the shift extends the sign
+  const __m128d s = _mm_set1_pd( k );
+  const __m128i m0 = _mm_set_epi32( 0, 0, 0, (int)0xffffff00 );
+  const __m128i m1 = _mm_set_epi32( 0, 0, (int)0xffffff00, 0 );
+  const __m128i m2 = _mm_set_epi32( 0, (int)0xffffff00, 0, 0 );
+  const __m128i m3 = _mm_set_epi32( (int)0xffffff00, 0, 0, 0 );
+  for( ; i + 4 <= count; i += 4 ) {
+    int tail = 0;
+    memcpy( &tail, src + 8, 4 );
+    __m128i v = _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i*)src ),
+                                                            _mm_cvtsi32_si128( tail ) );
+    v = _mm_or_si128(
+          _mm_or_si128( _mm_and_si128( _mm_slli_si128( v, 1 ), m0 ),
+                        _mm_and_si128( _mm_slli_si128( v, 2 ), m1 ) ),
+          _mm_or_si128( _mm_and_si128( _mm_slli_si128( v, 3 ), m2 ),
+                        _mm_and_si128( _mm_slli_si128( v, 4 ), m3 ) ) );
+    v = _mm_srai_epi32( v, 8 );
+    _mm_storeu_pd( dst + i, _mm_mul_pd( _mm_cvtepi32_pd( v ), s ) );
+    _mm_storeu_pd( dst + i + 2, _mm_mul_pd( _mm_cvtepi32_pd( _mm_srli_si128( v, 8 ) ), s ) );
+    src += 12;
+  }
+#endif
+  for( ; i < count; i++ ) {
+    // shift the sign into place, then back
+    qint32 v = (qint32)( ( (quint32)src[0] << 8 ) | ( (quint32)src[1] << 16 )
+                                                  | ( (quint32)src[2] << 24 ) ) >> 8;
+    dst[i] = v * k;
+    src += 3;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFormat::encode( int format, char* dst, const double* src, long count )
+{
+  switch( format ) {
+    case e_FormatDouble:
+      memcpy( dst, src, count * sizeof(double) );
+      break;
+    case e_FormatFloat32:
+      encode_float32( (float*)dst, src, count );
+      break;
+    case e_FormatInt16:
+      encode_int16( (qint16*)dst, src, count );
+      break;
+    case e_FormatInt24:
+      encode_int24( (uchar*)dst, src, count );
+      break;
+    default:
+      Q_ASSERT( false );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFormat::decode( int format, double* dst, const char* src, long count )
+{
+  switch( format ) {
+    case e_FormatDouble:
+      memcpy( dst, src, count * sizeof(double) );
+      break;
+    case e_FormatFloat32:
+      decode_float32( dst, (const float*)src, count );
+      break;
+    case e_FormatInt16:
+      decode_int16( dst, (const qint16*)src, count );
+      break;
+    case e_FormatInt24:
+      decode_int24( dst, (const uchar*)src, count );
+      break;
+    default:
+      Q_ASSERT( false );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFormat::encode( int format, char* dst, const float* src, long count )
+{
+  // single precision samples, the integer formats are encoded from doubles
+  // in blocks that stay in the cache
+  switch( format ) {
+    case e_FormatDouble:
+      decode_float32( (double*)dst, src, count );
+      break;
+    case e_FormatFloat32:
+      memcpy( dst, src, count * sizeof(float) );
+      break;
+    default:
+      {
+        const long BS = 0x400;
+        const int S = getSampleSize( format );
+        double buffer[ BS ];
+        for( long i = 0; i < count; i += BS ) {
+          long n = qMin( BS, count - i );
+          decode_float32( buffer, src + i, n );
+          encode( format, dst + i * S, buffer, n );
+        }
+      }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleFormat::decode( int format, float* dst, const char* src, long count )
+{
+  switch( format ) {
+    case e_FormatDouble:
+      encode_float32( dst, (const double*)src, count );
+      break;
+    case e_FormatFloat32:
+      memcpy( dst, src, count * sizeof(float) );
+      break;
+    default:
+      {
+        const long BS = 0x400;
+        const int S = getSampleSize( format );
+        double buffer[ BS ];
+        for( long i = 0; i < count; i += BS ) {
+          long n = qMin( BS, count - i );
+          decode( format, buffer, src + i * S, n );
+          encode_float32( dst + i, buffer, n );
+        }
+      }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
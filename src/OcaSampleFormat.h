@@ -0,0 +1,49 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaSampleFormat_h
+#define OcaSampleFormat_h
+
+#include <QString>
+
+// On-disk sample formats of the track data and the conversion kernels.
+// Integer formats represent the [-1,1) range, the values outside are clipped.
+
+class OcaSampleFormat
+{
+  public:
+    enum EFormat {
+      e_FormatDouble        = 0,
+      e_FormatFloat32       = 1,
+      e_FormatInt16         = 2,
+      e_FormatInt24         = 3,
+    };
+
+  public:
+    static int getSampleSize( int format );
+    static QString getName( int format );
+    static int fromName( const QString& name );
+
+    static void encode( int format, char* dst, const double* src, long count );
+    static void encode( int format, char* dst, const float* src, long count );
+    static void decode( int format, double* dst, const char* src, long count );
+    static void decode( int format, float* dst, const char* src, long count );
+};
+
+#endif // OcaSampleFormat_h
@@ -0,0 +1,56 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OcaSampleWriter.h"
+#include "OcaSampleFile.h"
+
+#include <QtCore>
+
+const int OcaSampleWriter::s_INTERVAL = 100;
+
+// ------------------------------------------------------------------------------------
+
+OcaSampleWriter::OcaSampleWriter( QObject* parent )
+: QThread( parent ),
+  m_run( true )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleWriter::run()
+{
+  while( m_run ) {
+    if( OcaSampleFile::hasPendingWrites() ) {
+      OcaSampleFile::flushPendingWrites();
+    }
+    msleep( s_INTERVAL );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaSampleWriter::stop()
+{
+  m_run = false;
+  wait();
+}
+
+// ------------------------------------------------------------------------------------
+
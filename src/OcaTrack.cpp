@@ -19,6 +19,10 @@
 
 #include "OcaTrack.h"
 #include "OcaTrackDataBlock.h"
+#include "OcaSampleFormat.h"
+#include "OcaSampleFile.h"
+#include "OcaPyramidBuilder.h"
+#include "OcaApp.h"
 
 #include <QtCore>
 
@@ -34,7 +38,11 @@ OcaTrack::OcaTrack( const QString& name, double sr )
   m_audible( 8000 <= sr ),
   m_gain( 1.0 ),
   m_stereoPan( 0.0 ),
-  m_channels( 1 )
+  m_channels( 1 ),
+  m_storageFormat( OcaSampleFormat::e_FormatDouble ),
+  m_pyramidFactors( OcaSampleFile::getDefaultPyramidFactors() ),
+  m_pyramidFormat( OcaSampleFormat::e_FormatDouble ),
+  m_origin( NAN )
 {
 }
 
@@ -42,9 +50,8 @@ OcaTrack::OcaTrack( const QString& name, double sr )
 
 OcaTrack::~OcaTrack()
 {
-  QMap<double,OcaTrackDataBlock*>::const_iterator it= m_blocks.begin();
-  for( ; it != m_blocks.end(); it++ ) {
-    delete it.value();
+  for( int i = 0; i < m_blocks.size(); i++ ) {
+    delete m_blocks[i].data;
   }
 }
 
@@ -164,6 +171,119 @@ bool OcaTrack::setChannels( int channels )
 
 // ------------------------------------------------------------------------------------
 
+QString OcaTrack::getStorageFormat() const
+{
+  return OcaSampleFormat::getName( m_storageFormat );
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaTrack::setStorageFormat( const QString& format )
+{
+  uint flags = 0;
+  int fmt = OcaSampleFormat::fromName( format );
+  if( -1 != fmt ) {
+    WLock lock( this );
+    if( m_storageFormat != fmt ) {
+      m_storageFormat = fmt;
+      for( int i = 0; i < m_blocks.size(); i++ ) {
+        if( m_blocks[i].data->setFormat( fmt ) ) {
+          flags = e_FlagTrackDataChanged;
+        }
+      }
+    }
+  }
+  if( flags ) {
+    waitForLevels();
+  }
+  emitChanged( flags );
+  return ( -1 != fmt );
+}
+
+// ------------------------------------------------------------------------------------
+
+QString OcaTrack::getPyramidFactors() const
+{
+  OcaLock lock( this );
+  QStringList list;
+  for( int i = 0; i < m_pyramidFactors.size(); i++ ) {
+    list.append( QString::number( m_pyramidFactors[i] ) );
+  }
+  return list.join( "," );
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaTrack::setPyramidFactors( const QString& factors )
+{
+  // comma separated list, repeated for the higher levels
+  QVector<int> list;
+  QStringList items = factors.split( ',' );
+  for( int i = 0; i < items.size(); i++ ) {
+    bool ok = false;
+    int f = items[i].trimmed().toInt( &ok );
+    if( ( ! ok ) || ( 2 > f ) || ( 1024 < f ) ) {
+      return false;
+    }
+    list.append( f );
+  }
+
+  uint flags = 0;
+  {
+    WLock lock( this );
+    m_pyramidFactors = list;
+    for( int i = 0; i < m_blocks.size(); i++ ) {
+      if( m_blocks[i].data->setPyramidFactors( list ) ) {
+        flags = e_FlagTrackDataChanged;
+      }
+    }
+  }
+  if( flags ) {
+    waitForLevels();
+  }
+  emitChanged( flags );
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+QString OcaTrack::getPyramidFormat() const
+{
+  return OcaSampleFormat::getName( m_pyramidFormat );
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaTrack::setPyramidFormat( const QString& format )
+{
+  // only the floating point formats can keep the pyramid entries
+  int fmt = OcaSampleFormat::fromName( format );
+  if( ( OcaSampleFormat::e_FormatDouble != fmt )
+                          && ( OcaSampleFormat::e_FormatFloat32 != fmt ) ) {
+    return false;
+  }
+
+  uint flags = 0;
+  {
+    WLock lock( this );
+    if( m_pyramidFormat != fmt ) {
+      m_pyramidFormat = fmt;
+      for( int i = 0; i < m_blocks.size(); i++ ) {
+        if( m_blocks[i].data->setPyramidFormat( fmt ) ) {
+          flags = e_FlagTrackDataChanged;
+        }
+      }
+    }
+  }
+  if( flags ) {
+    waitForLevels();
+  }
+  emitChanged( flags );
+  return true;
+}
+
+// ------------------------------------------------------------------------------------
+
 void OcaTrack::setGain( double gain )
 {
   uint flags = 0;
@@ -202,12 +322,7 @@ bool OcaTrack::setStartTime( double t )
     WLock lock( this );
     double dt = t - m_startTime;
     if( 0 != dt ) {
-      QMap<double,OcaTrackDataBlock*> new_blocks;
-      QMap<double,OcaTrackDataBlock*>::const_iterator it= m_blocks.begin();
-      for( ; it != m_blocks.end(); it++ ) {
-        new_blocks.insert( it.key() + dt, it.value() );
-      }
-      m_blocks = new_blocks;
+      m_origin += dt;
       m_startTime += dt;
       flags = e_FlagTrackDataChanged | e_FlagDurationChanged;
     }
@@ -225,24 +340,12 @@ bool OcaTrack::setSampleRate( double rate )
   }
   {
     WLock lock( this );
+    m_sampleRate = rate;
     if( ! m_blocks.empty() ) {
-      double k = m_sampleRate / rate;
-
-      QMap<double,OcaTrackDataBlock*> new_blocks;
-      double new_end_time = m_startTime;
-
-      QMap<double,OcaTrackDataBlock*>::const_iterator it= m_blocks.begin();
-      for( ; it != m_blocks.end(); it++ ) {
-        double t_old = it.key();
-        OcaTrackDataBlock* block = it.value();
-        double t_new = ( t_old - m_startTime ) * k + m_startTime;
-        new_end_time = t_new + block->getLength() / rate;
-        new_blocks.insert( t_new, block );
-      }
-      m_blocks = new_blocks;
-      m_duration = new_end_time - m_startTime;
+      // the positions stay, the start time is kept
+      m_origin = m_startTime - m_blocks.first().pos / rate;
+      updateDuration();
     }
-    m_sampleRate = rate;
   }
   return emitChanged( e_FlagSampleRateChanged | e_FlagTrackDataChanged | e_FlagDurationChanged );
 }
@@ -253,19 +356,31 @@ class OcaTrack::DstWrapper
 {
   public:
     DstWrapper( OcaBlockListData* dst );
-    DstWrapper( OcaBlockListAvg* dst, long decimation_hint );
+    DstWrapper( OcaBlockListAvg* dst, long decimation );
     DstWrapper( OcaBlockListInfo* dst );
+    DstWrapper( OcaBlockList<OcaTrackDataBlock>* dst );
+    DstWrapper( double* dst, int channels, long len_max );
+    DstWrapper( float* dst, int channels, long len_max );
     ~DstWrapper();
 
   public:
     void addBlock( OcaTrackDataBlock* block, const Range& r, double t );
     long getDecimation() const { return m_decimation; }
+    long getBufferLength() const { return m_bufferLength; }
+    double getBufferTime() const { return m_bufferTime; }
 
   protected:
     long m_decimation;
     OcaBlockListData* m_data;
     OcaBlockListAvg*  m_avg;
     OcaBlockListInfo* m_info;
+    OcaBlockList<OcaTrackDataBlock>* m_shared;
+    double*           m_buffer;
+    float*            m_floatBuffer;
+    int               m_bufferChannels;
+    long              m_bufferMax;
+    long              m_bufferLength;
+    double            m_bufferTime;
 };
 
 // ------------------------------------------------------------------------------------
@@ -275,20 +390,33 @@ OcaTrack::DstWrapper::DstWrapper( OcaBlockListData* dst )
   m_decimation( 1 ),
   m_data( dst ),
   m_avg( NULL ),
-  m_info( NULL )
+  m_info( NULL ),
+  m_shared( NULL ),
+  m_buffer( NULL ),
+  m_floatBuffer( NULL ),
+  m_bufferChannels( 0 ),
+  m_bufferMax( 0 ),
+  m_bufferLength( 0 ),
+  m_bufferTime( NAN )
 {
 }
 
 // ------------------------------------------------------------------------------------
 
-OcaTrack::DstWrapper::DstWrapper( OcaBlockListAvg* dst, long decimation_hint )
+OcaTrack::DstWrapper::DstWrapper( OcaBlockListAvg* dst, long decimation )
 :
-  m_decimation( 1 ),
+  m_decimation( decimation ),
   m_data( NULL ),
   m_avg( dst ),
-  m_info( NULL )
+  m_info( NULL ),
+  m_shared( NULL ),
+  m_buffer( NULL ),
+  m_floatBuffer( NULL ),
+  m_bufferChannels( 0 ),
+  m_bufferMax( 0 ),
+  m_bufferLength( 0 ),
+  m_bufferTime( NAN )
 {
-  m_decimation = OcaTrackDataBlock::getAvailableDecimation( decimation_hint );
 }
 
 // ------------------------------------------------------------------------------------
@@ -298,7 +426,68 @@ OcaTrack::DstWrapper::DstWrapper( OcaBlockListInfo* dst )
   m_decimation( 1 ),
   m_data( NULL ),
   m_avg( NULL ),
-  m_info( dst )
+  m_info( dst ),
+  m_shared( NULL ),
+  m_buffer( NULL ),
+  m_floatBuffer( NULL ),
+  m_bufferChannels( 0 ),
+  m_bufferMax( 0 ),
+  m_bufferLength( 0 ),
+  m_bufferTime( NAN )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaTrack::DstWrapper::DstWrapper( OcaBlockList<OcaTrackDataBlock>* dst )
+:
+  m_decimation( 1 ),
+  m_data( NULL ),
+  m_avg( NULL ),
+  m_info( NULL ),
+  m_shared( dst ),
+  m_buffer( NULL ),
+  m_floatBuffer( NULL ),
+  m_bufferChannels( 0 ),
+  m_bufferMax( 0 ),
+  m_bufferLength( 0 ),
+  m_bufferTime( NAN )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaTrack::DstWrapper::DstWrapper( double* dst, int channels, long len_max )
+:
+  m_decimation( 1 ),
+  m_data( NULL ),
+  m_avg( NULL ),
+  m_info( NULL ),
+  m_shared( NULL ),
+  m_buffer( dst ),
+  m_floatBuffer( NULL ),
+  m_bufferChannels( channels ),
+  m_bufferMax( len_max ),
+  m_bufferLength( 0 ),
+  m_bufferTime( NAN )
+{
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaTrack::DstWrapper::DstWrapper( float* dst, int channels, long len_max )
+:
+  m_decimation( 1 ),
+  m_data( NULL ),
+  m_avg( NULL ),
+  m_info( NULL ),
+  m_shared( NULL ),
+  m_buffer( NULL ),
+  m_floatBuffer( dst ),
+  m_bufferChannels( channels ),
+  m_bufferMax( len_max ),
+  m_bufferLength( 0 ),
+  m_bufferTime( NAN )
 {
 }
 
@@ -336,6 +525,29 @@ void OcaTrack::DstWrapper::addBlock( OcaTrackDataBlock* block, const Range& r, d
           out_avg = NULL;
         }
       }
+      else if ( ( NULL != m_buffer ) || ( NULL != m_floatBuffer ) ) {
+        // only the first block goes to the caller buffer
+        if( std::isnan( m_bufferTime ) ) {
+          m_bufferTime = t;
+          if( block->getChannels() == m_bufferChannels ) {
+            long len = qMin( (qint64)m_bufferMax, r.end - r.start );
+            if( NULL != m_buffer ) {
+              m_bufferLength = block->read( m_buffer, r.start, len );
+            }
+            else {
+              m_bufferLength = block->read( m_floatBuffer, r.start, len );
+            }
+          }
+        }
+      }
+      else if ( NULL != m_shared ) {
+        OcaTrackDataBlock* out_block = new OcaTrackDataBlock( block->getChannels(),
+                                                                block->getFormat(),
+                                                        block->getPyramidFactors(),
+                                                        block->getPyramidFormat() );
+        block->copy( out_block, r.start, r.end - r.start );
+        m_shared->appendBlock( t, out_block );
+      }
       else {
         Q_ASSERT( NULL != m_info );
         m_info->append( QPair<double,qint64>( t, r.end - r.start ) );
@@ -363,32 +575,92 @@ void OcaTrack::getData( OcaBlockListData* dst, double t0, double duration ) cons
 
 // ------------------------------------------------------------------------------------
 
+long OcaTrack::getData( double* dst, int channels, long len_max, double* t_start,
+                                                double t0, double duration ) const
+{
+  return getSamples( dst, channels, len_max, t_start, t0, duration );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaTrack::getData( float* dst, int channels, long len_max, double* t_start,
+                                                double t0, double duration ) const
+{
+  return getSamples( dst, channels, len_max, t_start, t0, duration );
+}
+
+// ------------------------------------------------------------------------------------
+
+template <typename Type>
+long OcaTrack::getSamples( Type* dst, int channels, long len_max, double* t_start,
+                                                double t0, double duration ) const
+{
+  // Reads the first block of the span straight into the caller buffer
+  // of len_max frames, the buffer is sized from getDataBlocksInfo().
+  // Returns the number of frames read, 0 if the channels do not match.
+  DstWrapper wrapper( dst, channels, len_max );
+  getDataInternal( &wrapper, t0, duration );
+  *t_start = wrapper.getBufferTime();
+  return wrapper.getBufferLength();
+}
+
+// ------------------------------------------------------------------------------------
+
 long OcaTrack::getAvgData( OcaBlockListAvg* dst, double t0,
                                  double duration, long decimation_hint        ) const
 {
   dst->clear();
-  DstWrapper wrapper( dst, decimation_hint );
+  long decimation = 1;
+  {
+    // the closest level not above the hint
+    OcaLock lock( this );
+    decimation = OcaTrackDataBlock::getAvailableDecimation( decimation_hint,
+                                                              m_pyramidFactors );
+  }
+  DstWrapper wrapper( dst, decimation );
   getDataInternal( &wrapper, t0, duration );
   return wrapper.getDecimation();
 }
 
 // ------------------------------------------------------------------------------------
 
-void OcaTrack::getDataInternal( DstWrapper* dst, double t0, double duration ) const
+void OcaTrack::getStats( QVector<OcaSampleStats>* dst, double t0, double duration ) const
 {
+  // per channel statistics of all blocks in the span, taken from the highest
+  // pyramid levels that fit (the samples are read only at the edges)
   OcaLock lock( this );
+  dst->resize( m_channels );
+  for( int c = 0; c < m_channels; c++ ) {
+    (*dst)[c].clear();
+  }
+  const Span span = getSpan( t0, duration );
+  for( int i = findBlock( span.start, false ); i < m_blocks.size(); i++ ) {
+    const Block& b = m_blocks[ i ];
+    Range r = getRange( b, span );
+    if( ! r.isValid() ) {
+      break;
+    }
+    Q_ASSERT( b.data->getChannels() == m_channels );
+    b.data->getStats( dst->data(), r.start, r.end - r.start );
+  }
+}
+
+// ------------------------------------------------------------------------------------
 
-  QMap<double,OcaTrackDataBlock*>::const_iterator it0 = findBlock( t0, false );
+void OcaTrack::getDataInternal( DstWrapper* dst, double t0, double duration ) const
+{
+  OcaLock lock( this );
 
-  for( QMap<double,OcaTrackDataBlock*>::const_iterator it = it0; it != m_blocks.end(); it++ ) {
-    OcaTrackDataBlock* block = it.value();
-    double start_time = it.key();
-    Range r = getRange( block, t0 - start_time, duration );
+  const Span span = getSpan( t0, duration );
+  for( int i = findBlock( span.start, false ); i < m_blocks.size(); i++ ) {
+    const Block& b = m_blocks[ i ];
+    Range r = getRange( b, span );
     if( ! r.isValid() ) {
       break;
     }
-    Q_ASSERT( block->getChannels() == m_channels );
-    dst->addBlock( block, r, start_time + r.start / m_sampleRate );
+    Q_ASSERT( b.data->getChannels() == m_channels );
+    // the pyramid entries start at a multiple of the decimation
+    dst->addBlock( b.data, r, toTime( b.pos + r.start - r.start % dst->getDecimation() ) );
   }
 
 }
@@ -396,6 +668,21 @@ void OcaTrack::getDataInternal( DstWrapper* dst, double t0, double duration ) co
 // ------------------------------------------------------------------------------------
 
 double OcaTrack::setData( const OcaDataVector* src, double t0, double duration /* = 0 */ )
+{
+  return setSamples( src, t0, duration );
+}
+
+// ------------------------------------------------------------------------------------
+
+double OcaTrack::setData( const OcaFloatVector* src, double t0, double duration /* = 0 */ )
+{
+  return setSamples( src, t0, duration );
+}
+
+// ------------------------------------------------------------------------------------
+
+template <typename Type>
+double OcaTrack::setSamples( const OcaBareArray<Type>* src, double t0, double duration )
 {
   double t_next = NAN;
   uint flags = 0;
@@ -408,109 +695,208 @@ double OcaTrack::setData( const OcaDataVector* src, double t0, double duration /
     }
     else {
 
+      const qint64 start = getWriteIndex( t0 );
       bool fill = false;
-      double t00 = t0;
-      if( 0.0 >= duration ) {
-        duration = src->length() / m_sampleRate;
-      }
-      else {
+      qint64 rem = src->length();
+      if( 0.0 < duration ) {
         fill = true;
+        rem = qMax( (qint64)0, toIndex( t0 + duration ) - start );
       }
 
-      QMap<double,OcaTrackDataBlock*>::const_iterator it0 = findBlock( t0, true );
-      OcaTrackDataBlock* block_dst = NULL;
       qint64 idx0 = 0;
+      OcaTrackDataBlock* block_dst = prepareDstBlock( start, rem, &idx0 );
 
-      if( m_blocks.constEnd() != it0 ) {
-        QMap<double,OcaTrackDataBlock*>::iterator it = m_blocks.find( it0.key() );
-
-        Range r = getRange( it.value(), t0 - it.key(), 0 );
-        idx0 = r.start;
-        if( r.isValid() ) {
-          block_dst = it.value();
-          t0 = it.key() + r.start / m_sampleRate;
-          it++;
+      qint64 len = 0;
+      if( fill ) {
+        // a repeated pattern is kept procedural, it is materialized only where
+        // it gets overwritten later
+        if( src->length() < rem ) {
+          len = block_dst->writePattern( src, idx0, rem );
         }
-
-        while( it != m_blocks.end() ) {
-          OcaTrackDataBlock* block = it.value();
-          double start = it.key();
-          r = getRange( block, t0 - start, duration );
-          if( ! r.isValid() ) {
-            break;
-          }
-          Q_ASSERT( 0 == r.start );
-          OcaTrackDataBlock* tmp = NULL;
-          if( block->getLength() > r.end ) {
-            Q_ASSERT( block->getChannels() == m_channels );
-            tmp = new OcaTrackDataBlock( m_channels );
-            if( ! block->split( r.end, tmp ) ) {
-              Q_ASSERT( false );
-            }
-          }
-          delete block;
-          block = NULL;
-          it = m_blocks.erase( it );
-          if( NULL != tmp ) {
-            m_blocks.insert( start + r.end / m_sampleRate, tmp );
-            break;
-          }
+        else if( 0 < rem ) {
+          len = block_dst->write( src, idx0, rem );
         }
       }
-
-      if( NULL == block_dst ) {
-        Q_ASSERT( 0 == idx0 );
-        block_dst = new OcaTrackDataBlock( m_channels );
-        m_blocks.insert( t0, block_dst );
-      }
       else {
-        Q_ASSERT( block_dst->getChannels() == m_channels );
+        len = block_dst->write( src, idx0 );
       }
 
-      qint64 len = 0;
-      if( fill ) {
-        OcaDataVector* src_fill = NULL;
-        qint64 rem = floor( t0 + duration * m_sampleRate - t00 + Oca_TIME_TOLERANCE );
-        long len_pat = src->length();
-        long k = ( qMin( rem, 0x10000ll ) - 1 ) /len_pat  + 1;
-        if( 1 < k ) {
-          src_fill = new OcaDataVector( m_channels, k * len_pat );
-          double* p = src_fill->data();
-          for( int i = 0; i < k; i++ ) {
-            memcpy( p, src->constData(), len_pat * m_channels * sizeof(double) );
-            p += len_pat * m_channels;
-          }
-          src = src_fill;
-          len_pat = src->length();
-        }
-        while( 0 < rem ) {
-          long l = block_dst->write( src, idx0, qMin( rem, (qint64)len_pat ) );
-          len += l;
-          rem -= l;
-          idx0 += l;
-        }
+      t_next = toTime( start + len );
+      flags = ( e_FlagTrackDataChanged | updateDuration() );
+    }
+  }
+
+  if( flags ) {
+    waitForLevels();
+  }
+  emitChanged( flags );
+  return t_next;
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaTrackDataBlock* OcaTrack::createBlock( int channels ) const
+{
+  // a detached block with the storage settings of the track
+  OcaLock lock( this );
+  return new OcaTrackDataBlock( channels, m_storageFormat,
+                                                m_pyramidFactors, m_pyramidFormat );
+}
+
+// ------------------------------------------------------------------------------------
+
+double OcaTrack::setData( const OcaTrackDataBlock* src, double t0 )
+{
+  // the data of the block is shared, not copied
+  double t_next = NAN;
+  uint flags = 0;
+
+  if( ( ! m_readonly ) && ( 0 < src->getLength() ) && std::isfinite( t0 ) ) {
+    WLock lock( this );
+    if( src->getChannels() == m_channels ) {
+      const qint64 start = getWriteIndex( t0 );
+      qint64 idx0 = 0;
+      OcaTrackDataBlock* block_dst = prepareDstBlock( start, src->getLength(), &idx0 );
+      qint64 len = block_dst->write( src, idx0 );
+      t_next = toTime( start + len );
+      flags = ( e_FlagTrackDataChanged | updateDuration() );
+    }
+  }
+
+  if( flags ) {
+    waitForLevels();
+  }
+  emitChanged( flags );
+  return t_next;
+}
+
+// ------------------------------------------------------------------------------------
+
+double OcaTrack::mapFile( const QString& path, qint64 offset,
+                                            int format, qint64 length, double t0 )
+{
+  // the samples are used in place (see OcaTrackDataBlock::mapFile)
+  double t_next = NAN;
+  uint flags = 0;
 
-        if( NULL != src_fill ) {
-          delete src_fill;
-          src_fill = NULL;
-          src = NULL;
+  if( ( ! m_readonly ) && ( 0 < length ) && std::isfinite( t0 ) ) {
+    WLock lock( this );
+    const qint64 start = getWriteIndex( t0 );
+    qint64 idx0 = 0;
+    OcaTrackDataBlock* block_dst = prepareDstBlock( start, length, &idx0 );
+    qint64 len = block_dst->mapFile( path, offset, format, length, idx0 );
+    if( 0 == block_dst->getLength() ) {
+      for( int i = 0; i < m_blocks.size(); i++ ) {
+        if( block_dst == m_blocks[ i ].data ) {
+          m_blocks.remove( i );
+          break;
         }
       }
-      else {
-        len = block_dst->write( src, idx0 );
-      }
+      delete block_dst;
+      block_dst = NULL;
+    }
+    if( 0 < len ) {
+      t_next = toTime( start + len );
+    }
+    flags = ( e_FlagTrackDataChanged | updateDuration() );
+  }
+
+  emitChanged( flags );
+  return t_next;
+}
+
+// ------------------------------------------------------------------------------------
 
-      t_next = t0 + len / m_sampleRate;
+double OcaTrack::copyData( const OcaTrack* src, double t0, double duration, double t_dst )
+{
+  double t_next = NAN;
+  uint flags = 0;
+
+  if( ( ! m_readonly ) && std::isfinite( t_dst ) && ( src->getChannels() == m_channels )
+                                        && ( src->getSampleRate() == m_sampleRate ) ) {
+    // the copied blocks share the sample files with the source track
+    OcaBlockList<OcaTrackDataBlock> blocks;
+    DstWrapper wrapper( &blocks );
+    src->getDataInternal( &wrapper, t0, duration );
+
+    if( ! blocks.isEmpty() ) {
+      // the sample containing t0 goes to t_dst, so a gap at the start of the
+      // interval is kept, an unbounded interval starts with its first block
+      const double t_src = std::isfinite( t0 ) ? src->toTime( src->toIndex( t0 ) )
+                                               : blocks.getTime( 0 );
+      WLock lock( this );
+      const qint64 start = getWriteIndex( t_dst );
+      for( int i = 0; i < blocks.getSize(); i++ ) {
+        OcaTrackDataBlock* block = blocks.getBlock( i );
+        if( block->getFormat() != m_storageFormat ) {
+          block->setFormat( m_storageFormat );
+        }
+        const qint64 pos = start + qRound64( ( blocks.getTime( i ) - t_src ) * m_sampleRate );
+        qint64 idx0 = 0;
+        OcaTrackDataBlock* block_dst = prepareDstBlock( pos, block->getLength(), &idx0 );
+        qint64 len = block_dst->write( block, idx0 );
+        t_next = toTime( pos + len );
+      }
       flags = ( e_FlagTrackDataChanged | updateDuration() );
     }
   }
 
+  if( flags ) {
+    waitForLevels();
+  }
   emitChanged( flags );
   return t_next;
 }
 
 // ------------------------------------------------------------------------------------
 
+OcaTrackDataBlock* OcaTrack::prepareDstBlock( qint64 start, qint64 len, qint64* idx0 )
+{
+  // Finds the block to write to (or creates a new one) and releases
+  // the blocks overlapped by the written range
+  int i = findBlock( start, true );
+  OcaTrackDataBlock* block_dst = NULL;
+  *idx0 = 0;
+
+  if( ( i < m_blocks.size() ) && ( m_blocks[ i ].pos <= start ) ) {
+    // starts within the block or right at its end
+    block_dst = m_blocks[ i ].data;
+    *idx0 = start - m_blocks[ i ].pos;
+    Q_ASSERT( block_dst->getChannels() == m_channels );
+  }
+  else {
+    block_dst = new OcaTrackDataBlock( m_channels, m_storageFormat,
+                                                m_pyramidFactors, m_pyramidFormat );
+    Block b = { start, block_dst };
+    m_blocks.insert( i, b );
+  }
+  i++;
+
+  const qint64 end = start + len;
+  while( ( i < m_blocks.size() ) && ( m_blocks[ i ].pos < end ) ) {
+    Block& b = m_blocks[ i ];
+    Q_ASSERT( b.data->getChannels() == m_channels );
+    if( b.end() > end ) {
+      // the tail stays in place
+      OcaTrackDataBlock* tmp = new OcaTrackDataBlock( m_channels, m_storageFormat,
+                                                m_pyramidFactors, m_pyramidFormat );
+      if( ! b.data->split( end - b.pos, tmp ) ) {
+        Q_ASSERT( false );
+      }
+      delete b.data;
+      b.data = tmp;
+      b.pos = end;
+      break;
+    }
+    delete b.data;
+    m_blocks.remove( i );
+  }
+
+  return block_dst;
+}
+
+// ------------------------------------------------------------------------------------
+
 uint OcaTrack::updateDuration()
 {
   if( m_blocks.isEmpty() ) {
@@ -518,9 +904,9 @@ uint OcaTrack::updateDuration()
     m_duration = 0;
   }
   else {
-    m_startTime = m_blocks.begin().key();
-    QMap<double,OcaTrackDataBlock*>::const_iterator it = --m_blocks.end();
-    m_duration = it.key() - m_startTime + it.value()->getLength() / m_sampleRate;
+    const qint64 pos0 = m_blocks.first().pos;
+    m_startTime = toTime( pos0 );
+    m_duration = ( m_blocks.last().end() - pos0 ) / m_sampleRate;
   }
 
   return e_FlagDurationChanged;
@@ -528,6 +914,38 @@ uint OcaTrack::updateDuration()
 
 // ------------------------------------------------------------------------------------
 
+void OcaTrack::waitForLevels()
+{
+  // the levels of the written data are rebuilt in background,
+  // the track is notified again when they are ready
+  OcaPyramidBuilder* builder = OcaApp::getPyramidBuilder();
+  if( NULL != builder ) {
+    builder->addWaiter( getId() );
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaTrack::hasDirtyLevels() const
+{
+  OcaLock lock( this );
+  for( int i = 0; i < m_blocks.size(); i++ ) {
+    if( m_blocks[ i ].data->hasDirtyLevels() ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaTrack::onLevelsBuilt()
+{
+  emitChanged( e_FlagTrackDataChanged );
+}
+
+// ------------------------------------------------------------------------------------
+
 void OcaTrack::deleteData( double t0, double duration )
 {
   cutData( NULL, t0, duration );
@@ -544,44 +962,42 @@ void OcaTrack::cutData( OcaBlockListData* dst, double t0, double duration )
 
   {
     WLock lock( this );
-    QMap<double,OcaTrackDataBlock*>::const_iterator it0 = findBlock( t0, false );
-    if( m_blocks.constEnd() != it0 ) {
-      QMap<double,OcaTrackDataBlock*>::iterator it = m_blocks.find( it0.key() );
-      while( it != m_blocks.end() ) {
-        OcaTrackDataBlock* block = it.value();
-        Q_ASSERT( block->getChannels() == m_channels );
-        double start_time = it.key();
-        Range r = getRange( block, t0 - start_time, duration );
-        if( ! r.isValid() ) {
-          break;
-        }
-        if( NULL != dst ) {
-          DstWrapper d( dst );
-          d.addBlock( block, r, start_time + r.start / m_sampleRate );
-        }
-        bool done = false;
-        if( block->getLength() > r.end ) {
-          OcaTrackDataBlock* tmp = new OcaTrackDataBlock( m_channels );
-          if( ! block->split( r.end, tmp ) ) {
-            Q_ASSERT( false );
-          }
-          m_blocks.insert( start_time + r.end / m_sampleRate, tmp );
-          done = true;
-        }
-        if( 0 < r.start ) {
-          if( ! block->split( r.start, NULL ) ) {
-            Q_ASSERT( false );
-          }
-          it++;
-        }
-        else {
-          delete block;
-          block = NULL;
-          it = m_blocks.erase( it );
+    const Span span = getSpan( t0, duration );
+    int i = findBlock( span.start, false );
+    while( i < m_blocks.size() ) {
+      const Block b = m_blocks[ i ];
+      Q_ASSERT( b.data->getChannels() == m_channels );
+      Range r = getRange( b, span );
+      if( ! r.isValid() ) {
+        break;
+      }
+      if( NULL != dst ) {
+        DstWrapper d( dst );
+        d.addBlock( b.data, r, toTime( b.pos + r.start ) );
+      }
+      bool done = false;
+      if( b.data->getLength() > r.end ) {
+        OcaTrackDataBlock* tmp = new OcaTrackDataBlock( m_channels, m_storageFormat,
+                                                m_pyramidFactors, m_pyramidFormat );
+        if( ! b.data->split( r.end, tmp ) ) {
+          Q_ASSERT( false );
         }
-        if( done ) {
-          break;
+        Block tail = { b.pos + r.end, tmp };
+        m_blocks.insert( i + 1, tail );
+        done = true;
+      }
+      if( 0 < r.start ) {
+        if( ! b.data->split( r.start, NULL ) ) {
+          Q_ASSERT( false );
         }
+        i++;
+      }
+      else {
+        delete b.data;
+        m_blocks.remove( i );
+      }
+      if( done ) {
+        break;
       }
     }
     flags = ( e_FlagTrackDataChanged | updateDuration() );
@@ -598,24 +1014,25 @@ double OcaTrack::splitBlock( double t0 )
   uint flags = 0;
   {
     WLock lock( this );
-    QMap<double,OcaTrackDataBlock*>::const_iterator it0 = findBlock( t0, false );
-    if( it0 != m_blocks.end() ) {
-      QMap<double,OcaTrackDataBlock*>::iterator it = m_blocks.find( it0.key() );
-      OcaTrackDataBlock* block = it.value();
-      Q_ASSERT( block->getChannels() == m_channels );
-      double start_time = it.key();
-      Range r = getRange( block, t0 - start_time, 0 );
+    const Span span = getSpan( t0, 0 );
+    int i = findBlock( span.start, false );
+    if( i < m_blocks.size() ) {
+      const Block b = m_blocks[ i ];
+      Q_ASSERT( b.data->getChannels() == m_channels );
+      Range r = getRange( b, span );
       if( r.isValid() ) {
         if( 0 == r.start ) {
-          t_ret = start_time;
+          t_ret = toTime( b.pos );
         }
         else {
-          OcaTrackDataBlock* tmp = new OcaTrackDataBlock( m_channels );
-          if( ! block->split( r.start, tmp ) ) {
+          OcaTrackDataBlock* tmp = new OcaTrackDataBlock( m_channels, m_storageFormat,
+                                                m_pyramidFactors, m_pyramidFormat );
+          if( ! b.data->split( r.start, tmp ) ) {
             Q_ASSERT( false );
           }
-          t_ret = start_time + r.start / m_sampleRate;
-          m_blocks.insert( t_ret, tmp );
+          Block tail = { b.pos + r.start, tmp };
+          m_blocks.insert( i + 1, tail );
+          t_ret = toTime( tail.pos );
           flags = e_FlagTrackDataChanged;
         }
       }
@@ -634,22 +1051,20 @@ int OcaTrack::joinBlocks( double t0, double duration )
   uint flags = 0;
   {
     WLock lock( this );
-    QMap<double,OcaTrackDataBlock*>::const_iterator it0 = findBlock( t0, false );
-    if( it0 != m_blocks.end() ) {
-      QMap<double,OcaTrackDataBlock*>::iterator it = m_blocks.find( it0.key() );
+    const Span span = getSpan( t0, duration );
+    int i = findBlock( span.start, false );
+    if( i < m_blocks.size() ) {
       ret = 1;
-      OcaTrackDataBlock* block = it.value();
+      OcaTrackDataBlock* block = m_blocks[ i ].data;
       Q_ASSERT( block->getChannels() == m_channels );
-      it++;
-      while( it != m_blocks.end() ) {
-        OcaTrackDataBlock* tmp = it.value();
+      while( i + 1 < m_blocks.size() ) {
+        OcaTrackDataBlock* tmp = m_blocks[ i + 1 ].data;
         Q_ASSERT( tmp->getChannels() == m_channels );
-        double start_time = it.key();
-        Range r = getRange( tmp, t0 - start_time, duration );
+        Range r = getRange( m_blocks[ i + 1 ], span );
         if( ( ! r.isValid() ) ) {
           break;
         }
-        it = m_blocks.erase( it );
+        m_blocks.remove( i + 1 );
         block->append( tmp );
         delete tmp;
         tmp = NULL;
@@ -675,47 +1090,34 @@ double OcaTrack::moveBlocks( double dt, double t0, double duration )
   uint flags = 0;
   if( 0 != dt ) {
     WLock lock( this );
-    QMap<double,OcaTrackDataBlock*>::iterator it = m_blocks.find( findBlock( t0, false ).key() );
-    QMap<double,OcaTrackDataBlock*>::iterator it_end = it;
-    for( ; it_end != m_blocks.end(); it_end++ ) {
-      OcaTrackDataBlock* block = it_end.value();
-      double start_time = it_end.key();
-      Range r = getRange( block, t0 - start_time, duration );
+    const Span span = getSpan( t0, duration );
+    const int i0 = findBlock( span.start, false );
+    int i_end = i0;
+    for( ; i_end < m_blocks.size(); i_end++ ) {
+      Range r = getRange( m_blocks[ i_end ], span );
       if( ! r.isValid() ) {
         break;
       }
     }
-    if( it != it_end ) {
-      if( 0 < dt ) {
-        if( it_end == m_blocks.end() ) {
-          dt_actual = dt;
+    if( i0 != i_end ) {
+      // the blocks are moved by whole samples, up to the neighbours
+      qint64 dn = qRound64( dt * m_sampleRate );
+      if( 0 < dn ) {
+        if( i_end < m_blocks.size() ) {
+          dn = qMin( dn, m_blocks[ i_end ].pos - m_blocks[ i_end - 1 ].end() );
         }
-        else {
-          QMap<double,OcaTrackDataBlock*>::iterator tmp = it_end - 1;
-          dt_actual = qMin( dt, it_end.key() - ( tmp.key() + tmp.value()->getLength() / m_sampleRate ) );
-        }
-        Q_ASSERT( 0 <= dt_actual );
+        Q_ASSERT( 0 <= dn );
       }
       else {
-        if( it == m_blocks.begin() ) {
-          dt_actual = dt;
-        }
-        else {
-          QMap<double,OcaTrackDataBlock*>::iterator tmp = it - 1;
-          dt_actual = - qMin( -dt, it.key() - ( tmp.key() + tmp.value()->getLength() / m_sampleRate ) );
-          Q_ASSERT( 0 >= dt_actual );
+        if( 0 < i0 ) {
+          dn = - qMin( -dn, m_blocks[ i0 ].pos - m_blocks[ i0 - 1 ].end() );
         }
+        Q_ASSERT( 0 >= dn );
       }
-      if( 0 != dt_actual ) {
-        QMap<double,OcaTrackDataBlock*> tmp_blocks;
-        while( it != it_end ) {
-          OcaTrackDataBlock* block = it.value();
-          double start_time = it.key();
-          it = m_blocks.erase( it );
-          tmp_blocks.insert( start_time + dt_actual, block );
-        }
-        for( it = tmp_blocks.begin() ; it != tmp_blocks.end(); it++ ) {
-          m_blocks.insert( it.key(), it.value() );
+      dt_actual = dn / m_sampleRate;
+      if( 0 != dn ) {
+        for( int i = i0; i < i_end; i++ ) {
+          m_blocks[ i ].pos += dn;
         }
         flags = e_FlagTrackDataChanged;
       }
@@ -732,42 +1134,85 @@ double OcaTrack::moveBlocks( double dt, double t0, double duration )
 
 // ------------------------------------------------------------------------------------
 
-QMap<double,OcaTrackDataBlock*>::const_iterator OcaTrack::findBlock( double t0,
-                                                                            bool bottom_allowed  ) const
+qint64 OcaTrack::Block::end() const
+{
+  return pos + data->getLength();
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaTrack::toIndex( double t ) const
+{
+  // the sample containing the time, bounded so that the index arithmetic
+  // cannot overflow for the infinite spans
+  const double limit = 1LL << 60;
+  double x = floor( ( t - m_origin + Oca_TIME_TOLERANCE ) * m_sampleRate );
+  if( ! ( -limit < x ) ) {
+    x = -limit;
+  }
+  else if( limit < x ) {
+    x = limit;
+  }
+  return (qint64)x;
+}
+
+// ------------------------------------------------------------------------------------
+
+qint64 OcaTrack::getWriteIndex( double t )
 {
-  QMap<double,OcaTrackDataBlock*>::const_iterator next = m_blocks.lowerBound( t0 - Oca_TIME_TOLERANCE );
-  if( std::isfinite( t0 ) && ( m_blocks.begin() != next ) ) {
-    next--;
-    qint64 len = next.value()->getLength();
-    if( bottom_allowed ) {
-      len++;
+  // the first block of an empty track defines the origin
+  if( m_blocks.isEmpty() ) {
+    m_origin = t;
+    return 0;
+  }
+  return toIndex( t );
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaTrack::findBlock( qint64 idx, bool bottom_allowed ) const
+{
+  // the first block ending after the index (or at it, if bottom_allowed)
+  const qint64 d = bottom_allowed ? 1 : 0;
+  int lo = 0;
+  int hi = m_blocks.size();
+  while( lo < hi ) {
+    const int mid = ( lo + hi ) / 2;
+    if( m_blocks[ mid ].end() + d > idx ) {
+      hi = mid;
     }
-    if( len <= ( t0 - next.key() + Oca_TIME_TOLERANCE ) * m_sampleRate ) {
-      next++;
+    else {
+      lo = mid + 1;
     }
   }
-  return next;
+  return lo;
 }
 
 // ------------------------------------------------------------------------------------
 
-OcaTrack::Range OcaTrack::getRange( const OcaTrackDataBlock* block,
-                                                     double dt, double duration ) const
+OcaTrack::Span OcaTrack::getSpan( double t0, double duration ) const
 {
-  Range r;
-  r.start = 0;
-  dt += Oca_TIME_TOLERANCE;
-  if( 0 < dt ) {
-    r.start = floor( dt * m_sampleRate );
-  }
-  r.end = block->getLength();
+  Span s;
+  s.start = toIndex( t0 );
+  s.end = toIndex( INFINITY );
   if( INFINITY > duration ) {
-    r.end = qMax( -1.0, floor( ( dt + duration ) * m_sampleRate ) );
-    if( ( r.start == r.end ) && ( 0 < dt ) ) {
-      r.end++;
+    s.end = qMax( s.start, toIndex( t0 + duration ) );
+    if( s.start == s.end ) {
+      // a point selects the sample containing it, the first sample of a block too
+      // (as the per block ranges did, the time tolerance put it inside the block)
+      s.end++;
     }
-    r.end = qMin( block->getLength(), r.end );
   }
+  return s;
+}
+
+// ------------------------------------------------------------------------------------
+
+OcaTrack::Range OcaTrack::getRange( const Block& block, const Span& span ) const
+{
+  Range r;
+  r.start = qMax( (qint64)0, span.start - block.pos );
+  r.end = qMin( block.data->getLength(), span.end - block.pos );
   return r;
 }
 
@@ -775,7 +1220,16 @@ OcaTrack::Range OcaTrack::getRange( const OcaTrackDataBlock* block,
 
 bool OcaTrack::validateBlocks() const
 {
-  // TODO
+  OcaLock lock( this );
+  for( int i = 0; i < m_blocks.size(); i++ ) {
+    const Block& b = m_blocks[ i ];
+    if( ( 0 >= b.data->getLength() ) || ( b.data->getChannels() != m_channels ) ) {
+      return false;
+    }
+    if( ( 0 < i ) && ( m_blocks[ i - 1 ].end() > b.pos ) ) {
+      return false;
+    }
+  }
   return true;
 }
 
@@ -27,6 +27,7 @@
 #include <QMap>
 #include <QPair>
 #include <QList>
+#include <QVector>
 
 const double Oca_TIME_TOLERANCE = 1.0e-6;
 class OcaTrackDataBlock;
@@ -46,6 +47,9 @@ class OcaTrack : public OcaTrackBase
   Q_PROPERTY( double stereo_pan READ getStereoPan WRITE setStereoPan );
   Q_PROPERTY( double start READ getStartTime WRITE setStartTime );
   Q_PROPERTY( int channels READ getChannels WRITE setChannels );
+  Q_PROPERTY( QString storage_format READ getStorageFormat WRITE setStorageFormat );
+  Q_PROPERTY( QString pyramid_factors READ getPyramidFactors WRITE setPyramidFactors );
+  Q_PROPERTY( QString pyramid_format READ getPyramidFormat WRITE setPyramidFormat );
 
   public:
     OcaTrack( const QString& name, double sr );
@@ -63,6 +67,9 @@ class OcaTrack : public OcaTrackBase
     double getStereoPan() const { return m_stereoPan; }
     void setStereoPan( double pan );
     int getChannels() const { return m_channels; }
+    QString getStorageFormat() const;
+    QString getPyramidFactors() const;
+    QString getPyramidFormat() const;
     virtual double getZero() const { return m_scaleData.getZero(); }
     virtual double getScale() const { return m_scaleData.getScale(); }
 
@@ -75,9 +82,19 @@ class OcaTrack : public OcaTrackBase
     void getDataBlocksInfo( OcaBlockListInfo* info, double t0, double duration ) const;
 
     void getData( OcaBlockListData* dst, double t0, double duration ) const;
+    long getData( double* dst, int channels, long len_max, double* t_start,
+                                            double t0, double duration ) const;
+    long getData( float* dst, int channels, long len_max, double* t_start,
+                                            double t0, double duration ) const;
     long getAvgData( OcaBlockListAvg* dst, double t0,
                      double duration, long decimation_hint ) const;
+    void getStats( QVector<OcaSampleStats>* dst, double t0, double duration ) const;
     double setData( const OcaDataVector* src, double t0, double duration = 0 );
+    double setData( const OcaFloatVector* src, double t0, double duration = 0 );
+    double setData( const OcaTrackDataBlock* src, double t0 );
+    OcaTrackDataBlock* createBlock( int channels ) const;
+    double mapFile( const QString& path, qint64 offset, int format, qint64 length, double t0 );
+    double copyData( const OcaTrack* src, double t0, double duration, double t_dst );
     void deleteData( double t0, double duration );
     void cutData( OcaBlockListData* dst, double t0, double duration );
     double splitBlock( double t0 );
@@ -85,6 +102,8 @@ class OcaTrack : public OcaTrackBase
     double moveBlocks( double dt, double t0, double duration );
 
     bool validateBlocks() const;
+    bool hasDirtyLevels() const;
+    void onLevelsBuilt();
 
   public slots:
     virtual void setScale( double scale );
@@ -95,6 +114,9 @@ class OcaTrack : public OcaTrackBase
     void setReadonly( bool readonly );
     void setAudible( bool on );
     bool setChannels( int channels );
+    bool setStorageFormat( const QString& format );
+    bool setPyramidFactors( const QString& factors );
+    bool setPyramidFormat( const QString& format );
 
   protected:
     double    m_sampleRate;
@@ -106,24 +128,51 @@ class OcaTrack : public OcaTrackBase
     double    m_gain;
     double    m_stereoPan;
     int       m_channels;
+    int       m_storageFormat;
+    QVector<int> m_pyramidFactors;
+    int       m_pyramidFormat;
 
   protected:
-    QMap<double,OcaTrackDataBlock*>   m_blocks;
+    // The blocks are sorted by position, in samples from m_origin. The times are
+    // applied only at the interface, so the track is moved without touching them.
+    struct Block {
+      qint64              pos;
+      OcaTrackDataBlock*  data;
+      qint64 end() const;
+    };
+    double            m_origin;
+    QVector<Block>    m_blocks;
 
   protected:
     uint updateDuration();
+    void waitForLevels();
 
     class DstWrapper;
     void getDataInternal( DstWrapper* dst, double t0, double duration ) const;
-
-    QMap<double,OcaTrackDataBlock*>::const_iterator findBlock( double t0,
-                                                                bool bottom_allowed  ) const;
+    OcaTrackDataBlock* prepareDstBlock( qint64 start, qint64 len, qint64* idx0 );
+    template <typename Type> long getSamples( Type* dst, int channels, long len_max,
+                              double* t_start, double t0, double duration ) const;
+    template <typename Type> double setSamples( const OcaBareArray<Type>* src,
+                                                        double t0, double duration );
+
+    qint64 toIndex( double t ) const;
+    double toTime( qint64 idx ) const { return m_origin + idx / m_sampleRate; }
+    qint64 getWriteIndex( double t );
+    int findBlock( qint64 idx, bool bottom_allowed ) const;
+
+    struct Span {
+      qint64 start;
+      qint64 end;
+    };
+    Span getSpan( double t0, double duration ) const;
     struct Range {
       qint64 start;
       qint64 end;
       bool isValid() const { return ( 0 < end ); }
     };
-    Range getRange( const OcaTrackDataBlock* block, double dt, double duration ) const;
+    Range getRange( const Block& block, const Span& span ) const;
+
+  friend class OcaProject;
 };
 
 #endif // OcaTrack_h
@@ -18,46 +18,45 @@
 */
 
 #include "OcaTrackDataBlock.h"
-#include "OcaApp.h"
+#include "OcaSampleFile.h"
 
 #include <QtCore>
 
-const int OcaTrackDataBlock::s_AVG_FACTOR = 32;
-volatile int OcaTrackDataBlock::s_counter = 0;
-
 // ------------------------------------------------------------------------------------
 
-OcaTrackDataBlock::OcaTrackDataBlock( int channels )
+OcaTrackDataBlock::OcaTrackDataBlock( int channels, int format,
+                                  const QVector<int>& factors, int pyramid_format )
 :
   m_channels( channels ),
+  m_format( format ),
+  m_factors( factors ),
+  m_pyramidFormat( pyramid_format ),
+  m_deferredLevels( false ),
   m_length( 0 )
 {
   Q_ASSERT( 0 < m_channels );
-  m_dataDir = OcaApp::getDataCacheDir();
-
-  QString name = QString( "%1.bin" ) . arg( s_counter++, 6, 16, QLatin1Char('0') );
-  m_files.append( m_dataDir.filePath( name ) );
+  if( m_factors.isEmpty() ) {
+    m_factors = OcaSampleFile::getDefaultPyramidFactors();
+  }
 }
 
 // ------------------------------------------------------------------------------------
 
 OcaTrackDataBlock::~OcaTrackDataBlock()
 {
-  for( int i = 0; i < m_files.size(); i++ ) {
-    QFile::remove( m_files[i] );
+  for( int i = 0; i < m_extents.size(); i++ ) {
+    m_extents[i].file->release();
   }
-  m_dataDir.rmdir( m_dataDir.path() );
+  m_extents.clear();
 }
 
 // ------------------------------------------------------------------------------------
 
-long OcaTrackDataBlock::getAvailableDecimation( long decimation_hint )
+long OcaTrackDataBlock::getAvailableDecimation( long decimation_hint,
+                                                      const QVector<int>& factors )
 {
-  if( 2 > decimation_hint ) {
-    return 1;
-  }
-  int k = floor( log2(decimation_hint) / log2(s_AVG_FACTOR) );
-  return pow( s_AVG_FACTOR, k );
+  return OcaSampleFile::getAvailableDecimation( decimation_hint,
+              factors.isEmpty() ? OcaSampleFile::getDefaultPyramidFactors() : factors );
 }
 
 // ------------------------------------------------------------------------------------
@@ -69,121 +68,298 @@ qint64 OcaTrackDataBlock::getLength() const
 
 // ------------------------------------------------------------------------------------
 
-long OcaTrackDataBlock::read( OcaDataVector* dst, qint64 ofs, long len ) const
+bool OcaTrackDataBlock::setFormat( int format )
 {
-  len = qMin( (qint64)len, m_length - ofs );
-  if( ( 0 >= len ) || ( 0 > ofs ) ) {
-    return 0;
+  // converts the extents stored in other formats,
+  // the neighbouring converted extents go to the same file
+  m_format = format;
+  bool changed = false;
+  const long BS = 4096 * 16;
+  OcaDataVector buffer( m_channels, BS );
+  OcaSampleFile* last = NULL;
+
+  for( int i = 0; i < m_extents.size(); i++ ) {
+    Extent& e = m_extents[i];
+    if( e.file->getFormat() == format ) {
+      last = NULL;
+      continue;
+    }
+    if( e.file->isPattern() ) {
+      // the pattern is quantized again instead of the repeated samples
+      OcaSampleFile* file = e.file->clonePattern( format );
+      e.file->release();
+      e.file = file;
+      last = NULL;
+      changed = true;
+      continue;
+    }
+    OcaSampleFile* file = last;
+    if( NULL == file ) {
+      file = new OcaSampleFile( m_channels, format, m_factors, m_pyramidFormat );
+    }
+    qint64 start = file->getLength();
+    qint64 pos = 0;
+    while( pos < e.length ) {
+      long n = e.file->read( buffer.data(), e.start + pos, qMin( e.length - pos, (qint64)BS ) );
+      if( 0 < n ) {
+        n = file->write( buffer.constData(), start + pos, n );
+      }
+      if( 0 >= n ) {
+        break;
+      }
+      pos += n;
+    }
+    if( pos < e.length ) {
+      // the samples can't be copied, the extent keeps its file
+      if( NULL == last ) {
+        file->release();
+      }
+      else {
+        file->truncate( start );
+      }
+      last = NULL;
+      continue;
+    }
+    e.file->release();
+    if( NULL == last ) {
+      e.file = file;
+      e.start = start;
+    }
+    else {
+      m_extents[i-1].length += e.length;
+      m_extents.removeAt( i-- );
+    }
+    last = file;
+    changed = true;
   }
-  dst->alloc( m_channels, len );
-  double* dst_v = dst->data();
-  long result = 0;
-  QFile f( m_files[0] );
-  f.open( QIODevice::ReadWrite );
-  int K = m_channels * sizeof(double);
-  f.seek( ofs * K );
-  result = f.read( (char*)dst_v, len * K ) / K;
-  f.close();
-  Q_ASSERT( result == len );
-  return result;
+
+  return changed;
 }
 
 // ------------------------------------------------------------------------------------
 
-int OcaTrackDataBlock::calcAvg( OcaAvgData* dst, const OcaDataVector* src, long ofs, long len )
+bool OcaTrackDataBlock::setPyramidFactors( const QVector<int>& factors )
 {
-  int result = 0;
-  const double* v0 = src->constData() + ofs * m_channels;
-  const double* v_max = src->constData() + ( ofs + len ) * m_channels;
-  const double* v_max2 = src->constData() + ( src->length() - s_AVG_FACTOR ) * m_channels;
+  // the levels of the files are rebuilt in background,
+  // the shared files are copied so their other users are not affected
+  m_factors = factors;
+  bool changed = false;
+  for( int i = 0; i < m_extents.size(); i++ ) {
+    OcaSampleFile* file = m_extents[i].file;
+    if( ( file->getPyramidFactors() == factors ) || file->isPattern() ) {
+      continue;
+    }
+    if( ! file->isShared() ) {
+      file->setPyramidFactors( factors );
+    }
+    else if( ! detachExtent( i ) ) {
+      continue;
+    }
+    changed = true;
+  }
+  return changed;
+}
 
+// ------------------------------------------------------------------------------------
 
-  for( int c = 0; c < m_channels; c++ ) {
+bool OcaTrackDataBlock::setPyramidFormat( int format )
+{
+  m_pyramidFormat = format;
+  bool changed = false;
+  for( int i = 0; i < m_extents.size(); i++ ) {
+    OcaSampleFile* file = m_extents[i].file;
+    if( ( file->getPyramidFormat() == format ) || file->isPattern() ) {
+      continue;
+    }
+    if( ! file->isShared() ) {
+      file->setPyramidFormat( format );
+    }
+    else if( ! detachExtent( i ) ) {
+      continue;
+    }
+    changed = true;
+  }
+  return changed;
+}
 
-    const double* v = v0++;
-    int M = s_AVG_FACTOR;
-    result = 0;
-    OcaAvgData* d = dst++;
+// ------------------------------------------------------------------------------------
 
-    while( v < v_max ) {
-      double min = *v;
-      double max = *v;
-      double sum = *v;
-      double sumsq = (*v) * (*v);
-      if( v > v_max2 ) {
-        M = ( v_max2 - v ) / m_channels + s_AVG_FACTOR ;
-        Q_ASSERT( 0 < M );
-      }
-      v += m_channels;
-      for( int i = 1; i < M; i++ ) {
-        min = qMin( min, *v );
-        max = qMax( max, *v );
-        sum += *v;
-        sumsq += (*v) * (*v);
-        v += m_channels;
-      }
-      d->min = min;
-      d->max = max;
-      d->avg = sum / M;
-      d->var = sumsq / M - pow( d->avg, 2 );
-      d += m_channels;
-      result++;
+bool OcaTrackDataBlock::detachExtent( int idx )
+{
+  // copies the samples of the extent to a new file with the pyramid of the block,
+  // the extent keeps its file when they can't be copied
+  Extent& e = m_extents[idx];
+  OcaSampleFile* file = new OcaSampleFile( m_channels, e.file->getFormat(),
+                                                        m_factors, m_pyramidFormat );
+  const long BS = 4096 * 16;
+  OcaDataVector buffer( m_channels, BS );
+  qint64 pos = 0;
+  while( pos < e.length ) {
+    long n = e.file->read( buffer.data(), e.start + pos, qMin( e.length - pos, (qint64)BS ) );
+    if( 0 < n ) {
+      n = file->write( buffer.constData(), pos, n );
     }
+    if( 0 >= n ) {
+      break;
+    }
+    pos += n;
+  }
+  if( pos < e.length ) {
+    file->release();
+    return false;
+  }
+  e.file->release();
+  e.file = file;
+  e.start = 0;
+  return true;
+}
 
+// ------------------------------------------------------------------------------------
+
+int OcaTrackDataBlock::findExtent( qint64 ofs ) const
+{
+  if( ( 0 > ofs ) || ( m_length <= ofs ) ) {
+    return -1;
+  }
+  int lo = 0;
+  int hi = m_extents.size() - 1;
+  while( lo < hi ) {
+    int mid = ( lo + hi + 1 ) / 2;
+    if( m_extents[mid].pos <= ofs ) {
+      lo = mid;
+    }
+    else {
+      hi = mid - 1;
+    }
   }
+  Q_ASSERT( ofs < m_extents[lo].pos + m_extents[lo].length );
+  return lo;
+}
 
-  return result;
+// ------------------------------------------------------------------------------------
+
+int OcaTrackDataBlock::splitExtent( qint64 ofs )
+{
+  int idx = findExtent( ofs );
+  if( 0 > idx ) {
+    return m_extents.size();
+  }
+  Extent e = m_extents[idx];
+  if( e.pos == ofs ) {
+    return idx;
+  }
+  qint64 len = ofs - e.pos;
+  m_extents[idx].length = len;
+  e.start += len;
+  e.length -= len;
+  e.pos = ofs;
+  e.file->ref();
+  m_extents.insert( idx + 1, e );
+  return idx + 1;
 }
 
 // ------------------------------------------------------------------------------------
 
-int OcaTrackDataBlock::calcAvg2( OcaAvgData* dst, const OcaAvgVector* src, long ofs, long len )
+void OcaTrackDataBlock::replaceRange( qint64 ofs, qint64 len, const QList<Extent>& extents )
 {
-  int result = 0;
-  const OcaAvgData* v0 = src->constData() + ofs * m_channels;
-  const OcaAvgData* v_max = src->constData() + ( ofs + len ) * m_channels;
-  const OcaAvgData* v_max2 = src->constData() + ( src->length() - s_AVG_FACTOR ) * m_channels;
+  // the new extents may refer to the same files as the replaced ones
+  for( int i = 0; i < extents.size(); i++ ) {
+    extents[i].file->ref();
+  }
+  int i0 = splitExtent( ofs );
+  int i1 = splitExtent( ofs + len );
+  for( int i = i0; i < i1; i++ ) {
+    m_extents[i].file->release();
+  }
+  m_extents.erase( m_extents.begin() + i0, m_extents.begin() + i1 );
+  for( int i = 0; i < extents.size(); i++ ) {
+    m_extents.insert( i0 + i, extents[i] );
+  }
+  m_length = qMax( m_length, ofs + len );
+  updatePositions( i0 );
+}
 
-  for( int c = 0; c < m_channels; c++ ) {
+// ------------------------------------------------------------------------------------
 
-    const OcaAvgData* v = v0++;
-    int M = s_AVG_FACTOR;
-    result = 0;
-    OcaAvgData* d = dst++;
+void OcaTrackDataBlock::updatePositions( int idx )
+{
+  qint64 pos = ( 0 < idx ) ? m_extents[idx-1].pos + m_extents[idx-1].length : 0;
+  for( int i = idx; i < m_extents.size(); i++ ) {
+    m_extents[i].pos = pos;
+    pos += m_extents[i].length;
+  }
+  Q_ASSERT( pos == m_length );
+}
 
-    while( v < v_max ) {
-      double min = v->min;
-      double max = v->max;
-      double sum = v->avg;
-      double sumsq = sum*sum + v->var;
-      if( v > v_max2 ) {
-        M = ( v_max2 - v ) / m_channels + s_AVG_FACTOR;
-        Q_ASSERT( 0 < M );
-      }
-      v += m_channels;
-      for( int i = 1; i < M; i++ ) {
-        min = qMin( min, v->min );
-        max = qMax( max, v->max );
-        sum += v->avg;
-        sumsq += pow( v->avg, 2 ) + v->var;
-        v += m_channels;
-      }
-      d->min = min;
-      d->max = max;
-      d->avg = sum / M;
-      d->var = sumsq / M - pow( d->avg, 2 );
-      d += m_channels;
-      result++;
-    }
+// ------------------------------------------------------------------------------------
 
+long OcaTrackDataBlock::read( OcaDataVector* dst, qint64 ofs, long len ) const
+{
+  len = qMin( (qint64)len, m_length - ofs );
+  if( ( 0 >= len ) || ( 0 > ofs ) ) {
+    return 0;
   }
+  dst->alloc( m_channels, len );
+  return read( dst->data(), ofs, len );
+}
+
+// ------------------------------------------------------------------------------------
 
+long OcaTrackDataBlock::read( double* dst, qint64 ofs, long len ) const
+{
+  return readSamples( dst, ofs, len );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaTrackDataBlock::read( float* dst, qint64 ofs, long len ) const
+{
+  return readSamples( dst, ofs, len );
+}
+
+// ------------------------------------------------------------------------------------
+
+template <typename Type>
+long OcaTrackDataBlock::readSamples( Type* dst, qint64 ofs, long len ) const
+{
+  // the buffer holds len frames of m_channels samples
+  len = qMin( (qint64)len, m_length - ofs );
+  if( ( 0 >= len ) || ( 0 > ofs ) ) {
+    return 0;
+  }
+  long result = 0;
+  for( int idx = findExtent( ofs ); result < len; idx++ ) {
+    const Extent& e = m_extents[idx];
+    qint64 pos = ofs + result;
+    long n = qMin( (qint64)( len - result ), e.pos + e.length - pos );
+    n = e.file->read( dst + result * m_channels, e.start + pos - e.pos, n );
+    if( 0 >= n ) {
+      break;
+    }
+    result += n;
+  }
+  Q_ASSERT( result == len );
   return result;
 }
 
 // ------------------------------------------------------------------------------------
 
 long OcaTrackDataBlock::write( const OcaDataVector* src, qint64 ofs, long len_max /* = 0 */ )
+{
+  return writeSamples( src, ofs, len_max );
+}
+
+// ------------------------------------------------------------------------------------
+
+long OcaTrackDataBlock::write( const OcaFloatVector* src, qint64 ofs, long len_max /* = 0 */ )
+{
+  return writeSamples( src, ofs, len_max );
+}
+
+// ------------------------------------------------------------------------------------
+
+template <typename Type>
+long OcaTrackDataBlock::writeSamples( const OcaBareArray<Type>* src, qint64 ofs, long len_max )
 {
   if( ( ofs > m_length ) || ( 0 > ofs ) ) {
     return 0;
@@ -195,99 +371,146 @@ long OcaTrackDataBlock::write( const OcaDataVector* src, qint64 ofs, long len_ma
   if( 0 < len_max ) {
     len = qMin( len, len_max );
   }
-  qint64 avg_ofs = ofs / s_AVG_FACTOR;
-  long avg_len = (ofs + len - 1 ) / s_AVG_FACTOR + 1 - avg_ofs;
-  OcaAvgVector avg( m_channels, avg_len );
-  long avg_idx = 0;
 
   long result = 0;
-  const double* src_v = src->constData();
-
-  QFile f( m_files[0] );
-  f.open( QIODevice::ReadWrite );
-  int K = m_channels * sizeof(double);
-  int i0 = ofs % s_AVG_FACTOR;
-  f.seek( ( ofs - i0 ) * K );
-  OcaDataVector tmp( m_channels, s_AVG_FACTOR );
-  if( 0 != i0 ) {
-    f.read( (char*)tmp.data(), i0 * K );
-  }
-  result = f.write( (char*)src_v, len * K ) / K;
-  Q_ASSERT( result == len );
-  f.close();
+  const Type* src_v = src->constData();
+  while( result < len ) {
+    qint64 pos = ofs + result;
+    long n = len - result;
+    int idx = findExtent( pos );
+    if( 0 > idx ) {
+      // appending to the last extent
+      idx = m_extents.size() - 1;
+    }
+    int last = m_extents.size() - 1;
 
-  if( 0 != i0 ) {
-    int tmp_len = qMin( i0 + len, (long)s_AVG_FACTOR );
-    memcpy( tmp.data() + i0 * m_channels, src_v, (tmp_len - i0) * K );
-    tmp.setLength( tmp_len );
-    avg_idx = calcAvg( avg.data(), &tmp, 0, tmp_len );
-    i0 = s_AVG_FACTOR - i0;
-  }
-  if( avg_idx < avg_len ) {
-    avg_idx += calcAvg( avg.data() + avg_idx * m_channels, src, i0, result - i0 );
-  }
-  Q_ASSERT( avg_idx == avg.length() );
+    if( ( 0 <= idx ) && ( ! m_extents[idx].file->isShared() ) ) {
+      Extent& e = m_extents[idx];
+      if( idx < last ) {
+        n = qMin( (qint64)n, e.pos + e.length - pos );
+      }
+      n = e.file->write( src_v + result * m_channels, e.start + pos - e.pos, n );
+      e.length = qMax( e.length, pos + n - e.pos );
+      m_length = qMax( m_length, e.pos + e.length );
+    }
+    else {
+      // copy on write, one new file for the whole run of shared extents
+      if( 0 <= idx ) {
+        int i = idx;
+        while( ( i < last ) && m_extents[i+1].file->isShared() ) {
+          i++;
+        }
+        if( i < last ) {
+          n = qMin( (qint64)n, m_extents[i].pos + m_extents[i].length - pos );
+        }
+      }
+      Extent e;
+      e.file = new OcaSampleFile( m_channels, m_format, m_factors, m_pyramidFormat );
+      e.file->setDeferredLevels( m_deferredLevels );
+      e.start = 0;
+      e.length = e.file->write( src_v + result * m_channels, 0, n );
+      n = e.length;
+      if( 0 < n ) {
+        replaceRange( pos, n, QList<Extent>() << e );
+      }
+      e.file->release();
+    }
 
-  m_length = qMax( m_length, ofs + result );
-  writeAvgChunks( avg_ofs, &avg, 1, false );
+    if( 0 >= n ) {
+      break;
+    }
+    result += n;
+  }
+  Q_ASSERT( result == len );
   return result;
 }
 
 // ------------------------------------------------------------------------------------
 
-void OcaTrackDataBlock::writeAvgChunks( qint64 ofs, const OcaAvgVector* avg, int order, bool truncate )
+qint64 OcaTrackDataBlock::write( const OcaTrackDataBlock* src, qint64 ofs )
 {
-  long len = avg->length();
-  if( m_files.size() <= order ) {
-    QString name = QString( "%1.bin" ) . arg( s_counter++, 6, 16, QLatin1Char('0') );
-    Q_ASSERT( m_files.size() == order );
-    m_files.append( m_dataDir.filePath( name ) );
+  if( ( ofs > m_length ) || ( 0 > ofs ) ) {
+    return 0;
+  }
+  if( ( src->getChannels() != m_channels ) || ( 0 == src->getLength() ) ) {
+    return 0;
   }
+  qint64 len = src->getLength();
+  QList<Extent> extents = src->m_extents;
+  replaceRange( ofs, len, extents );
+  return len;
+}
+
+// ------------------------------------------------------------------------------------
 
-  qint64 avg_ofs = ofs / s_AVG_FACTOR;
-  long avg_len = (ofs + len - 1 ) / s_AVG_FACTOR + 1 - avg_ofs;
-  OcaAvgVector avg2( m_channels, avg_len );
-  long avg_idx = 0;
+qint64 OcaTrackDataBlock::writePattern( const OcaDataVector* pattern, qint64 ofs, qint64 len )
+{
+  // the pattern is not materialized, a later write replaces only the written part
+  if( ( ofs > m_length ) || ( 0 > ofs ) || ( 0 >= len ) ) {
+    return 0;
+  }
+  if( ( pattern->channels() != m_channels ) || pattern->isEmpty() ) {
+    return 0;
+  }
+  Extent e;
+  e.file = new OcaSampleFile( pattern, m_format );
+  e.start = 0;
+  e.length = len;
+  replaceRange( ofs, len, QList<Extent>() << e );
+  e.file->release();
+  return len;
+}
 
-  const OcaAvgData* v = avg->constData();
+// ------------------------------------------------------------------------------------
 
-  QFile f( m_files[order] );
-  f.open( QIODevice::ReadWrite );
-  int K = m_channels * sizeof(OcaAvgData);
-  int i0 = ofs % s_AVG_FACTOR;
-  f.seek( ( ofs - i0 ) * K );
-  OcaAvgVector tmp( m_channels, s_AVG_FACTOR );
-  if( 0 != i0 ) {
-    f.read( (char*)tmp.data(), i0 * K );
+qint64 OcaTrackDataBlock::writePattern( const OcaFloatVector* pattern, qint64 ofs, qint64 len )
+{
+  // the pattern file keeps its own copy in doubles anyway
+  if( pattern->isEmpty() ) {
+    return 0;
   }
-  f.write( (char*)v, len * K );
-  f.close();
+  OcaDataVector tmp( pattern->channels(), pattern->length() );
+  OcaSampleFormat::decode( OcaSampleFormat::e_FormatFloat32, tmp.data(),
+                    (const char*)pattern->constData(), tmp.length() * tmp.channels() );
+  return writePattern( &tmp, ofs, len );
+}
 
-  order++;
+// ------------------------------------------------------------------------------------
 
-  if( 1 < ofs + len ) {
-    if( 0 != i0 ) {
-      int tmp_len = qMin( i0 + len, (long)s_AVG_FACTOR );
-      memcpy( tmp.data() + i0 * m_channels, v, (tmp_len - i0) * K );
-      tmp.setLength( tmp_len );
-      avg_idx = calcAvg2( avg2.data(), &tmp, 0, tmp_len );
-      i0 = s_AVG_FACTOR - i0;
-    }
-    if( avg_idx < avg_len ) {
-      avg_idx += calcAvg2( avg2.data() + avg_idx * m_channels, avg, i0, len - i0 );
-    }
+qint64 OcaTrackDataBlock::mapFile( const QString& path, qint64 offset,
+                                                  int format, qint64 len, qint64 ofs )
+{
+  // the samples stay in the given file, only the levels are built (at once)
+  if( ( ofs > m_length ) || ( 0 > ofs ) || ( 0 >= len ) ) {
+    return 0;
+  }
+  Extent e;
+  e.file = new OcaSampleFile( path, offset, len, m_channels, format,
+                                                          m_factors, m_pyramidFormat );
+  e.file->buildAllLevels();
+  e.start = 0;
+  e.length = e.file->getLength();
+  if( 0 < e.length ) {
+    replaceRange( ofs, e.length, QList<Extent>() << e );
+  }
+  e.file->release();
+  return e.length;
+}
 
-    if( truncate ) {
-      f.resize( (ofs + len) * m_channels * sizeof(OcaAvgData) );
-    }
+// ------------------------------------------------------------------------------------
 
-    writeAvgChunks( avg_ofs, &avg2, order, truncate );
+void OcaTrackDataBlock::getStats( OcaSampleStats* dst, qint64 ofs, qint64 len ) const
+{
+  len = qMin( len, m_length - ofs );
+  if( ( 0 >= len ) || ( 0 > ofs ) ) {
+    return;
   }
-  else if( truncate ) {
-    f.resize( m_channels * sizeof(OcaAvgData) );
-    while( m_files.size() > order ) {
-      QFile::remove( m_files.takeLast() );
-    }
+  qint64 pos = ofs;
+  for( int idx = findExtent( ofs ); pos < ofs + len; idx++ ) {
+    const Extent& e = m_extents[idx];
+    qint64 n = qMin( ofs + len, e.pos + e.length ) - pos;
+    e.file->getStats( dst, e.start + pos - e.pos, n );
+    pos += n;
   }
 }
 
@@ -296,40 +519,19 @@ void OcaTrackDataBlock::writeAvgChunks( qint64 ofs, const OcaAvgVector* avg, int
 long OcaTrackDataBlock::readAvg( OcaAvgVector* dst, long decimation,
                                                     qint64 ofs, long len ) const
 {
-  int k = floor( log2(decimation) / log2(s_AVG_FACTOR) );
-  if( ( 0 == m_length ) || ( decimation != pow( s_AVG_FACTOR, k ) ) ) {
+  if( ( 0 == m_length ) || ( 1 > decimation ) ) {
     return 0;
   }
-  k = qMin( k, m_files.size() - 1 );
-  long result = 0;
-
   len = qMin( (qint64)len, ( m_length - ofs + decimation - 1 ) / decimation );
-  if( 0 < k ) {
-    qint64 idx0 = ofs / decimation;
-    dst->alloc( m_channels, len );
-    OcaAvgData* dst_v = dst->data();
-
-    QFile f( m_files[k] );
-    f.open( QIODevice::ReadWrite );
-    int K = m_channels * sizeof(OcaAvgData);
-    f.seek( idx0 * K );
-    result = f.read( (char*)dst_v, len * K ) / K;
-    //Q_ASSERT( result == len );
-    f.close();
+  if( ( 0 >= len ) || ( 0 > ofs ) ) {
+    return 0;
   }
-  else {
-    OcaDataVector d( m_channels, len );
-
-    QFile f( m_files[0] );
-    f.open( QIODevice::ReadWrite );
-    int K = m_channels * sizeof(double);
-    f.seek( ofs * K );
-    result = f.read( (char*)d.data(), len * K ) / K;
-    Q_ASSERT( result == len );
-    f.close();
-
-    dst->alloc( m_channels, len );
-    OcaAvgData* dst_v = dst->data();
+  dst->alloc( m_channels, len );
+  OcaAvgData* dst_v = dst->data();
+
+  if( 1 == decimation ) {
+    OcaDataVector d;
+    long result = read( &d, ofs, len );
     const double* src_v = d.constData();
     OcaAvgData* dst_max = dst_v + result * m_channels;
     while( dst_v < dst_max ) {
@@ -340,8 +542,39 @@ long OcaTrackDataBlock::readAvg( OcaAvgVector* dst, long decimation,
       dst_v->var = 0;
       dst_v++;
     }
+    return result;
   }
-  return result;
+
+  qint64 idx0 = ofs / decimation;
+  OcaBareArray<OcaSampleStats> stats( m_channels, 1 );
+
+  long j = 0;
+  while( j < len ) {
+    qint64 s = ( idx0 + j ) * decimation;
+    const Extent& e = m_extents[ findExtent( s ) ];
+
+    // the entries inside the extent are taken from the file at once,
+    // only those crossing the extent edges are combined from the pieces
+    qint64 fs = e.start + s - e.pos;
+    long n = qMin( ( e.pos + e.length - s ) / decimation, (qint64)( len - j ) );
+    if( 0 < n ) {
+      n = e.file->readShiftedAvg( dst_v + j * m_channels, decimation, fs, n );
+      if( 0 < n ) {
+        j += n;
+        continue;
+      }
+    }
+
+    for( int c = 0; c < m_channels; c++ ) {
+      stats.data()[c].clear();
+    }
+    getStats( stats.data(), s, decimation );
+    for( int c = 0; c < m_channels; c++ ) {
+      stats.constData()[c].getAvgData( dst_v + j * m_channels + c );
+    }
+    j++;
+  }
+  return len;
 }
 
 // ------------------------------------------------------------------------------------
@@ -352,36 +585,28 @@ bool OcaTrackDataBlock::split( qint64 ofs, OcaTrackDataBlock* rem )
     return false;
   }
 
+  int idx = splitExtent( ofs );
   if( NULL != rem ) {
-    const long BS = 4096 * 128;
-    OcaDataVector buffer;
-
-    long len = m_length - ofs;
-    long pos = ofs;
-    long pos2 = 0;
-    while( 0 < len ) {
-      long n = read( &buffer, pos, qMin( len, BS ) );
-      len -= n;
-      pos += n;
-      long n2 = rem->write( &buffer, pos2 );
-      Q_ASSERT( n == n2 );
-      pos2 += n2;
+    Q_ASSERT( rem->m_channels == m_channels );
+    while( m_extents.size() > idx ) {
+      Extent e = m_extents.takeAt( idx );
+      e.pos += rem->m_length - ofs;
+      rem->m_extents.append( e );
+    }
+    rem->m_length += m_length - ofs;
+  }
+  else {
+    while( m_extents.size() > idx ) {
+      m_extents.takeLast().file->release();
+    }
+    // give back the space if nobody else refers to the rest of the file
+    const Extent& e = m_extents.last();
+    if( ! e.file->isShared() ) {
+      e.file->truncate( e.start + e.length );
     }
   }
-
-  QFile f( m_files[0] );
-  int K = m_channels * sizeof(double);
-  f.resize( K * ofs );
   m_length = ofs;
 
-  qint64 avg_ofs = ofs / s_AVG_FACTOR;
-  int i0 = m_length % s_AVG_FACTOR;
-  OcaDataVector tmp( m_channels, s_AVG_FACTOR - i0 );
-  read( &tmp, m_length - s_AVG_FACTOR + i0, s_AVG_FACTOR - i0 );
-  OcaAvgVector avg( m_channels, 1 );
-  calcAvg( avg.data(), &tmp, 0, 1 );
-  writeAvgChunks( avg_ofs, &avg, 1, true );
-
   return true;
 }
 
@@ -389,26 +614,103 @@ bool OcaTrackDataBlock::split( qint64 ofs, OcaTrackDataBlock* rem )
 
 qint64 OcaTrackDataBlock::append( const OcaTrackDataBlock* block )
 {
-  const long BS = 4096 * 128;
-  OcaDataVector buffer;
-
-  long len = block->getLength();
-  long ofs = 0;
-  while( 0 < len ) {
-    long n = block->read( &buffer, ofs, qMin( len, BS ) );
-    len -= n;
-    ofs += n;
-    write( &buffer, m_length );
+  Q_ASSERT( block->m_channels == m_channels );
+  for( int i = 0; i < block->m_extents.size(); i++ ) {
+    appendExtent( block->m_extents[i] );
   }
-  Q_ASSERT( 0 == len );
   return m_length;
 }
 
 // ------------------------------------------------------------------------------------
 
+qint64 OcaTrackDataBlock::copy( OcaTrackDataBlock* dst, qint64 ofs, qint64 len ) const
+{
+  Q_ASSERT( dst->m_channels == m_channels );
+  len = qMin( len, m_length - ofs );
+  if( ( 0 >= len ) || ( 0 > ofs ) ) {
+    return 0;
+  }
+  qint64 pos = ofs;
+  for( int idx = findExtent( ofs ); pos < ofs + len; idx++ ) {
+    Extent e = m_extents[idx];
+    qint64 n = qMin( ofs + len, e.pos + e.length ) - pos;
+    e.start += pos - e.pos;
+    e.length = n;
+    dst->appendExtent( e );
+    pos += n;
+  }
+  return len;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaTrackDataBlock::appendExtent( const Extent& e )
+{
+  if( ! m_extents.isEmpty() ) {
+    // rejoin the pieces of the same file
+    Extent& prev = m_extents.last();
+    if( ( prev.file == e.file ) && ( prev.start + prev.length == e.start ) ) {
+      prev.length += e.length;
+      m_length += e.length;
+      return;
+    }
+  }
+  e.file->ref();
+  m_extents.append( e );
+  m_extents.last().pos = m_length;
+  m_length += e.length;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaTrackDataBlock::hasDirtyLevels() const
+{
+  for( int i = 0; i < m_extents.size(); i++ ) {
+    if( m_extents[i].file->hasDirtyLevels() ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaTrackDataBlock::buildAllLevels()
+{
+  for( int i = 0; i < m_extents.size(); i++ ) {
+    m_extents[i].file->buildAllLevels();
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+void OcaTrackDataBlock::setDeferredLevels( bool deferred )
+{
+  m_deferredLevels = deferred;
+  for( int i = 0; i < m_extents.size(); i++ ) {
+    if( ! m_extents[i].file->isShared() ) {
+      m_extents[i].file->setDeferredLevels( deferred );
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
 bool OcaTrackDataBlock::validate() const
 {
-  return true;
+  qint64 pos = 0;
+  for( int i = 0; i < m_extents.size(); i++ ) {
+    const Extent& e = m_extents[i];
+    if( ( e.pos != pos ) || ( 0 >= e.length ) || ( 0 > e.start ) ) {
+      return false;
+    }
+    if( ( e.file->getChannels() != m_channels )
+        || ( e.start + e.length > e.file->getLength() ) ) {
+      return false;
+    }
+    pos += e.length;
+  }
+  return ( pos == m_length );
 }
 
 // ------------------------------------------------------------------------------------
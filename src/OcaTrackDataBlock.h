@@ -21,47 +21,94 @@
 #define OcaTrackDataBlock_h
 
 #include "OcaDataVector.h"
+#include "OcaSampleFormat.h"
 
 #include <QList>
-#include <QStringList>
-#include <QDir>
+#include <QVector>
+
+class OcaSampleFile;
+
+// Block of samples stored as a list of extents of shared sample files.
+// Split and join only edit the extent list, writes to shared files
+// are redirected to new files (copy on write).
+// New sample files get the pyramid factors of the block, empty factors
+// mean OcaSampleFile::getDefaultPyramidFactors(). The pyramid format
+// (e_FormatDouble or e_FormatFloat32) selects the size of the level entries.
+// Changing the factors or the pyramid format of the block changes its own files,
+// the extents of the shared files are copied to new files first.
+// setDeferredLevels() leaves the levels of the written files to buildAllLevels()
+// (see OcaSampleFile), used when a block is filled at once.
 
 class OcaTrackDataBlock
 {
   public:
-    OcaTrackDataBlock( int channels );
+    OcaTrackDataBlock( int channels, int format = OcaSampleFormat::e_FormatDouble,
+                                      const QVector<int>& factors = QVector<int>(),
+                          int pyramid_format = OcaSampleFormat::e_FormatDouble );
     ~OcaTrackDataBlock();
 
   public:
-    static long getAvailableDecimation( long decimation_hint );
+    static long getAvailableDecimation( long decimation_hint, const QVector<int>& factors );
 
   public:
     qint64 getLength() const;
     int  getChannels() const { return m_channels; }
+    int  getFormat() const { return m_format; }
+    bool setFormat( int format );
+    const QVector<int>& getPyramidFactors() const { return m_factors; }
+    bool setPyramidFactors( const QVector<int>& factors );
+    int  getPyramidFormat() const { return m_pyramidFormat; }
+    bool setPyramidFormat( int format );
     long read( OcaDataVector* dst, qint64 ofs, long len ) const;
+    long read( double* dst, qint64 ofs, long len ) const;
+    long read( float* dst, qint64 ofs, long len ) const;
     long write( const OcaDataVector* src, qint64 ofs, long len_max = 0 );
+    long write( const OcaFloatVector* src, qint64 ofs, long len_max = 0 );
+    qint64 write( const OcaTrackDataBlock* src, qint64 ofs );
+    qint64 writePattern( const OcaDataVector* pattern, qint64 ofs, qint64 len );
+    qint64 writePattern( const OcaFloatVector* pattern, qint64 ofs, qint64 len );
+    qint64 mapFile( const QString& path, qint64 offset, int format, qint64 len, qint64 ofs );
     long readAvg( OcaAvgVector* dst, long decimation, qint64 ofs, long len ) const;
+    void getStats( OcaSampleStats* dst, qint64 ofs, qint64 len ) const;
 
     bool split( qint64 ofs, OcaTrackDataBlock* rem );
     qint64 append( const OcaTrackDataBlock* block );
+    qint64 copy( OcaTrackDataBlock* dst, qint64 ofs, qint64 len ) const;
 
     bool validate() const;
+    bool hasDirtyLevels() const;
+    void buildAllLevels();
+    void setDeferredLevels( bool deferred );
 
   protected:
-    int calcAvg( OcaAvgData* dst, const OcaDataVector* v, long ofs, long len );
-    int calcAvg2( OcaAvgData* dst, const OcaAvgVector* v, long ofs, long len );
-    void writeAvgChunks( qint64 ofs, const OcaAvgVector* avg, int order, bool truncate );
+    struct Extent {
+      OcaSampleFile*  file;
+      qint64          start;    // position in the file
+      qint64          length;
+      qint64          pos;      // position in the block
+    };
 
   protected:
-    int              m_channels;
-    qint64           m_length;
-    QStringList      m_files;
-    QDir             m_dataDir;
+    int  findExtent( qint64 ofs ) const;
+    int  splitExtent( qint64 ofs );
+    void replaceRange( qint64 ofs, qint64 len, const QList<Extent>& extents );
+    void appendExtent( const Extent& e );
+    void updatePositions( int idx );
+    bool detachExtent( int idx );
+    template <typename Type> long readSamples( Type* dst, qint64 ofs, long len ) const;
+    template <typename Type> long writeSamples( const OcaBareArray<Type>* src,
+                                                            qint64 ofs, long len_max );
 
   protected:
-    static const int s_AVG_FACTOR;
-    static volatile int s_counter;
+    int              m_channels;
+    int              m_format;
+    QVector<int>     m_factors;
+    int              m_pyramidFormat;
+    bool             m_deferredLevels;
+    qint64           m_length;
+    QList<Extent>    m_extents;
 
+  friend class OcaProject;
 };
 
 #endif // OcaTrackDataBlock_h
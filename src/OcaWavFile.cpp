@@ -0,0 +1,141 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "OcaWavFile.h"
+#include "OcaSampleFormat.h"
+
+#include <QtCore>
+
+static const quint16 WAVE_FORMAT_PCM = 0x0001;
+static const quint16 WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+static const quint16 WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+// ------------------------------------------------------------------------------------
+
+static int get_format( quint16 tag, int bits, int block_align, int channels )
+{
+  if( block_align != channels * ( bits / 8 ) ) {
+    return -1;
+  }
+  if( ( WAVE_FORMAT_PCM == tag ) && ( 16 == bits ) ) {
+    return OcaSampleFormat::e_FormatInt16;
+  }
+  if( ( WAVE_FORMAT_PCM == tag ) && ( 24 == bits ) ) {
+    return OcaSampleFormat::e_FormatInt24;
+  }
+  if( ( WAVE_FORMAT_IEEE_FLOAT == tag ) && ( 32 == bits ) ) {
+    return OcaSampleFormat::e_FormatFloat32;
+  }
+  if( ( WAVE_FORMAT_IEEE_FLOAT == tag ) && ( 64 == bits ) ) {
+    return OcaSampleFormat::e_FormatDouble;
+  }
+  return -1;
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaWavFile::readInfo( const QString& path, Info* info, QString* error )
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+  *error = "not supported on big endian hosts";
+  return false;
+#endif
+  QFile file( path );
+  if( ! file.open( QIODevice::ReadOnly ) ) {
+    *error = "can't open file";
+    return false;
+  }
+  uchar header[12];
+  if( 12 != file.read( (char*)header, 12 ) ) {
+    *error = "invalid file";
+    return false;
+  }
+  const bool rf64 = ( 0 == memcmp( header, "RF64", 4 ) );
+  if( ( ( ! rf64 ) && ( 0 != memcmp( header, "RIFF", 4 ) ) )
+                                        || ( 0 != memcmp( header + 8, "WAVE", 4 ) ) ) {
+    *error = "not a wav file";
+    return false;
+  }
+
+  // the data size of RF64 comes from the ds64 chunk
+  qint64 data_size64 = -1;
+  int format = -1;
+  bool fmt_found = false;
+  for( ; ; ) {
+    uchar chunk[8];
+    if( 8 != file.read( (char*)chunk, 8 ) ) {
+      *error = "no data chunk";
+      return false;
+    }
+    const quint32 size = qFromLittleEndian<quint32>( chunk + 4 );
+    const qint64 pos = file.pos();
+    if( 0 == memcmp( chunk, "ds64", 4 ) ) {
+      uchar ds64[16];
+      if( ( 16 > size ) || ( 16 != file.read( (char*)ds64, 16 ) ) ) {
+        *error = "invalid ds64 chunk";
+        return false;
+      }
+      data_size64 = qFromLittleEndian<quint64>( ds64 + 8 );
+    }
+    else if( 0 == memcmp( chunk, "fmt ", 4 ) ) {
+      uchar fmt[40];
+      if( ( 16 > size ) || ( 16 > file.read( (char*)fmt, qMin( size, (quint32)40 ) ) ) ) {
+        *error = "invalid fmt chunk";
+        return false;
+      }
+      quint16 tag = qFromLittleEndian<quint16>( fmt );
+      if( ( WAVE_FORMAT_EXTENSIBLE == tag ) && ( 26 <= size ) ) {
+        // the first two bytes of the sub format guid are the format tag
+        tag = qFromLittleEndian<quint16>( fmt + 24 );
+      }
+      info->channels = qFromLittleEndian<quint16>( fmt + 2 );
+      info->rate = qFromLittleEndian<quint32>( fmt + 4 );
+      const int block_align = qFromLittleEndian<quint16>( fmt + 12 );
+      const int bits = qFromLittleEndian<quint16>( fmt + 14 );
+      format = get_format( tag, bits, block_align, info->channels );
+      fmt_found = true;
+    }
+    else if( 0 == memcmp( chunk, "data", 4 ) ) {
+      if( ! fmt_found ) {
+        *error = "no fmt chunk";
+        return false;
+      }
+      if( ( 0 >= info->channels ) || ( 0 >= info->rate ) || ( 0 > format ) ) {
+        *error = "unsupported sample format";
+        return false;
+      }
+      qint64 data_size = size;
+      if( rf64 && ( 0xFFFFFFFF == size ) && ( 0 <= data_size64 ) ) {
+        data_size = data_size64;
+      }
+      // the truncated recordings are accepted
+      data_size = qMin( data_size, file.size() - pos );
+      info->format = format;
+      info->offset = pos;
+      info->length = data_size / ( info->channels * OcaSampleFormat::getSampleSize( format ) );
+      return true;
+    }
+    // the chunks are word aligned
+    if( ! file.seek( pos + size + ( size & 1 ) ) ) {
+      *error = "no data chunk";
+      return false;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
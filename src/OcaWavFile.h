@@ -0,0 +1,44 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OcaWavFile_h
+#define OcaWavFile_h
+
+#include <QString>
+
+// Header parser of the PCM WAV and RF64 files. Only the sample layouts
+// matching the storage formats (see OcaSampleFormat) are accepted,
+// so that the samples can be used in place.
+
+class OcaWavFile
+{
+  public:
+    struct Info {
+      double  rate;
+      int     channels;
+      int     format;
+      qint64  offset;     // position of the samples in the file
+      qint64  length;     // number of frames
+    };
+
+  public:
+    static bool readInfo( const QString& path, Info* info, QString* error );
+};
+
+#endif // OcaWavFile_h
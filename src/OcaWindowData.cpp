@@ -475,3 +475,45 @@ bool OcaWindowData::setCacheBase( const QString& path )
 
 // ------------------------------------------------------------------------------------
 
+int OcaWindowData::getBlockCacheSize() const
+{
+  return OcaApp::getOcaInstance()->getBlockCacheSize();
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaWindowData::setBlockCacheSize( int size_mb )
+{
+  return OcaApp::getOcaInstance()->setBlockCacheSize( size_mb );
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaWindowData::getMemoryBlockLimit() const
+{
+  return OcaApp::getOcaInstance()->getMemoryBlockLimit();
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaWindowData::setMemoryBlockLimit( int size_kb )
+{
+  return OcaApp::getOcaInstance()->setMemoryBlockLimit( size_kb );
+}
+
+// ------------------------------------------------------------------------------------
+
+int OcaWindowData::getMemoryBudget() const
+{
+  return OcaApp::getOcaInstance()->getMemoryBudget();
+}
+
+// ------------------------------------------------------------------------------------
+
+bool OcaWindowData::setMemoryBudget( int size_mb )
+{
+  return OcaApp::getOcaInstance()->setMemoryBudget( size_mb );
+}
+
+// ------------------------------------------------------------------------------------
+
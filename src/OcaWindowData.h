@@ -36,6 +36,9 @@ class OcaWindowData : public OcaObject
   Q_PROPERTY( QString output_device READ getOutputDevice WRITE setOutputDevice );
   Q_PROPERTY( QString input_device READ getInputDevice WRITE setInputDevice );
   Q_PROPERTY( QString cache_dir READ getCacheBase WRITE setCacheBase );
+  Q_PROPERTY( int block_cache_size READ getBlockCacheSize WRITE setBlockCacheSize );
+  Q_PROPERTY( int memory_block_limit READ getMemoryBlockLimit WRITE setMemoryBlockLimit );
+  Q_PROPERTY( int memory_budget READ getMemoryBudget WRITE setMemoryBudget );
 
   public:
     OcaWindowData();
@@ -97,9 +100,15 @@ class OcaWindowData : public OcaObject
     QString getOutputDevice() const;
     QString getInputDevice() const;
     QString getCacheBase() const;
+    int     getBlockCacheSize() const;
+    int     getMemoryBlockLimit() const;
+    int     getMemoryBudget() const;
     bool    setOutputDevice( const QString& dev_name );
     bool    setInputDevice( const QString& dev_name );
     bool    setCacheBase( const QString& path );
+    bool    setBlockCacheSize( int size_mb );
+    bool    setMemoryBlockLimit( int size_kb );
+    bool    setMemoryBudget( int size_mb );
 
   protected slots:
     void onMonitorClosed( OcaObject* obj );
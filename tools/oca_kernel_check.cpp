@@ -0,0 +1,218 @@
+/*
+   Copyright 2013-2019 Anton Runov
+
+   This file is part of Octaudio.
+
+   Octaudio is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Octaudio is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the simd reduction kernels of OcaAvgKernel against the scalar ones
+// and reports their throughput (built with -DOCTAUDIO_BUILD_KERNEL_CHECK=ON).
+// Usage: oca_kernel_check [-nobench]
+
+#include "OcaAvgKernel.h"
+
+#include <QtCore>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+static const char* s_kernels[] = { "sse2", "avx2" };
+
+// ------------------------------------------------------------------------------------
+
+static quint32 s_seed = 12345;
+
+static double random_value()
+{
+  s_seed = s_seed * 1664525u + 1013904223u;
+  return ( s_seed >> 8 ) / (double)( 1 << 23 ) - 1.0;
+}
+
+// ------------------------------------------------------------------------------------
+
+static void fill_samples( double* dst, int channels, long frames )
+{
+  // a different offset per channel, the variance is computed from the sums
+  for( long j = 0; j < frames; j++ ) {
+    for( int c = 0; c < channels; c++ ) {
+      *dst++ = 0.25 * c + random_value();
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static void fill_entries( OcaAvgData* dst, int channels, long frames )
+{
+  for( long j = 0; j < frames * channels; j++ ) {
+    const double avg = random_value();
+    const double r = fabs( random_value() );
+    dst->min = avg - r;
+    dst->max = avg + r;
+    dst->avg = avg;
+    dst->var = r * r / 3;
+    dst++;
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+static bool is_close( double a, double b )
+{
+  return fabs( a - b ) <= 1e-9 * ( 1.0 + fabs( b ) );
+}
+
+// ------------------------------------------------------------------------------------
+
+static int compare( const char* func, const char* kernel, int channels, int factor,
+                                long len, const OcaAvgData* a, const OcaAvgData* b )
+{
+  for( long i = 0; i < len * channels; i++ ) {
+    if( ( a[i].min != b[i].min ) || ( a[i].max != b[i].max )
+                  || ( ! is_close( a[i].avg, b[i].avg ) )
+                  || ( ! is_close( a[i].var, b[i].var ) ) ) {
+      printf( "FAILED %s %s: channels %d, factor %d, len %ld, entry %ld:"
+              " (%g %g %g %g) != (%g %g %g %g)\n",
+              func, kernel, channels, factor, len, i,
+              a[i].min, a[i].max, a[i].avg, a[i].var,
+              b[i].min, b[i].max, b[i].avg, b[i].var );
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------------------
+
+static int check_kernel( const char* kernel )
+{
+  // every factor, 1..8 channels and a few lengths,
+  // the sources are not aligned to exercise the unaligned loads
+  int failures = 0;
+  for( int channels = 1; channels <= 8; channels++ ) {
+    for( int factor = 2; factor <= 1024; factor++ ) {
+      const long len = 1 + ( factor + channels ) % 5;
+      const long n = len * factor;
+      std::vector<double> samples( n * channels + 1 );
+      std::vector<OcaAvgData> entries( n * channels + 1 );
+      fill_samples( &samples[1], channels, n );
+      fill_entries( &entries[1], channels, n );
+
+      std::vector<OcaAvgData> ref( len * channels );
+      std::vector<OcaAvgData> out( len * channels );
+      OcaAvgKernel::calcAvgScalar( &ref[0], &samples[1], channels, len, factor );
+      OcaAvgKernel::calcAvg( &out[0], &samples[1], channels, len, factor );
+      failures += compare( "calcAvg", kernel, channels, factor, len, &out[0], &ref[0] );
+
+      OcaAvgKernel::calcAvg2Scalar( &ref[0], &entries[1], channels, len, factor );
+      OcaAvgKernel::calcAvg2( &out[0], &entries[1], channels, len, factor );
+      failures += compare( "calcAvg2", kernel, channels, factor, len, &out[0], &ref[0] );
+    }
+  }
+  printf( "%s: %s\n", kernel, failures ? "FAILED" : "ok" );
+  return failures;
+}
+
+// ------------------------------------------------------------------------------------
+
+static double measure( bool entries, int channels, int factor )
+{
+  // MB/s of the source data, each run takes at least 200 ms
+  const long frames = 1 << 18;
+  const long len = frames / factor;
+  std::vector<double> samples;
+  std::vector<OcaAvgData> src;
+  std::vector<OcaAvgData> dst( len * channels );
+  double bytes = 0;
+  if( entries ) {
+    src.resize( frames * channels );
+    fill_entries( &src[0], channels, frames );
+    bytes = sizeof( OcaAvgData ) * (double)( len * factor * channels );
+  }
+  else {
+    samples.resize( frames * channels );
+    fill_samples( &samples[0], channels, frames );
+    bytes = sizeof( double ) * (double)( len * factor * channels );
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  long runs = 0;
+  do {
+    if( entries ) {
+      OcaAvgKernel::calcAvg2( &dst[0], &src[0], channels, len, factor );
+    }
+    else {
+      OcaAvgKernel::calcAvg( &dst[0], &samples[0], channels, len, factor );
+    }
+    runs++;
+  } while( 200 > timer.elapsed() );
+  return bytes * runs / ( timer.nsecsElapsed() * 1e-3 );
+}
+
+// ------------------------------------------------------------------------------------
+
+static void bench_kernels()
+{
+  const int channels[] = { 1, 2, 4, 8 };
+  const int factors[] = { 4, 16, 256 };
+  const char* names[] = { "scalar", "sse2", "avx2" };
+  for( int e = 0; e < 2; e++ ) {
+    printf( "\n%s MB/s\n%-12s", e ? "calcAvg2" : "calcAvg", "ch x factor" );
+    for( int k = 0; k < 3; k++ ) {
+      printf( "%10s", names[k] );
+    }
+    printf( "\n" );
+    for( int c = 0; c < 4; c++ ) {
+      for( int f = 0; f < 3; f++ ) {
+        printf( "%2d x %-7d", channels[c], factors[f] );
+        for( int k = 0; k < 3; k++ ) {
+          if( OcaAvgKernel::setKernel( names[k] ) ) {
+            printf( "%10.0f", measure( 0 < e, channels[c], factors[f] ) );
+          }
+          else {
+            printf( "%10s", "-" );
+          }
+        }
+        printf( "\n" );
+      }
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------------
+
+int main( int argc, char** argv )
+{
+  const bool bench = ( 2 > argc ) || ( 0 != strcmp( argv[1], "-nobench" ) );
+  int failures = 0;
+  for( int k = 0; k < 2; k++ ) {
+    if( OcaAvgKernel::setKernel( s_kernels[k] ) ) {
+      failures += check_kernel( s_kernels[k] );
+    }
+    else {
+      printf( "%s: not supported\n", s_kernels[k] );
+    }
+  }
+  if( bench ) {
+    bench_kernels();
+  }
+  return failures ? 1 : 0;
+}
+
+// ------------------------------------------------------------------------------------
+
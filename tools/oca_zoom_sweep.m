@@ -0,0 +1,58 @@
+## Copyright 2013-2019 Anton Runov
+##
+## This file is part of Octaudio.
+##
+## Octaudio is free software: you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation, either version 3 of the License, or
+## (at your option) any later version.
+##
+## Octaudio is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with Octaudio.  If not, see <http://www.gnu.org/licenses/>.
+
+## oca_zoom_sweep( duration=600, rate=48000, width=1000 )
+##
+## Measures the block cache reads of a zoom sweep for several pyramid factors.
+## A noise track is imported with each setting, then the view zooms in to the
+## middle of the track by sqrt(2) per step, from the whole track down to `width`
+## samples, reading about `width` entries per view with oca_data_getavg.
+## The cache is emptied before each sweep, the printed volumes are the deltas
+## of the "pyramid_read" and "samples_read" counters of oca_global_getinfo.
+## Usage (in octaudio): addpath( "tools" ); oca_zoom_sweep
+
+function oca_zoom_sweep( duration=600, rate=48000, width=1000 )
+  factors = { "4", "8", "32", "4,8" };
+  path = [ tempname() ".wav" ];
+  audiowrite( path, 2 * rand( round( duration * rate ), 1 ) - 1, rate );
+  cache_size = oca_global_getprop( "block_cache_size" );
+  for k = 1:numel( factors )
+    id = oca_track_add( [ "zoom_sweep_" factors{k} ], rate );
+    oca_track_setprop( "pyramid_factors", factors{k}, id );
+    oca_data_import( path, id );
+
+    # the levels were read into the cache while they were built
+    oca_global_setprop( "block_cache_size", 0 );
+    oca_global_setprop( "block_cache_size", cache_size );
+    c0 = oca_global_getinfo( "block_cache" );
+    views = 0;
+    entries = 0;
+    len = duration;
+    while len * rate >= width
+      mins = oca_data_getavg( [ ( duration - len ) / 2, len ], max( 1, len * rate / width ), id );
+      entries += numel( mins );
+      views++;
+      len /= sqrt( 2 );
+    end
+    c1 = oca_global_getinfo( "block_cache" );
+    printf( "factors %-4s: %d views, %d entries, pyramid read %.2f MB, samples read %.2f MB\n",
+            factors{k}, views, entries, ( c1.pyramid_read - c0.pyramid_read ) / 2^20,
+            ( c1.samples_read - c0.samples_read ) / 2^20 );
+    oca_track_remove( id );
+  end
+  delete( path );
+endfunction